@@ -14,6 +14,8 @@ struct Light
 struct PointLight : public Light
 {
     math::Position<3> position;
+    // A non-null radius makes a spherical light, casting soft shadows (sampled stochastically).
+    double radius{0.};
 };
 
 
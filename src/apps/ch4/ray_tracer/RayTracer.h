@@ -7,30 +7,141 @@
 
 #include <arte/Image.h>
 
+#include <focg-common/Denoising.h>
+#include <focg-common/Parallel.h>
+#include <focg-common/Tonemapping.h>
+
 #include <optional>
 
+#include <cassert>
+
 
 namespace ad {
 namespace focg {
 
 
+/// \brief Color of the sample aSample of pixel (i, j), i and j being in image space (i.e. top-left origin).
+///
+/// The result only depends on the arguments, whatever the thread tracing it (see seedSampling()).
+inline math::hdr::Rgb_d tracePixel(const Scene & aScene, const View & aView,
+                                   int i, int j, const int aRecursionLimit,
+                                   int aSample = 0)
+{
+    seedSampling(i, j, aSample);
+    // The image origin is top-left, the ray tracer viewport is bottom-left
+    // we take j in the image space, so it corresponds to the viewspace coordinate height-j.
+    return getRayColor(aView.getRay(i, aView.getResolution().height()-j), Interval{}, aScene, aRecursionLimit);
+}
+
+
+/// \brief Accumulate aSamplesPerPixel radiance samples per pixel in aFramebuffer.
+///
+/// Nothing is quantized at this stage: the framebuffer can be tonemapped (and re-exposed) later.
+/// \note Samples only differ when the scene is stochastic (i.e. spherical lights).
+void rayTrace(const Scene & aScene, const View & aView, HdrFramebuffer & aFramebuffer,
+              const int aRecursionLimit = 5,
+              const int aSamplesPerPixel = 1,
+              const unsigned int aThreadCount = getDefaultThreadCount())
+{
+    math::Size<2, int> resolution = aView.getResolution();
+    assert(aFramebuffer.getResolution() == resolution);
+
+    // Each row only accumulates into its own pixels.
+    parallelFor(resolution.height(), [&](std::size_t aRow)
+    {
+        const int j = static_cast<int>(aRow);
+        for (int i = 0; i != resolution.width(); ++i)
+        {
+            for (int sample = 0; sample != aSamplesPerPixel; ++sample)
+            {
+                aFramebuffer.accumulate(i, j, tracePixel(aScene, aView, i, j, aRecursionLimit, sample));
+            }
+        }
+    },
+    aThreadCount);
+}
+
 
-ad::arte::Image<math::sdr::Rgb> rayTrace(const Scene & aScene, const View & aView, const int aRecursionLimit = 5)
+/// \brief Write the features of the primary hit of each pixel, guiding the denoiser.
+///
+/// Primary rays are deterministic, so the guides are noise-free and only need to be traced once.
+void rayTraceGuides(const Scene & aScene, const View & aView, GuideBuffers & aGuides)
 {
     math::Size<2, int> resolution = aView.getResolution();
-    ad::arte::Image<math::sdr::Rgb> image{resolution, math::sdr::gWhite};
+    assert(aGuides.resolution == resolution);
 
-    for (int j = 0; j != resolution.height(); ++j)
+    parallelFor(resolution.height(), [&](std::size_t aRow)
     {
+        const int j = static_cast<int>(aRow);
         for (int i = 0; i != resolution.width(); ++i)
         {
-            // The image origin is top-left, the ray tracer viewport is bottom-left
-            // we take j in the image space, so it corresponds to the viewspace coordinate height-j.
-            image.at(i, j) = to_sdr(getRayColor(aView.getRay(i, resolution.height()-j), Interval{}, aScene, aRecursionLimit));
+            const std::size_t index = aGuides.index(i, j);
+            // Same ray as tracePixel()
+            Ray ray = aView.getRay(i, resolution.height()-j);
+            if (auto hit = aScene.hit(ray, Interval{}))
+            {
+                aGuides.normals[index] = math::Vec<3, float>{
+                    (float)hit->normal.x(), (float)hit->normal.y(), (float)hit->normal.z()};
+                aGuides.depths[index] = (float)(hit->position - ray.origin).getNorm();
+                const math::hdr::Rgb_d & albedo = hit->material->diffuseColor;
+                aGuides.albedos[index] = math::hdr::Rgb_f{(float)albedo.r(), (float)albedo.g(), (float)albedo.b()};
+            }
+            else
+            {
+                // The background is not lit, it is its own "albedo".
+                aGuides.albedos[index] = math::hdr::Rgb_f{(float)aScene.backgroundColor.r(),
+                                                          (float)aScene.backgroundColor.g(),
+                                                          (float)aScene.backgroundColor.b()};
+            }
         }
-    }
+    });
+}
+
+
+ad::arte::Image<math::sdr::Rgb> rayTrace(const Scene & aScene, const View & aView,
+                                         const int aRecursionLimit = 5,
+                                         const unsigned int aThreadCount = getDefaultThreadCount())
+{
+    HdrFramebuffer framebuffer{aView.getResolution()};
+    rayTrace(aScene, aView, framebuffer, aRecursionLimit, 1, aThreadCount);
+    return tonemap(framebuffer);
+}
+
 
-    return image;
+/// \brief Ray trace by horizontal bands of aBandHeight rows, handing each completed band to aSink.
+///
+/// Bands are traced concurrently, so the peak memory is bounded by the band size times the thread count,
+/// independently of the image resolution. Bands complete in any order.
+///
+/// \param aSink Must provide `writeBand(int aFirstRow, const std::vector<math::hdr::Rgb_d> & aBand)`,
+/// safe to call concurrently (e.g. StreamingImageFile).
+template <class T_bandSink>
+void rayTraceBands(const Scene & aScene, const View & aView, T_bandSink & aSink,
+                   const int aBandHeight = 16,
+                   const int aRecursionLimit = 5,
+                   const unsigned int aThreadCount = getDefaultThreadCount())
+{
+    assert(aBandHeight > 0);
+    math::Size<2, int> resolution = aView.getResolution();
+    const int bandCount = (resolution.height() + aBandHeight - 1) / aBandHeight;
+
+    parallelFor(bandCount, [&](std::size_t aBandId)
+    {
+        const int firstRow = static_cast<int>(aBandId) * aBandHeight;
+        const int rowCount = std::min(aBandHeight, resolution.height() - firstRow);
+
+        std::vector<math::hdr::Rgb_d> band;
+        band.reserve((std::size_t)rowCount * resolution.width());
+        for (int j = firstRow; j != firstRow + rowCount; ++j)
+        {
+            for (int i = 0; i != resolution.width(); ++i)
+            {
+                band.push_back(tracePixel(aScene, aView, i, j, aRecursionLimit));
+            }
+        }
+        aSink.writeBand(firstRow, band);
+    },
+    aThreadCount);
 }
 
 
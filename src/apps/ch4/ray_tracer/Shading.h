@@ -4,6 +4,10 @@
 #include "Ray.h"
 #include "Scene.h"
 
+#include <random>
+
+#include <cstdint>
+
 
 namespace ad {
 namespace focg {
@@ -13,6 +17,63 @@ namespace focg {
 math::hdr::Rgb_d getRayColor(const Ray & aRay, const Interval aInterval, const Scene & aScene,
                            int aRecursionLimit, math::hdr::Rgb_d aBackgroundColor);
 
+namespace detail {
+
+
+    /// \brief One generator per thread, so concurrent pixels do not contend (nor race) on it.
+    inline std::minstd_rand & getSamplingGenerator()
+    {
+        thread_local std::minstd_rand generator;
+        return generator;
+    }
+
+
+} // namespace detail
+
+
+/// \brief Reseed the light sampling of the calling thread for the sample aSample of pixel (aX, aY).
+///
+/// The random sequence of a sample then only depends on the sample itself, not on the thread tracing it
+/// (pixels are dynamically distributed to threads): renders are reproducible.
+inline void seedSampling(int aX, int aY, int aSample)
+{
+    // Integer hash mixing the three coordinates (constants from MurmurHash3 finalizer).
+    std::uint32_t hash = static_cast<std::uint32_t>(aX) * 0x9e3779b1u
+                         ^ static_cast<std::uint32_t>(aY) * 0x85ebca6bu
+                         ^ static_cast<std::uint32_t>(aSample) * 0xc2b2ae35u;
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35u;
+    hash ^= hash >> 16;
+    detail::getSamplingGenerator().seed(hash);
+}
+
+
+/// \brief Sample a position on aLight, uniformly in its volume.
+///
+/// Each call returns a different sample for a spherical light, so shadows are noisy
+/// until enough samples per pixel are accumulated (or the image is denoised).
+/// \note The sequence of samples is determined by the last seedSampling() on the calling thread.
+inline math::Position<3> sampleLightPosition(const PointLight & aLight)
+{
+    if (aLight.radius == 0.)
+    {
+        return aLight.position;
+    }
+
+    std::minstd_rand & generator = detail::getSamplingGenerator();
+    std::uniform_real_distribution<double> distribution{-1., 1.};
+    // Rejection sampling of the unit ball.
+    math::Vec<3> offset;
+    do
+    {
+        offset = math::Vec<3>{distribution(generator), distribution(generator), distribution(generator)};
+    } while (offset.dot(offset) > 1.);
+    return aLight.position + aLight.radius * offset;
+}
+
+
 math::hdr::Rgb_d shade(const Hit & aHit, const Ray & aRay, const Scene & aScene, int aRecursionLimit)
 {
     const Material & material = *aHit.material;
@@ -25,7 +86,7 @@ math::hdr::Rgb_d shade(const Hit & aHit, const Ray & aRay, const Scene & aScene,
     
     for(const auto & light : aScene.lights)
     {
-        math::UnitVec<3> lightDirection{light.position - point};
+        math::UnitVec<3> lightDirection{sampleLightPosition(light) - point};
 
         // Shadow (add current light contribution only if point is not in the light's shadow).
         if (! aScene.hit(Ray{point, lightDirection}, Interval{Interval::gEpsilon}))
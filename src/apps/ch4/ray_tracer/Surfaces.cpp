@@ -2,10 +2,44 @@
 
 #include "Intersect.h"
 
+#include <algorithm>
+#include <limits>
+
+#include <cassert>
+#include <cmath>
+
+
 namespace ad {
 namespace focg {
 
 
+namespace {
+
+
+    math::Box<double> makeBox(math::Position<3> aMin, math::Position<3> aMax)
+    {
+        return math::Box<double>{
+            aMin,
+            math::Size<3>{aMax.x() - aMin.x(), aMax.y() - aMin.y(), aMax.z() - aMin.z()}
+        };
+    }
+
+
+} // anonymous namespace
+
+
+math::Box<double> unite(const math::Box<double> & aLhs, const math::Box<double> & aRhs)
+{
+    return makeBox(
+        math::Position<3>{std::min(aLhs.xMin(), aRhs.xMin()),
+                          std::min(aLhs.yMin(), aRhs.yMin()),
+                          std::min(aLhs.zMin(), aRhs.zMin())},
+        math::Position<3>{std::max(aLhs.xMax(), aRhs.xMax()),
+                          std::max(aLhs.yMax(), aRhs.yMax()),
+                          std::max(aLhs.zMax(), aRhs.zMax())});
+}
+
+
 std::optional<Hit> Group::hit(const Ray & aRay, Interval aInterval) const
 {
     std::optional<Hit> result;
@@ -21,16 +55,224 @@ std::optional<Hit> Group::hit(const Ray & aRay, Interval aInterval) const
 }
 
 
+math::Box<double> Group::getBoundingBox() const
+{
+    if (surfaces.empty())
+    {
+        return makeBox(math::Position<3>::Zero(), math::Position<3>::Zero());
+    }
+
+    math::Box<double> result = surfaces.front()->getBoundingBox();
+    for (const auto & element : surfaces)
+    {
+        result = unite(result, element->getBoundingBox());
+    }
+    return result;
+}
+
+
+Grid::Grid(std::vector<std::shared_ptr<Surface>> aSurfaces, std::optional<math::Size<3, int>> aResolution) :
+    mSurfaces{std::move(aSurfaces)},
+    mBounds{makeBox(math::Position<3>::Zero(), math::Position<3>::Zero())}
+{
+    std::vector<math::Box<double>> boxes;
+    boxes.reserve(mSurfaces.size());
+    for (const auto & surface : mSurfaces)
+    {
+        boxes.push_back(surface->getBoundingBox());
+        mBounds = (boxes.size() == 1 ? boxes.back() : unite(mBounds, boxes.back()));
+    }
+
+    // Padding gives a volume to flat scenes, and keeps all surfaces strictly inside the grid.
+    const math::Vec<3> padding{Interval::gEpsilon, Interval::gEpsilon, Interval::gEpsilon};
+    mBounds = makeBox(mBounds.origin() - padding,
+                      mBounds.origin() + mBounds.dimension().as<math::Vec>() + padding);
+
+    mResolution = aResolution.value_or(ChooseResolution(mBounds, mSurfaces.size()));
+    assert(mResolution.width() > 0 && mResolution.height() > 0 && mResolution.depth() > 0);
+    mCellSize = math::Vec<3>{
+        mBounds.width() / mResolution.width(),
+        mBounds.height() / mResolution.height(),
+        mBounds.depth() / mResolution.depth(),
+    };
+
+    // Two passes (counting sort): count the surfaces in each cell to compute the offsets, then fill.
+    auto forEachCell = [this](const math::Box<double> & aBox, auto && aOperation)
+    {
+        math::Position<3, int> first = getCell(aBox.origin());
+        math::Position<3, int> last = getCell(aBox.origin() + aBox.dimension().as<math::Vec>());
+        for (int z = first.z(); z <= last.z(); ++z)
+        {
+            for (int y = first.y(); y <= last.y(); ++y)
+            {
+                for (int x = first.x(); x <= last.x(); ++x)
+                {
+                    aOperation(getCellIndex({x, y, z}));
+                }
+            }
+        }
+    };
+
+    const std::size_t cellCount = (std::size_t)mResolution.width() * mResolution.height() * mResolution.depth();
+    mCellOffsets.assign(cellCount + 1, 0);
+    for (const auto & box : boxes)
+    {
+        forEachCell(box, [this](std::size_t aCell){ ++mCellOffsets[aCell + 1]; });
+    }
+    for (std::size_t cell = 0; cell != cellCount; ++cell)
+    {
+        mCellOffsets[cell + 1] += mCellOffsets[cell];
+    }
+
+    mCellSurfaces.resize(mCellOffsets.back());
+    std::vector<std::uint32_t> cursors{mCellOffsets.begin(), mCellOffsets.end() - 1};
+    for (std::uint32_t surfaceId = 0; surfaceId != boxes.size(); ++surfaceId)
+    {
+        forEachCell(boxes[surfaceId], [&](std::size_t aCell){ mCellSurfaces[cursors[aCell]++] = surfaceId; });
+    }
+}
+
+
+math::Size<3, int> Grid::ChooseResolution(const math::Box<double> & aBounds,
+                                          std::size_t aSurfaceCount,
+                                          double aCellsPerSurface)
+{
+    // Cleary et al.: a cell edge length making the grid have aCellsPerSurface * N cells,
+    // so each cell contains a bounded number of surfaces on average.
+    constexpr double gMaxResolution = 128.;
+    const double volume = aBounds.width() * aBounds.height() * aBounds.depth();
+    const double cellsPerUnit = std::cbrt(aCellsPerSurface * std::max<std::size_t>(aSurfaceCount, 1) / volume);
+
+    auto axisResolution = [&](double aExtent)
+    {
+        return static_cast<int>(std::clamp(std::round(aExtent * cellsPerUnit), 1., gMaxResolution));
+    };
+    return {axisResolution(aBounds.width()), axisResolution(aBounds.height()), axisResolution(aBounds.depth())};
+}
+
+
+math::Position<3, int> Grid::getCell(math::Position<3> aPosition) const
+{
+    math::Position<3, int> cell;
+    for (int axis = 0; axis != 3; ++axis)
+    {
+        cell[axis] = std::clamp(static_cast<int>((aPosition[axis] - mBounds.origin()[axis]) / mCellSize[axis]),
+                                0, mResolution[axis] - 1);
+    }
+    return cell;
+}
+
+
+std::optional<Hit> Grid::hit(const Ray & aRay, Interval aInterval) const
+{
+    // Clip the ray interval to the grid bounds (slabs intersection).
+    const math::Position<3> boundsMax = mBounds.origin() + mBounds.dimension().as<math::Vec>();
+    double tEnter = aInterval.t0;
+    double tExit = aInterval.t1;
+    for (int axis = 0; axis != 3; ++axis)
+    {
+        if (aRay.direction[axis] == 0.)
+        {
+            if (aRay.origin[axis] < mBounds.origin()[axis] || aRay.origin[axis] > boundsMax[axis])
+            {
+                return {};
+            }
+        }
+        else
+        {
+            double tNear = (mBounds.origin()[axis] - aRay.origin[axis]) / aRay.direction[axis];
+            double tFar = (boundsMax[axis] - aRay.origin[axis]) / aRay.direction[axis];
+            if (tNear > tFar)
+            {
+                std::swap(tNear, tFar);
+            }
+            tEnter = std::max(tEnter, tNear);
+            tExit = std::min(tExit, tFar);
+        }
+    }
+    if (tEnter > tExit)
+    {
+        return {};
+    }
+
+    // 3D-DDA (Amanatides & Woo): tNext is the ray parameter where the next cell boundary is crossed on each axis.
+    math::Position<3, int> cell = getCell(aRay(tEnter));
+    int step[3];
+    double tNext[3];
+    double tDelta[3];
+    for (int axis = 0; axis != 3; ++axis)
+    {
+        if (aRay.direction[axis] == 0.)
+        {
+            step[axis] = 0;
+            tNext[axis] = tDelta[axis] = std::numeric_limits<double>::infinity();
+        }
+        else
+        {
+            step[axis] = aRay.direction[axis] > 0. ? 1 : -1;
+            int boundary = cell[axis] + (step[axis] > 0 ? 1 : 0);
+            tNext[axis] = (mBounds.origin()[axis] + boundary * mCellSize[axis] - aRay.origin[axis])
+                          / aRay.direction[axis];
+            tDelta[axis] = mCellSize[axis] / std::abs(aRay.direction[axis]);
+        }
+    }
+
+    std::optional<Hit> result;
+    for (;;)
+    {
+        const int axis = tNext[0] < tNext[1] ? (tNext[0] < tNext[2] ? 0 : 2)
+                                             : (tNext[1] < tNext[2] ? 1 : 2);
+
+        const std::size_t cellIndex = getCellIndex(cell);
+        for (std::uint32_t i = mCellOffsets[cellIndex]; i != mCellOffsets[cellIndex + 1]; ++i)
+        {
+            if (auto hit = mSurfaces[mCellSurfaces[i]]->hit(aRay, aInterval))
+            {
+                aInterval.trimRight(hit->t);
+                result = hit;
+            }
+        }
+
+        // A surface overlapping several cells can be hit beyond the current cell,
+        // where it might still be occluded by a surface only listed in the next cells.
+        if ((result && result->t <= tNext[axis]) || tNext[axis] > tExit)
+        {
+            return result;
+        }
+
+        cell[axis] += step[axis];
+        if (cell[axis] < 0 || cell[axis] >= mResolution[axis])
+        {
+            return result;
+        }
+        tNext[axis] += tDelta[axis];
+    }
+}
+
+
 std::optional<Hit> Sphere::hit(const Ray & aRay, Interval aInterval) const
 {
     return intersect(aRay, *this, aInterval);
 }
 
 
+math::Box<double> Sphere::getBoundingBox() const
+{
+    const math::Vec<3> extent{radius, radius, radius};
+    return makeBox(center - extent, center + extent);
+}
+
+
 std::optional<Hit> Triangle::hit(const Ray & aRay, Interval aInterval) const
 {
     return intersect(aRay, *this, aInterval);
 }
 
+
+math::Box<double> Triangle::getBoundingBox() const
+{
+    return unite(makeBox(a, a), unite(makeBox(b, b), makeBox(c, c)));
+}
+
 } // namespace focg
 } // namespace ad
@@ -5,8 +5,10 @@
 #include "Material.h"
 #include "Ray.h"
 
+#include <math/Box.h>
 #include <math/Vector.h>
 
+#include <cstdint>
 #include <initializer_list>
 #include <optional>
 #include <memory>
@@ -20,25 +22,80 @@ namespace focg {
 struct Surface
 {
     virtual std::optional<Hit> hit(const Ray & aRay, Interval aInterval) const = 0;
+
+    /// \brief Axis aligned box enclosing the surface, used by the acceleration structures.
+    virtual math::Box<double> getBoundingBox() const = 0;
 };
 
 
+/// \brief Smallest box containing both boxes.
+math::Box<double> unite(const math::Box<double> & aLhs, const math::Box<double> & aRhs);
+
+
+/// \brief Linear scan over all its surfaces.
 struct Group : public Surface
 {
     std::optional<Hit> hit(const Ray & aRay, Interval aInterval) const override;
+    math::Box<double> getBoundingBox() const override;
 
     // No aggregate initialization due to virtual function
     Group(std::initializer_list<std::shared_ptr<Surface>> aSurfaces) :
         surfaces{aSurfaces}
     {}
 
+    explicit Group(std::vector<std::shared_ptr<Surface>> aSurfaces) :
+        surfaces{std::move(aSurfaces)}
+    {}
+
     std::vector<std::shared_ptr<Surface>> surfaces;
 };
 
 
+/// \brief Uniform grid partitioning its bounding box in cells, each listing the surfaces overlapping it.
+///
+/// Building is linear in the number of surfaces, and a ray only tests the surfaces in the cells
+/// it traverses (3D-DDA), in front-to-back order. It works best for many primitives of similar size
+/// spread through the scene (e.g. particles), a Group remains better for a handful of surfaces.
+/// \note Surfaces cannot be modified after construction (contrary to Group).
+class Grid : public Surface
+{
+public:
+    /// \param aResolution Number of cells along each axis, deduced by ChooseResolution() when not provided.
+    explicit Grid(std::vector<std::shared_ptr<Surface>> aSurfaces,
+                  std::optional<math::Size<3, int>> aResolution = std::nullopt);
+
+    std::optional<Hit> hit(const Ray & aRay, Interval aInterval) const override;
+    math::Box<double> getBoundingBox() const override
+    { return mBounds; }
+
+    math::Size<3, int> getResolution() const
+    { return mResolution; }
+
+    /// \brief Close to cubic cells, the grid having about aCellsPerSurface cells for each surface.
+    static math::Size<3, int> ChooseResolution(const math::Box<double> & aBounds,
+                                               std::size_t aSurfaceCount,
+                                               double aCellsPerSurface = 2.);
+
+private:
+    math::Position<3, int> getCell(math::Position<3> aPosition) const;
+    std::size_t getCellIndex(math::Position<3, int> aCell) const
+    { return aCell.x() + (std::size_t)mResolution.width() * (aCell.y() + (std::size_t)mResolution.height() * aCell.z()); }
+
+    std::vector<std::shared_ptr<Surface>> mSurfaces;
+    math::Box<double> mBounds;
+    math::Size<3, int> mResolution;
+    math::Vec<3> mCellSize;
+    // Compact storage of the cells' content:
+    // the surfaces of cell c are indexed by mCellSurfaces[mCellOffsets[c]] to mCellSurfaces[mCellOffsets[c+1]] (excluded).
+    std::vector<std::uint32_t> mCellOffsets;
+    std::vector<std::uint32_t> mCellSurfaces;
+};
+
+
 struct Sphere : public Surface
 {
     std::optional<Hit> hit(const Ray & aRay, Interval aInterval) const override;
+    math::Box<double> getBoundingBox() const override;
 
     // No aggregate initialization due to virtual function
     Sphere(std::shared_ptr<Material> aMaterial, math::Position<3> aCenter, double aRadius) :
@@ -56,6 +113,7 @@ struct Sphere : public Surface
 struct Triangle : public Surface
 {
     std::optional<Hit> hit(const Ray & aRay, Interval aInterval) const override;
+    math::Box<double> getBoundingBox() const override;
 
     // No aggregate initialization due to virtual function
     Triangle(std::shared_ptr<Material> aMaterial, 
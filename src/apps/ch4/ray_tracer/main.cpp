@@ -2,40 +2,53 @@
 #include "Surfaces.h"
 #include "View.h"
 
+#include <focg-common/ImageStream.h>
+#include <focg-common/RenderService.h>
+
 #include <math/Color.h>
 
+#include <chrono>
+#include <optional>
+#include <random>
+
 #include <cstdlib>
 
 
 using namespace ad;
 
 
-void render(std::filesystem::path aImagePath, math::Size<2, int> aResolution)
+const math::Position<3> gPerspectivePosition{-0., 600., 1000.};
+const math::Position<3> gPerspectiveTarget{0., 0., -100.};
+
+
+focg::Image makeViewport(math::Size<2, int> aResolution)
 {
-    focg::Image viewport{
+    return focg::Image{
         math::Rectangle<double>{
             {-150., -150.},
             {300., 300.}
         },
         aResolution
     };
+}
 
-    focg::OrthographicView orthographic{
-        math::Position<3>{0., 100., 0.},
-        {0., -100., -100.},
-        {0., 1., 0.},
-        viewport
-    };
 
-    math::Position<3> perspectivePosition{-0., 600., 1000.};
-    focg::PerspectiveView perspective{
-        perspectivePosition,
-        math::Position<3>{0., 0., -100.} - perspectivePosition,
+focg::PerspectiveView makePerspective(math::Position<3> aPosition,
+                                      math::Position<3> aTarget,
+                                      math::Size<2, int> aResolution)
+{
+    return focg::PerspectiveView{
+        aPosition,
+        aTarget - aPosition,
         {0., 1., 0.},
-        viewport,
+        makeViewport(aResolution),
         800
     };
+}
 
+
+focg::Scene makeScene()
+{
     math::hdr::Rgb_d sphereSpecularColor{math::hdr::gWhite<> * 0.5};
     double colorIntensity = 0.7;
     auto cyanMaterial = std::make_shared<focg::Material>(
@@ -90,19 +103,235 @@ void render(std::filesystem::path aImagePath, math::Size<2, int> aResolution)
         ambientLight
     };
 
+    return scene;
+}
+
+
+/// \brief Render soft shadows with few samples per pixel, then denoise the result.
+void renderSoftShadows(std::filesystem::path aImagePath, math::Size<2, int> aResolution)
+{
+    constexpr int gSamplesPerPixel = 4;
+
+    focg::PerspectiveView perspective = makePerspective(gPerspectivePosition, gPerspectiveTarget, aResolution);
+
+    focg::Scene scene = makeScene();
+    for (focg::PointLight & light : scene.lights)
+    {
+        light.radius = 0.1 * (light.position - math::Position<3>::Zero()).getNorm();
+    }
+
+    focg::HdrFramebuffer framebuffer{aResolution};
+    rayTrace(scene, perspective, framebuffer, 5, gSamplesPerPixel);
+    tonemap(framebuffer).saveFile(aImagePath / "ch4_soft_shadows_noisy.ppm");
+
+    focg::GuideBuffers guides{aResolution};
+    rayTraceGuides(scene, perspective, guides);
+    tonemap(denoiseAtrous(framebuffer.resolve(), guides)).saveFile(aImagePath / "ch4_soft_shadows_denoised.ppm");
+}
+
+
+void render(std::filesystem::path aImagePath, math::Size<2, int> aResolution)
+{
+    focg::OrthographicView orthographic{
+        math::Position<3>{0., 100., 0.},
+        {0., -100., -100.},
+        {0., 1., 0.},
+        makeViewport(aResolution)
+    };
+
+    focg::PerspectiveView perspective = makePerspective(gPerspectivePosition, gPerspectiveTarget, aResolution);
+
+    focg::Scene scene = makeScene();
+
     //rayTrace(scene, orthographic).saveFile(aImagePath);
-    rayTrace(scene, perspective).saveFile(aImagePath / "ch4_raytraced.ppm");
+    focg::HdrFramebuffer framebuffer{aResolution};
+    rayTrace(scene, perspective, framebuffer);
+    tonemap(framebuffer).saveFile(aImagePath / "ch4_raytraced.ppm");
+
+    // Re-exposing only runs the tonemapping pass again, the scene is not traced a second time.
+    tonemap(framebuffer, {-1., focg::ToneOperator::Reinhard, true})
+        .saveFile(aImagePath / "ch4_raytraced_reexposed.ppm");
+
+    renderSoftShadows(aImagePath, aResolution);
 }
 
+
+/// \brief Keep the scene resident, and render each request received on stdin to stdout.
+///
+/// Recognized parameters: eye, target, resolution, recursion,
+/// and lightN / lightN_intensity to move or change the intensity of the N-th light.
+void serve()
+{
+    const focg::Scene scene = makeScene();
+
+    focg::setBinaryMode(stdout);
+    focg::serve(std::cin, std::cout, [&scene](const focg::RenderRequest & aRequest)
+    {
+        // The geometry is shared with the resident scene, only the lights are copied.
+        focg::Scene requestScene{scene};
+        for (std::size_t lightId = 0; lightId != requestScene.lights.size(); ++lightId)
+        {
+            focg::PointLight & light = requestScene.lights[lightId];
+            const std::string key = "light" + std::to_string(lightId);
+
+            light.position = aRequest.get(key, light.position);
+            math::Vec<3> intensity = aRequest.get(key + "_intensity",
+                math::Vec<3>{light.intensity.r(), light.intensity.g(), light.intensity.b()});
+            light.intensity = math::hdr::Rgb_d{intensity.x(), intensity.y(), intensity.z()};
+        }
+
+        math::Size<2, int> resolution = aRequest.get("resolution", math::Size<2, int>{800, 800});
+        if (resolution.width() <= 0 || resolution.height() <= 0)
+        {
+            throw std::invalid_argument{"Resolution must be strictly positive."};
+        }
+
+        focg::PerspectiveView perspective = makePerspective(aRequest.get("eye", gPerspectivePosition),
+                                                            aRequest.get("target", gPerspectiveTarget),
+                                                            resolution);
+        return focg::rayTrace(requestScene, perspective, (int)aRequest.get("recursion", 5));
+    });
+}
+
+
+/// \brief Render to aImagePath by bands, never holding the complete image in memory.
+void renderStreamed(std::filesystem::path aImagePath, math::Size<2, int> aResolution)
+{
+    focg::PerspectiveView perspective = makePerspective(gPerspectivePosition, gPerspectiveTarget, aResolution);
+    focg::StreamingImageFile output{aImagePath, aResolution, focg::StreamingImageFile::DeduceFormat(aImagePath)};
+    focg::rayTraceBands(makeScene(), perspective, output);
+}
+
+
+/// \brief Compare the linear scan (Group) with the uniform Grid, on a particle dump of aSphereCount spheres.
+///
+/// Both are rendered on a single thread, so the timings do not depend on the core count.
+void benchmark(std::size_t aSphereCount, math::Size<2, int> aResolution)
+{
+    using Clock = std::chrono::steady_clock;
+    auto milliseconds = [](Clock::duration aDuration)
+    {
+        return std::chrono::duration<double, std::milli>(aDuration).count();
+    };
+
+    // Fixed seed, so the scene is the same from one run to the next.
+    std::minstd_rand generator{1};
+    std::uniform_real_distribution<double> horizontal{-150., 150.};
+    std::uniform_real_distribution<double> vertical{-50., 250.};
+    std::uniform_real_distribution<double> depth{-400., 100.};
+    std::uniform_real_distribution<double> radius{2., 6.};
+    std::uniform_real_distribution<double> channel{0.2, 1.};
+
+    std::vector<std::shared_ptr<focg::Material>> materials;
+    for (int materialId = 0; materialId != 8; ++materialId)
+    {
+        math::hdr::Rgb_d color{channel(generator), channel(generator), channel(generator)};
+        materials.push_back(std::make_shared<focg::Material>(
+            focg::Material{color * 0.5, color, math::hdr::gWhite<> * 0.3, 50}));
+    }
+
+    std::vector<std::shared_ptr<focg::Surface>> spheres;
+    spheres.reserve(aSphereCount);
+    for (std::size_t sphereId = 0; sphereId != aSphereCount; ++sphereId)
+    {
+        spheres.push_back(std::make_shared<focg::Sphere>(
+            materials[sphereId % materials.size()],
+            math::Position<3>{horizontal(generator), vertical(generator), depth(generator)},
+            radius(generator)));
+    }
+
+    focg::Scene scene = makeScene();
+    focg::PerspectiveView perspective = makePerspective(gPerspectivePosition, gPerspectiveTarget, aResolution);
+
+    auto start = Clock::now();
+    scene.geometry = std::make_shared<focg::Group>(spheres);
+    const double groupBuild = milliseconds(Clock::now() - start);
+    start = Clock::now();
+    arte::Image<math::sdr::Rgb> groupImage = focg::rayTrace(scene, perspective, 5, 1);
+    const double groupRender = milliseconds(Clock::now() - start);
+
+    start = Clock::now();
+    auto grid = std::make_shared<focg::Grid>(spheres);
+    const double gridBuild = milliseconds(Clock::now() - start);
+    scene.geometry = grid;
+    start = Clock::now();
+    arte::Image<math::sdr::Rgb> gridImage = focg::rayTrace(scene, perspective, 5, 1);
+    const double gridRender = milliseconds(Clock::now() - start);
+
+    std::size_t differences = 0;
+    for (int j = 0; j != aResolution.height(); ++j)
+    {
+        for (int i = 0; i != aResolution.width(); ++i)
+        {
+            differences += (groupImage.at(i, j) != gridImage.at(i, j));
+        }
+    }
+
+    math::Size<3, int> gridResolution = grid->getResolution();
+    std::cout << aSphereCount << " spheres, " << aResolution.width() << "x" << aResolution.height() << " pixels, single thread.\n"
+              << "Group: build " << groupBuild << " ms, render " << groupRender << " ms.\n"
+              << "Grid " << gridResolution.width() << "x" << gridResolution.height() << "x" << gridResolution.depth()
+              << ": build " << gridBuild << " ms, render " << gridRender << " ms.\n"
+              << "Speedup: " << groupRender / (gridBuild + gridRender) << ", "
+              << differences << " differing pixel(s).\n";
+}
+
+
+/// \brief The strictly positive integer in aArgument, if it only contains such an integer.
+std::optional<int> parseDimension(const std::string & aArgument)
+{
+    std::size_t consumed = 0;
+    int value = 0;
+    try
+    {
+        value = std::stoi(aArgument, &consumed);
+    }
+    catch (std::logic_error &)
+    {
+        return std::nullopt;
+    }
+    if (consumed != aArgument.size() || value <= 0)
+    {
+        return std::nullopt;
+    }
+    return value;
+}
+
+
 int main(int argc, char ** argv)
 {
-    if (argc != 2)
+    std::optional<int> streamWidth;
+    std::optional<int> streamHeight;
+    if (argc == 5 && std::string{argv[1]} == "--stream")
     {
-        std::cerr << "Usage: " << argv[0] << " output_image_folder\n";
-        return EXIT_FAILURE;
+        streamWidth = parseDimension(argv[3]);
+        streamHeight = parseDimension(argv[4]);
     }
 
-    render(argv[1], {800, 800});
+    if (argc == 2 && std::string{argv[1]} == "--serve")
+    {
+        serve();
+    }
+    else if (streamWidth && streamHeight)
+    {
+        renderStreamed(argv[2], {*streamWidth, *streamHeight});
+    }
+    else if (argc == 3 && std::string{argv[1]} == "--benchmark")
+    {
+        benchmark(std::stoul(argv[2]), {400, 400});
+    }
+    else if (argc == 2)
+    {
+        render(argv[1], {800, 800});
+    }
+    else
+    {
+        std::cerr << "Usage: " << argv[0] << " output_image_folder\n"
+                  << "       " << argv[0] << " --serve\n"
+                  << "       " << argv[0] << " --stream output_image.(ppm|pfm) width height (strictly positive)\n"
+                  << "       " << argv[0] << " --benchmark sphere_count\n";
+        return EXIT_FAILURE;
+    }
 
     return EXIT_SUCCESS;
 }
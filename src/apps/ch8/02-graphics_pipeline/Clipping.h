@@ -7,10 +7,15 @@
 #include <math/Box.h>
 #include <math/Homogeneous.h>
 #include <math/Interpolation/Interpolation.h>
+#include <math/Matrix.h>
 
+#include <array>
+#include <limits>
 #include <optional>
+#include <vector>
 
 #include <cassert>
+#include <cstdint>
 
 
 namespace ad {
@@ -21,11 +26,6 @@ using HPos = math::Position<4>;
 using HVec = math::Vec<4>;
 
 
-struct ViewVolume;
-using Evaluator = double(*)(HPos, const ViewVolume &);
-using Solver = double(*)(HPos, HPos);
-
-
 struct ViewVolume
 {
     // Clipping in homogenous space
@@ -33,10 +33,14 @@ struct ViewVolume
     // Note: For the equation of the solver in clipping space,
     // see: https://fabiensanglard.net/polygon_codec/clippingdocument/p245-blinn.pdf (CLIPPING USING HOMOGENEOUS COORDINATES, Blinn)
     // see: https://fabiensanglard.net/polygon_codec/clippingdocument/Clipping.pdf (Clipping, Kenneth I. Joy)
-    struct Plane
+    enum Plane : std::size_t
     {
-        Evaluator f;         
-        Solver solver;
+        Left,
+        Right,
+        Bottom,
+        Top,
+        Front,
+        Back,
     };
 
     ViewVolume(math::Box<double> aBox) :
@@ -45,74 +49,78 @@ struct ViewVolume
         t{aBox.yMax()},
         b{aBox.yMin()},
         n{aBox.zMax()},
-        f{aBox.zMin()},
-        planes {
-            Plane{ // Left
-                [](HPos aPos, const ViewVolume & aVolume) -> double
-                { return -aPos.x() + aVolume.l * aPos.w(); },
-                [](HPos a, HPos b) -> double
-                { return (a.w() + a.x()) / ( (a.w() + a.x()) - (b.w() + b.x())); },
-            },
-            Plane{ // Right
-                [](HPos aPos, const ViewVolume & aVolume) -> double
-                { return aPos.x() - aVolume.r * aPos.w(); },
-                [](HPos a, HPos b) -> double
-                { return (a.w() - a.x()) / ( (a.w() - a.x()) - (b.w() - b.x())); },
-            },
-            Plane{ // Bottom
-                [](HPos aPos, const ViewVolume & aVolume) -> double
-                { return -aPos.y() + aVolume.b * aPos.w(); },
-                [](HPos a, HPos b) -> double
-                { return (a.w() + a.y()) / ( (a.w() + a.y()) - (b.w() + b.y())); },
-            },
-            Plane{ // Top
-                [](HPos aPos, const ViewVolume & aVolume) -> double
-                { return aPos.y() - aVolume.t * aPos.w(); },
-                [](HPos a, HPos b) -> double
-                { return (a.w() - a.y()) / ( (a.w() - a.y()) - (b.w() - b.y())); },
-            },
-            Plane{ // Front
-                [](HPos aPos, const ViewVolume & aVolume) -> double
-                { return aPos.z() - aVolume.n * aPos.w(); },
-                [](HPos a, HPos b) -> double
-                { return (a.w() - a.z()) / ( (a.w() - a.z()) - (b.w() - b.z())); },
-            },
-            Plane{ // Back
-                [](HPos aPos, const ViewVolume & aVolume) -> double
-                { return -aPos.z() + aVolume.f * aPos.w(); },
-                [](HPos a, HPos b) -> double
-                { return (a.w() + a.z()) / ( (a.w() + a.z()) - (b.w() + b.z())); },
-            },
-        }
+        f{aBox.zMin()}
     {}
 
-    double evaluate(std::size_t aPlaneId, HPos aPosition) const
+    /// \brief The implicit equation of the plane, positive outside of the volume.
+    double evaluate(std::size_t aPlaneId, HPos aPos) const
     {
-        return planes[aPlaneId].f(aPosition, *this);
+        switch (aPlaneId)
+        {
+        case Left:
+            return -aPos.x() + l * aPos.w();
+        case Right:
+            return aPos.x() - r * aPos.w();
+        case Bottom:
+            return -aPos.y() + b * aPos.w();
+        case Top:
+            return aPos.y() - t * aPos.w();
+        case Front:
+            return aPos.z() - n * aPos.w();
+        case Back:
+            return -aPos.z() + f * aPos.w();
+        }
+        // Invalid plane: NaN makes every comparison false, instead of silently evaluating another plane.
+        assert(false);
+        return std::numeric_limits<double>::quiet_NaN();
     }
 
+    /// \brief Parameter of the intersection of segment [a, b] with the plane (0 at a, 1 at b).
+    /// \note The equation is linear in homogeneous coordinates, so it is interpolated linearly.
     double solveForT(std::size_t aPlaneId, HPos a, HPos b) const
     {
-        return planes[aPlaneId].solver(a, b);
+        double fa = evaluate(aPlaneId, a);
+        return fa / (fa - evaluate(aPlaneId, b));
+    }
+
+    /// \brief Bit i is set if aPos is outside of plane i.
+    std::uint8_t outcode(HPos aPos) const
+    {
+        return (-aPos.x() + l * aPos.w() > 0.) << Left
+            | (aPos.x() - r * aPos.w() > 0.) << Right
+            | (-aPos.y() + b * aPos.w() > 0.) << Bottom
+            | (aPos.y() - t * aPos.w() > 0.) << Top
+            | (aPos.z() - n * aPos.w() > 0.) << Front
+            | (-aPos.z() + f * aPos.w() > 0.) << Back;
     }
 
     static constexpr std::size_t gPlanesCount = 6;
     double l, r, t, b, n, f;
-    std::array<Plane, gPlanesCount> planes;
 };
 
 
-/// \brief Returns true if both evaluations place the point on the same side of the plane
+/// \brief Whether aBounds, transformed by aLocalToClip, is entirely outside of aVolume.
 ///
-/// \important Both points are on the same side if:
-/// * both their evaluations are non-null and of the same sign 
-/// * or both are either negative or zero.
-bool onSameSide(double aLhs, double aRhs)
+/// Conservative: a box that is outside is only detected when all its corners are outside of the same plane.
+inline bool isOutside(const math::Box<double> & aBounds,
+                      const math::Matrix<4, 4> & aLocalToClip,
+                      const ViewVolume & aVolume)
 {
-    double sign = aLhs * aRhs;
-    return (sign > 0.) || (sign == 0. && (aLhs + aRhs) <= 0.);
+    std::uint8_t outside = 0b111111;
+    for (int corner = 0; corner != 8 && outside != 0; ++corner)
+    {
+        HPos position{
+            (corner & 0b001) ? aBounds.xMax() : aBounds.xMin(),
+            (corner & 0b010) ? aBounds.yMax() : aBounds.yMin(),
+            (corner & 0b100) ? aBounds.zMax() : aBounds.zMin(),
+            1.
+        };
+        outside &= aVolume.outcode(position * aLocalToClip);
+    }
+    return outside != 0;
 }
 
+
 //
 // Lines
 //
@@ -159,93 +167,165 @@ inline std::optional<Line> clip(Line aLine, const ViewVolume & aVolume)
 //
 // Triangles
 //
-template <class T_vertex, class T_insertIterator>
-inline void clip_impl(const Triangle<T_vertex> & aTriangle,
-                      T_insertIterator && aInserter,     
-                      const ViewVolume & aVolume,
-                      std::size_t aStartingPlane)
+
+// Notes:
+// Triangles are clipped as polygons (Sutherland-Hodgman), each plane removing at most one vertex
+// and adding at most two. The convex polygon resulting from clipping a triangle by the 6 planes
+// has at most 9 vertices, so it fits in a fixed-capacity buffer, then it is fanned into triangles.
+//
+// Clipping is only applied against the planes that at least one vertex is outside of (outcodes),
+// so most triangles are trivially accepted (or rejected) without solving any intersection.
+
+
+/// \brief Caller provided storage for the result of clipping a triangle, never allocating.
+///
+/// It is intended to be reused for each clipped triangle (e.g. one per thread).
+template <class T_vertex>
+class ClipBuffer
 {
-    for (std::size_t planeId = aStartingPlane; planeId != ViewVolume::gPlanesCount; ++planeId)
+public:
+    static constexpr std::size_t gMaxVertices = 3 + ViewVolume::gPlanesCount;
+
+    /// \brief The resulting triangles share their first vertex (fan), and keep the winding of the input.
+    std::size_t getTriangleCount() const
+    { return mSize < 3 ? 0 : mSize - 2; }
+
+    Triangle<T_vertex> getTriangle(std::size_t aIndex) const
     {
-        double fa = aVolume.evaluate(planeId, aTriangle.a);
-        double fb = aVolume.evaluate(planeId, aTriangle.b);
-        double fc = aVolume.evaluate(planeId, aTriangle.c);
+        assert(aIndex < getTriangleCount());
+        return {polygon()[0], polygon()[aIndex + 1], polygon()[aIndex + 2]};
+    }
 
-        if (fa > 0. && fb > 0. && fc > 0.) // all outside
-        {
-            return; // no insertion taking place
-        }
-        else if (fa > 0. || fb > 0. || fc > 0) // points are on different sides 
-                                               // (at least one outside, but not all)
-        {
-            T_vertex a = aTriangle.a;
-            T_vertex b = aTriangle.b;
-            T_vertex c = aTriangle.c;
+private:
+    template <class T>
+    friend void clip(const Triangle<T> &, const ViewVolume &, const ViewVolume &, ClipBuffer<T> &);
 
-            // Reorganize the triangle edges to make sure that:
-            // * c is on one side
-            // * a & b are both on the other side
-            // see FoCG 3rd p296
+    const std::array<T_vertex, gMaxVertices> & polygon() const
+    { return mPolygons[mCurrent]; }
 
-            if (onSameSide(fa, fc)) // b is alone on the other side
-            {
-                // rotate backward (a=c, b=a, c=b)
-                std::swap(fb, fc);
-                std::swap(b, c);
-                std::swap(fa, fb);
-                std::swap(a, b);
-            }
-            else if (onSameSide(fb, fc)) // a is alone on the otherside
-            {
-                // rotate forward (a=b, b=c, c=a)
-                std::swap(fa, fc);
-                std::swap(a, c);
-                std::swap(fa, fb);
-                std::swap(a, b);
-            }
+    std::array<std::array<T_vertex, gMaxVertices>, 2> mPolygons;
+    std::size_t mCurrent{0};
+    std::size_t mSize{0};
+};
+
+
+/// \brief Clip aTriangle, writing the result in aOut.
+///
+/// \param aVisibleVolume Triangles entirely outside one of its planes are rejected.
+/// \param aClippingVolume Triangles are only clipped against its planes. It must contain aVisibleVolume,
+/// and can be larger to implement a guard band: the rasterizer scissor then discards the fragments
+/// that are outside of the visible volume, which is cheaper than clipping.
+template <class T_vertex>
+void clip(const Triangle<T_vertex> & aTriangle,
+          const ViewVolume & aVisibleVolume,
+          const ViewVolume & aClippingVolume,
+          ClipBuffer<T_vertex> & aOut);
+
+
+/// \brief Clip aTriangle against aVolume, writing the result in aOut.
+template <class T_vertex>
+void clip(const Triangle<T_vertex> & aTriangle, const ViewVolume & aVolume, ClipBuffer<T_vertex> & aOut)
+{
+    clip(aTriangle, aVolume, aVolume, aOut);
+}
 
-            // NOTE: After swapping, C must be alone on one side of the clipping plane.
-            assert(( (void)"Point C must be swapped alone on one side of the plane.",
-                     (fc <= 0. && fa > 0. && fb > 0.) || (fc > 0. && fa <= 0. && fb <= 0.) )
-            );
 
-            double t_ac = aVolume.solveForT(planeId, a, c);
-            double t_bc = aVolume.solveForT(planeId, b, c);
+/// \brief Convenience overload allocating the result, prefer the ClipBuffer overloads.
+template <class T_vertex>
+std::vector<Triangle<T_vertex>> clip(const Triangle<T_vertex> & aTriangle, const ViewVolume & aVolume);
+
+
+//
+// Implementations
+//
+template <class T_vertex>
+void clip(const Triangle<T_vertex> & aTriangle,
+          const ViewVolume & aVisibleVolume,
+          const ViewVolume & aClippingVolume,
+          ClipBuffer<T_vertex> & aOut)
+{
+    aOut.mSize = 0;
 
-            // NOTE: The solution must strictly be on the line segment.
-            assert( 0.0 <= t_ac && t_ac <= 1.0 && 0.0 <= t_bc && t_bc <= 1.0 );
+    // Trivial reject, all vertices outside of the same visible plane.
+    if ((aVisibleVolume.outcode(aTriangle.a)
+         & aVisibleVolume.outcode(aTriangle.b)
+         & aVisibleVolume.outcode(aTriangle.c)) != 0)
+    {
+        return;
+    }
 
-            // Define intersection position
-            T_vertex vertexAC{a.pos + t_ac * (c.pos - a.pos)};
-            T_vertex vertexBC{b.pos + t_bc * (c.pos - b.pos)};
+    aOut.mCurrent = 0;
+    aOut.mPolygons[0][0] = aTriangle.a;
+    aOut.mPolygons[0][1] = aTriangle.b;
+    aOut.mPolygons[0][2] = aTriangle.c;
+    aOut.mSize = 3;
+
+    // Only the planes crossed by the triangle need clipping (none for a trivial accept).
+    std::uint8_t crossed = aClippingVolume.outcode(aTriangle.a)
+                           | aClippingVolume.outcode(aTriangle.b)
+                           | aClippingVolume.outcode(aTriangle.c);
+    for (std::size_t planeId = 0; planeId != ViewVolume::gPlanesCount && aOut.mSize != 0; ++planeId)
+    {
+        if ((crossed & (1u << planeId)) == 0)
+        {
+            continue;
+        }
 
-            // Interpolate fragment varying attributes
-            vertexAC.frag = interpolateLinear({ {(1 - t_ac), a.frag}, {t_ac, c.frag} });
-            vertexBC.frag = interpolateLinear({ {(1 - t_bc), b.frag}, {t_bc, c.frag} });
+        const std::array<T_vertex, ClipBuffer<T_vertex>::gMaxVertices> & input = aOut.mPolygons[aOut.mCurrent];
+        std::array<T_vertex, ClipBuffer<T_vertex>::gMaxVertices> & output = aOut.mPolygons[1 - aOut.mCurrent];
+        std::size_t outputSize = 0;
 
+        for (std::size_t vertexId = 0; vertexId != aOut.mSize; ++vertexId)
+        {
+            const T_vertex & current = input[vertexId];
+            const T_vertex & next = input[(vertexId + 1) % aOut.mSize];
             // NOTE evaluation == 0 is also considering the point on the in side.
-            if (fc <= 0) // c is on the *in* side of the plane, spawn a single triangle
+            const bool currentInside = aClippingVolume.evaluate(planeId, current) <= 0.;
+            const bool nextInside = aClippingVolume.evaluate(planeId, next) <= 0.;
+
+            if (currentInside)
             {
-                clip_impl<T_vertex>({vertexAC, vertexBC, c}, aInserter, aVolume, aStartingPlane + 1);
-                return;
+                output[outputSize++] = current;
             }
-            else // c is outside, spawn two triangles
+            if (currentInside != nextInside)
             {
-                clip_impl<T_vertex>({a, b,        vertexAC}, aInserter, aVolume, aStartingPlane + 1);
-                clip_impl<T_vertex>({b, vertexBC, vertexAC}, aInserter, aVolume, aStartingPlane + 1);
-                return;
+                // Always solve from the inside vertex, so an edge shared by two triangles
+                // gets the exact same intersection for both.
+                const T_vertex & in = currentInside ? current : next;
+                const T_vertex & out = currentInside ? next : current;
+                double t = aClippingVolume.solveForT(planeId, in, out);
+
+                // NOTE: The solution must strictly be on the line segment.
+                assert(0.0 <= t && t <= 1.0);
+
+                T_vertex intersection{in.pos + t * (out.pos - in.pos)};
+                // Interpolate fragment varying attributes
+                intersection.varyings = interpolateAttributes<typename T_vertex::varyings_type>({
+                    {(1 - t), in.varyings},
+                    {t, out.varyings},
+                });
+                output[outputSize++] = intersection;
             }
         }
+
+        assert(outputSize <= ClipBuffer<T_vertex>::gMaxVertices);
+        aOut.mCurrent = 1 - aOut.mCurrent;
+        aOut.mSize = outputSize;
     }
-    aInserter = aTriangle;
 }
 
 
 template <class T_vertex>
-inline std::vector<Triangle<T_vertex>> clip(const Triangle<T_vertex> & aTriangle, const ViewVolume & aVolume)
+std::vector<Triangle<T_vertex>> clip(const Triangle<T_vertex> & aTriangle, const ViewVolume & aVolume)
 {
+    ClipBuffer<T_vertex> buffer;
+    clip(aTriangle, aVolume, buffer);
+
     std::vector<Triangle<T_vertex>> result;
-    clip_impl(aTriangle, std::back_inserter(result), aVolume, 0);
+    for (std::size_t triangleId = 0; triangleId != buffer.getTriangleCount(); ++triangleId)
+    {
+        result.push_back(buffer.getTriangle(triangleId));
+    }
     return result;
 }
 
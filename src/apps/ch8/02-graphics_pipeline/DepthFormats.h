@@ -0,0 +1,106 @@
+#pragma once
+
+
+#include <algorithm>
+#include <concepts>
+#include <limits>
+#include <type_traits>
+
+#include <cmath>
+#include <cstdint>
+
+
+namespace ad {
+namespace focg {
+
+
+// Notes:
+// The window space depth of fragments goes from farPlaneZ to nearPlaneZ, near being greater than far:
+// the depth test is for superiority in all formats.
+// A depth format defines the stored value type, the cleared value, and the encoding of window space depths.
+//
+// Apart from DepthDouble, formats store the depth normalized in [0, 1], 1 being the near plane (reversed-Z).
+// The perspective divide distributes depth as 1/z: most of the scene, away from the near plane,
+// is squeezed into a small interval at the far end of the range.
+// Mapping far to 1 would put it where floating point values are the coarsest.
+// With far mapped to 0, it is where floats are the densest, which cancels out the 1/z distribution.
+// The normalized formats are cleared to the far plane, so a fragment exactly on it fails the depth test.
+
+
+/// \brief Window space depths of the near and far planes, as given to GraphicsPipeline::traverse().
+struct DepthRange
+{
+    /// \brief Map aDepth from [farPlaneZ, nearPlaneZ] to [0, 1].
+    double normalize(double aDepth) const
+    { return (aDepth - farPlaneZ) / (nearPlaneZ - farPlaneZ); }
+
+    double nearPlaneZ;
+    double farPlaneZ;
+};
+
+
+template <class T_format>
+concept DepthFormat = requires(double aDepth, const DepthRange & aRange)
+{
+    typename T_format::value_type;
+    { T_format::gCleared } -> std::convertible_to<typename T_format::value_type>;
+    { T_format::encode(aDepth, aRange) } -> std::same_as<typename T_format::value_type>;
+};
+
+
+/// \brief Window space depth, stored as is (8 bytes per pixel).
+struct DepthDouble
+{
+    using value_type = double;
+
+    // Important: for floating point, ::min() is the lowest positive value...
+    static constexpr value_type gCleared = std::numeric_limits<double>::lowest();
+
+    static value_type encode(double aDepth, const DepthRange &)
+    { return aDepth; }
+};
+
+
+/// \brief Normalized depth as a 32 bits float, with near at 1 (reversed-Z).
+struct DepthFloat32Reversed
+{
+    using value_type = float;
+
+    static constexpr value_type gCleared = 0.f;
+
+    static value_type encode(double aDepth, const DepthRange & aRange)
+    { return static_cast<float>(aRange.normalize(aDepth)); }
+};
+
+
+/// \brief Normalized depth as an unsigned integer of N_bits (unorm), with near at the maximum value.
+template <int N_bits>
+struct DepthUnorm
+{
+    static_assert(N_bits > 0 && N_bits <= 32);
+    using value_type = std::conditional_t<(N_bits <= 16), std::uint16_t, std::uint32_t>;
+
+    static constexpr value_type gCleared = 0;
+    static constexpr value_type gMaximum = static_cast<value_type>((std::uint64_t{1} << N_bits) - 1);
+
+    static value_type encode(double aDepth, const DepthRange & aRange)
+    {
+        const double normalized = std::clamp(aRange.normalize(aDepth), 0., 1.);
+        return static_cast<value_type>(std::llround(normalized * gMaximum));
+    }
+};
+
+
+using DepthUnorm16 = DepthUnorm<16>;
+// Stored in 32 bits, leaving room for an 8 bits stencil.
+using DepthUnorm24 = DepthUnorm<24>;
+
+
+static_assert(DepthFormat<DepthDouble>
+              && DepthFormat<DepthFloat32Reversed>
+              && DepthFormat<DepthUnorm16>
+              && DepthFormat<DepthUnorm24>);
+
+
+} // namespace focg
+} // namespace ad
@@ -0,0 +1,318 @@
+#pragma once
+
+
+#include "HalfSpaceRasterization.h"
+#include "Triangle.h"
+
+#include <algorithm>
+#include <array>
+#include <optional>
+
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+
+
+namespace ad {
+namespace focg {
+
+
+// Notes:
+// Fixed-point variant of the half-space rasterization (see HalfSpaceRasterization.h):
+// window space vertex positions are snapped to a subpixel grid of gSubpixelBits,
+// and the edge functions are evaluated with exact integer arithmetic.
+//
+// Since there is no rounding error, the coverage is watertight and deterministic:
+// a pixel center exactly on an edge shared by two triangles is covered by exactly one of them
+// (the owner of the edge, see the top-left rule in HalfSpaceRasterization.h),
+// whatever the order of the vertices and the block (or tile) from which the edge is evaluated.
+// The traversal (hierarchical blocks, emission by 2x2 quads) is the same as rasterizeHalfSpace().
+//
+// Edge function values are products of two subpixel coordinates, computed in 64 bits:
+// they cannot overflow as long as coordinates stay below gMaxCoordinate
+// (which the guard band ensures for any sensible resolution).
+
+
+/// \brief Number of fractional bits of the window space positions.
+constexpr int gSubpixelBits = 8;
+constexpr std::int64_t gSubpixelScale = std::int64_t{1} << gSubpixelBits;
+/// \brief Largest absolute window space coordinate (in pixels) that can be snapped.
+constexpr double gMaxCoordinate = double(1 << 20);
+
+
+/// \brief Edge function in subpixel units, positive on the inner side of the edge.
+struct FixedEdgeFunction
+{
+    /// \brief Value at the center of pixel (x, y).
+    std::int64_t operator()(int x, int y) const
+    { return stepX * x + stepY * y + c; }
+
+    // Increment of the edge function from one pixel to the next (i.e. over gSubpixelScale subpixels).
+    std::int64_t stepX;
+    std::int64_t stepY;
+    std::int64_t c;
+    // A pixel is covered when the edge function is greater or equal to the threshold:
+    // 0 if a pixel center exactly on the edge is covered, 1 otherwise.
+    std::int64_t threshold;
+};
+
+
+/// \brief Exact values of the edge functions for the lanes of a block, and the lanes coverage.
+struct FixedBlockCoverage
+{
+    std::array<std::array<std::int64_t, gLaneCount>, 3> edgeValues;
+    std::uint32_t mask; // Bit i is set when lane i is covered.
+};
+
+
+/// \brief Per-triangle constants of the fixed-point half-space rasterization.
+///
+/// Provides the same interface as HalfSpaceSetup, so it is traversed by the same code.
+struct FixedPointSetup
+{
+    /// \return Empty if the snapped triangle is degenerate, or does not overlap aScissor.
+    template <class T_vertex>
+    static std::optional<FixedPointSetup> Make(const Triangle<T_vertex> & aTriangle, const Scissor & aScissor);
+
+    /// \brief Coverage of the gLaneCount pixels of the lanes block with origin (aX, aY).
+    FixedBlockCoverage evaluateBlock(int aX, int aY) const;
+
+    /// \brief Edge values of the lanes block with origin (aX, aY), which must be entirely covered.
+    FixedBlockCoverage interpolateBlock(int aX, int aY) const;
+
+    /// \brief Classify the aSize x aSize square block with origin (aX, aY), from its corners.
+    BlockClass classifyBlock(int aX, int aY, int aSize) const;
+
+    // Opposite to vertices a, b and c (i.e. lines A, B and C of the triangle).
+    std::array<FixedEdgeFunction, 3> edges;
+    // Twice the area of the snapped triangle (in square subpixels), the same for the three edges.
+    // It is exactly computed, and only converted to double for the barycentric coordinates.
+    std::array<double, 3> denominators;
+    // Offset of each edge function from the block origin to each lane.
+    std::array<std::array<std::int64_t, gLaneCount>, 3> laneOffsets;
+    // Inclusive bounds of the pixels to rasterize.
+    int xMin, yMin, xMax, yMax;
+};
+
+
+/// \brief Rasterize aTriangle with its vertices snapped to the subpixel grid,
+/// evaluating edge functions with integer arithmetic.
+///
+/// Varyings and depth are interpolated from the original vertices,
+/// with the barycentric coordinates of the pixel in the snapped triangle.
+template <class T_vertex, class T_raster, class F_postRasterization>
+void rasterizeFixedPoint(const Triangle<T_vertex> & aTriangle,
+                         T_raster & aRaster,
+                         const F_postRasterization & aFragmentCallback,
+                         const Scissor & aScissor = {});
+
+
+//
+// Implementations
+//
+namespace detail {
+
+
+    struct SubpixelPosition
+    {
+        std::int64_t x;
+        std::int64_t y;
+    };
+
+
+    inline SubpixelPosition snap(const HPos & aPosition)
+    {
+        assert(std::abs(aPosition.x()) < gMaxCoordinate && std::abs(aPosition.y()) < gMaxCoordinate);
+        return {
+            std::llround(aPosition.x() * gSubpixelScale),
+            std::llround(aPosition.y() * gSubpixelScale),
+        };
+    }
+
+
+    /// \brief Smallest integer greater or equal to aValue / gSubpixelScale.
+    inline int ceilToPixel(std::int64_t aValue)
+    {
+        return static_cast<int>(-((-aValue) >> gSubpixelBits));
+    }
+
+
+    /// \brief Largest integer lower or equal to aValue / gSubpixelScale.
+    inline int floorToPixel(std::int64_t aValue)
+    {
+        return static_cast<int>(aValue >> gSubpixelBits);
+    }
+
+
+    /// \brief Edge from aFrom to aTo, oriented so that aOpposite is on the positive side.
+    inline FixedEdgeFunction makeFixedEdge(SubpixelPosition aFrom,
+                                           SubpixelPosition aTo,
+                                           SubpixelPosition aOpposite,
+                                           std::int64_t & aDenominator)
+    {
+        std::int64_t a = aFrom.y - aTo.y;
+        std::int64_t b = aTo.x - aFrom.x;
+        std::int64_t c = aFrom.x * aTo.y - aTo.x * aFrom.y;
+        aDenominator = a * aOpposite.x + b * aOpposite.y + c;
+        if (aDenominator < 0)
+        {
+            a = -a;
+            b = -b;
+            c = -c;
+            aDenominator = -aDenominator;
+        }
+
+        // Same top-left tie-breaking rule as rasterizeHalfSpace(), exact on the integer factors.
+        const bool acceptsTie = ownsTies(a, b);
+        return FixedEdgeFunction{
+            a * gSubpixelScale,
+            b * gSubpixelScale,
+            c,
+            acceptsTie ? 0 : 1,
+        };
+    }
+
+
+} // namespace detail
+
+
+template <class T_vertex>
+std::optional<FixedPointSetup> FixedPointSetup::Make(const Triangle<T_vertex> & aTriangle, const Scissor & aScissor)
+{
+    const detail::SubpixelPosition a = detail::snap(aTriangle.a.pos);
+    const detail::SubpixelPosition b = detail::snap(aTriangle.b.pos);
+    const detail::SubpixelPosition c = detail::snap(aTriangle.c.pos);
+
+    FixedPointSetup setup;
+    std::int64_t doubleArea;
+    setup.edges = {
+        detail::makeFixedEdge(b, c, a, doubleArea),
+        detail::makeFixedEdge(c, a, b, doubleArea),
+        detail::makeFixedEdge(a, b, c, doubleArea),
+    };
+
+    // Degenerate after snapping (zero area), which should not be rasterized.
+    if (doubleArea == 0)
+    {
+        return std::nullopt;
+    }
+    setup.denominators.fill(static_cast<double>(doubleArea));
+
+    for (std::size_t edge = 0; edge != 3; ++edge)
+    {
+        for (int lane = 0; lane != gLaneCount; ++lane)
+        {
+            setup.laneOffsets[edge][lane] = setup.edges[edge].stepX * gLaneX[lane]
+                                            + setup.edges[edge].stepY * gLaneY[lane];
+        }
+    }
+
+    // Pixel centers have integer coordinates.
+    setup.xMin = std::max(detail::ceilToPixel(std::min({a.x, b.x, c.x})), aScissor.xMin);
+    setup.yMin = std::max(detail::ceilToPixel(std::min({a.y, b.y, c.y})), aScissor.yMin);
+    setup.xMax = std::min(detail::floorToPixel(std::max({a.x, b.x, c.x})), aScissor.xMax);
+    setup.yMax = std::min(detail::floorToPixel(std::max({a.y, b.y, c.y})), aScissor.yMax);
+    if (setup.xMin > setup.xMax || setup.yMin > setup.yMax)
+    {
+        return std::nullopt;
+    }
+
+    return setup;
+}
+
+
+inline FixedBlockCoverage FixedPointSetup::interpolateBlock(int aX, int aY) const
+{
+    FixedBlockCoverage result;
+    for (std::size_t edge = 0; edge != 3; ++edge)
+    {
+        const std::int64_t origin = edges[edge](aX, aY);
+        const std::int64_t * offsets = laneOffsets[edge].data();
+        std::int64_t * values = result.edgeValues[edge].data();
+        for (int lane = 0; lane != gLaneCount; ++lane)
+        {
+            values[lane] = origin + offsets[lane];
+        }
+    }
+    result.mask = gAllLanes;
+    return result;
+}
+
+
+inline BlockClass FixedPointSetup::classifyBlock(int aX, int aY, int aSize) const
+{
+    // Inclusive coordinates of the last pixel center in the block.
+    const int xLast = aX + aSize - 1;
+    const int yLast = aY + aSize - 1;
+    if (xLast < xMin || aX > xMax || yLast < yMin || aY > yMax)
+    {
+        return BlockClass::Outside;
+    }
+    bool partial = aX < xMin || xLast > xMax || aY < yMin || yLast > yMax;
+
+    const std::int64_t span = aSize - 1;
+    for (const FixedEdgeFunction & edge : edges)
+    {
+        const std::int64_t origin = edge(aX, aY);
+        const std::int64_t maximum = origin + (std::max<std::int64_t>(edge.stepX, 0) + std::max<std::int64_t>(edge.stepY, 0)) * span;
+        const std::int64_t minimum = origin + (std::min<std::int64_t>(edge.stepX, 0) + std::min<std::int64_t>(edge.stepY, 0)) * span;
+        if (maximum < edge.threshold)
+        {
+            return BlockClass::Outside;
+        }
+        partial |= minimum < edge.threshold;
+    }
+    return partial ? BlockClass::Partial : BlockClass::Covered;
+}
+
+
+inline FixedBlockCoverage FixedPointSetup::evaluateBlock(int aX, int aY) const
+{
+    FixedBlockCoverage result;
+    std::array<std::uint32_t, gLaneCount> covered;
+
+    // Lanes outside of the bounds (triangle bounding box and scissor).
+    for (int lane = 0; lane != gLaneCount; ++lane)
+    {
+        const int x = aX + gLaneX[lane];
+        const int y = aY + gLaneY[lane];
+        covered[lane] = (x >= xMin) & (x <= xMax) & (y >= yMin) & (y <= yMax);
+    }
+
+    for (std::size_t edge = 0; edge != 3; ++edge)
+    {
+        const std::int64_t origin = edges[edge](aX, aY);
+        const std::int64_t threshold = edges[edge].threshold;
+        const std::int64_t * offsets = laneOffsets[edge].data();
+        std::int64_t * values = result.edgeValues[edge].data();
+        for (int lane = 0; lane != gLaneCount; ++lane)
+        {
+            values[lane] = origin + offsets[lane];
+            covered[lane] &= (values[lane] >= threshold);
+        }
+    }
+
+    result.mask = 0;
+    for (int lane = 0; lane != gLaneCount; ++lane)
+    {
+        result.mask |= covered[lane] << lane;
+    }
+    return result;
+}
+
+
+template <class T_vertex, class T_raster, class F_postRasterization>
+void rasterizeFixedPoint(const Triangle<T_vertex> & aTriangle,
+                         T_raster & aRaster,
+                         const F_postRasterization & aFragmentCallback,
+                         const Scissor & aScissor)
+{
+    if (std::optional<FixedPointSetup> setup = FixedPointSetup::Make(aTriangle, aScissor))
+    {
+        detail::traverseBlocks(InterpolationSetup<T_vertex>{aTriangle}, *setup, aRaster, aFragmentCallback);
+    }
+}
+
+
+} // namespace focg
+} // namespace ad
@@ -2,169 +2,1524 @@
 
 
 #include "Clipping.h"
+#include "DepthFormats.h"
+#include "FixedPointRasterization.h"
+#include "HalfSpaceRasterization.h"
+#include "MicroTriangleRasterization.h"
+#include "MultisampleRasterization.h"
 #include "Rasterization.h"
+#include "ScanlineRasterization.h"
 #include "Scene.h"
 
-#include <bitset>
+#include <focg-common/Parallel.h>
 
 #include <math/Transformations.h>
 
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <concepts>
+#include <limits>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <cstdint>
+
 
 namespace ad {
 namespace focg {
 
 
+/// \brief Tiles of a render target which are cleared, while their pixels still hold previous values.
+///
+/// Clearing a target only flags all its tiles. The clear values of a tile are written (materialized)
+/// on its first access, so tiles that are not drawn to cost nothing until the target is resolved.
+struct TileClearFlags
+{
+    static constexpr int gTileSize = 64;
+
+    explicit TileClearFlags(math::Size<2, int> aResolution);
+
+    void setAll()
+    { std::fill(flags.begin(), flags.end(), std::uint8_t{1}); }
+
+    bool isCleared(int aX, int aY) const
+    { return flags[getIndex(aX, aY)]; }
+
+    void reset(int aX, int aY)
+    { flags[getIndex(aX, aY)] = 0; }
+
+    /// \brief If the tile containing pixel (aX, aY) is cleared, reset its flag
+    /// then invoke aFill with the origin and size of the tile.
+    template <class F_fill>
+    void materialize(int aX, int aY, F_fill && aFill);
+
+    /// \brief Invoke aFill on each cleared tile, resetting all flags.
+    template <class F_fill>
+    void materializeAll(F_fill && aFill);
+
+    math::Size<2, int> resolution;
+    int tilesX;
+    std::vector<std::uint8_t> flags;
+
+private:
+    std::size_t getIndex(int aX, int aY) const
+    { return aX / gTileSize + (std::size_t)(aY / gTileSize) * tilesX; }
+};
+
+
+inline TileClearFlags::TileClearFlags(math::Size<2, int> aResolution) :
+    resolution{aResolution},
+    tilesX{(aResolution.width() + gTileSize - 1) / gTileSize},
+    flags((std::size_t)tilesX * ((aResolution.height() + gTileSize - 1) / gTileSize), 0)
+{}
+
+
+template <class F_fill>
+void TileClearFlags::materialize(int aX, int aY, F_fill && aFill)
+{
+    std::uint8_t & flag = flags[getIndex(aX, aY)];
+    if (flag)
+    {
+        flag = 0;
+        const math::Position<2, int> origin{aX - aX % gTileSize, aY - aY % gTileSize};
+        aFill(origin, math::Size<2, int>{
+            std::min(gTileSize, resolution.width() - origin.x()),
+            std::min(gTileSize, resolution.height() - origin.y()),
+        });
+    }
+}
+
+
+template <class F_fill>
+void TileClearFlags::materializeAll(F_fill && aFill)
+{
+    for (int y = 0; y < resolution.height(); y += gTileSize)
+    {
+        for (int x = 0; x < resolution.width(); x += gTileSize)
+        {
+            materialize(x, y, aFill);
+        }
+    }
+}
+
+
 /// \brief Realizee the TargetBuffer concept
-template <class T_pixel = math::sdr::Rgb, class T_depthValue = double>
+///
+/// \note clear() is deferred per tile (see TileClearFlags):
+/// resolveClears() must be called before accessing color or depth directly (e.g. to save the image).
+template <class T_pixel = math::sdr::Rgb, DepthFormat T_depthFormat = DepthDouble>
 struct ImageBuffer
 {
+    using pixel_type = T_pixel;
+    using depth_format = T_depthFormat;
+    using depth_type = typename T_depthFormat::value_type;
+
     ImageBuffer(math::Size<2, int> aResolution, T_pixel aDefaultColor = T_pixel{0, 0, 0});
 
     math::Size<2, int> getResolution() const
     { return color.dimensions(); }
 
     template <class T_position>
-    double & depthAt(T_position aPosition)
-    { return depth[aPosition.x() + aPosition.y() * color.width()]; }
+    T_pixel & colorAt(T_position aPosition)
+    {
+        materialize(aPosition.x(), aPosition.y());
+        return color.at(aPosition.x(), aPosition.y());
+    }
+
+    template <class T_position>
+    depth_type & depthAt(T_position aPosition)
+    {
+        materialize(aPosition.x(), aPosition.y());
+        return depth[aPosition.x() + aPosition.y() * color.width()];
+    }
 
+    /// \brief Only flags the tiles as cleared.
     void clear()
-    { 
-        color.clear(clearColor);
-        std::fill(depth.begin(), depth.end(), std::numeric_limits<T_depthValue>::lowest());
+    { clearedTiles.setAll(); }
+
+    /// \brief Write the clear values in the tiles not accessed since the last clear().
+    ImageBuffer & resolveClears()
+    {
+        clearedTiles.materializeAll([this](math::Position<2, int> aOrigin, math::Size<2, int> aSize)
+                                    { fillTile(aOrigin, aSize); });
+        return *this;
     }
 
     arte::Image<T_pixel> color;
-    std::vector<T_depthValue> depth;
+    std::vector<depth_type> depth;
     T_pixel clearColor;
+    TileClearFlags clearedTiles;
+
+private:
+    void materialize(int aX, int aY)
+    {
+        clearedTiles.materialize(aX, aY, [this](math::Position<2, int> aOrigin, math::Size<2, int> aSize)
+                                         { fillTile(aOrigin, aSize); });
+    }
+
+    void fillTile(math::Position<2, int> aOrigin, math::Size<2, int> aSize);
 };
 
 
-template <class T_pixel, class T_depthValue>
-ImageBuffer<T_pixel, T_depthValue>::ImageBuffer(math::Size<2, int> aResolution, T_pixel aDefaultColor) :
+template <class T_pixel, DepthFormat T_depthFormat>
+ImageBuffer<T_pixel, T_depthFormat>::ImageBuffer(math::Size<2, int> aResolution, T_pixel aDefaultColor) :
     color{aResolution, aDefaultColor},
-    // Near plane > Far plane, so the test is for superiority (hence min).
-    // Important: for floating point, ::min() is the lowest positive value...
-    depth((std::size_t)aResolution.area(), std::numeric_limits<T_depthValue>::lowest()),
-    clearColor{aDefaultColor}
+    // Near plane > Far plane, so the test is for superiority (hence cleared to the lowest value).
+    depth((std::size_t)aResolution.area(), T_depthFormat::gCleared),
+    clearColor{aDefaultColor},
+    clearedTiles{aResolution}
 {}
 
 
-struct GraphicsPipeline
+template <class T_pixel, DepthFormat T_depthFormat>
+void ImageBuffer<T_pixel, T_depthFormat>::fillTile(math::Position<2, int> aOrigin, math::Size<2, int> aSize)
 {
-private:
-    using RenderFlag = std::bitset<2>;
+    for (int y = aOrigin.y(); y != aOrigin.y() + aSize.height(); ++y)
+    {
+        for (int x = aOrigin.x(); x != aOrigin.x() + aSize.width(); ++x)
+        {
+            color.at(x, y) = clearColor;
+        }
+        auto row = depth.begin() + aOrigin.x() + (std::size_t)y * color.width();
+        std::fill(row, row + aSize.width(), T_depthFormat::gCleared);
+    }
+}
 
-public:
-    /// Have each object in aScene travers the graphics pipeline, rasterizing to aTarget.
-    template <class T_vertex, class T_targetBuffer, class T_program>
-    T_targetBuffer & traverse(
-        const Scene<T_vertex> & aScene, T_targetBuffer & aTarget, const T_program & aProgram,
-        double aNear, double aFar) const;
 
-    static constexpr RenderFlag Wireframe = 0b01;
-    static constexpr RenderFlag Fill = 0b10;
-    RenderFlag renderMode{Fill};
+/// \brief A depth-only render target, without color attachment (e.g. for shadow maps, or a depth pre-pass).
+///
+/// Fragments are not shaded when drawing to it, unless the program writes depth.
+/// \note As for ImageBuffer, resolveClears() must be called before accessing depth directly.
+template <DepthFormat T_depthFormat = DepthDouble>
+struct DepthBuffer
+{
+    using depth_format = T_depthFormat;
+    using depth_type = typename T_depthFormat::value_type;
+
+    explicit DepthBuffer(math::Size<2, int> aResolution) :
+        resolution{aResolution},
+        depth((std::size_t)aResolution.area(), T_depthFormat::gCleared),
+        clearedTiles{aResolution}
+    {}
+
+    math::Size<2, int> getResolution() const
+    { return resolution; }
+
+    template <class T_position>
+    depth_type & depthAt(T_position aPosition)
+    {
+        clearedTiles.materialize(aPosition.x(), aPosition.y(),
+                                 [this](math::Position<2, int> aOrigin, math::Size<2, int> aSize)
+                                 { fillTile(aOrigin, aSize); });
+        return depth[aPosition.x() + aPosition.y() * resolution.width()];
+    }
+
+    /// \brief Only flags the tiles as cleared.
+    void clear()
+    { clearedTiles.setAll(); }
+
+    /// \brief Write the clear value in the tiles not accessed since the last clear().
+    DepthBuffer & resolveClears()
+    {
+        clearedTiles.materializeAll([this](math::Position<2, int> aOrigin, math::Size<2, int> aSize)
+                                    { fillTile(aOrigin, aSize); });
+        return *this;
+    }
+
+    math::Size<2, int> resolution;
+    std::vector<depth_type> depth;
+    TileClearFlags clearedTiles;
+
+private:
+    void fillTile(math::Position<2, int> aOrigin, math::Size<2, int> aSize)
+    {
+        for (int y = aOrigin.y(); y != aOrigin.y() + aSize.height(); ++y)
+        {
+            auto row = depth.begin() + aOrigin.x() + (std::size_t)y * resolution.width();
+            std::fill(row, row + aSize.width(), T_depthFormat::gCleared);
+        }
+    }
 };
 
 
-template <class T_vertex, class T_targetBuffer, class T_program>
-T_targetBuffer & GraphicsPipeline::traverse(const Scene<T_vertex> & aScene,
-                                            T_targetBuffer & aTarget,
-                                            const T_program & aProgram,
-                                            double aNear, double aFar) const
+/// \brief A multisampled render target, storing color and depth for gSampleCount samples per pixel.
+///
+/// Triangles drawn to it are rasterized per sample (see rasterizeMultisample()),
+/// their fragments being shaded once per pixel and written to the samples passing the depth test.
+/// resolve() then averages the samples of each pixel to an arte::Image.
+///
+/// Sample colors are compressed: a pixel whose samples were all written by the same fragment
+/// stores a single color, written and resolved without touching the other samples.
+/// The pixel is expanded to distinct sample colors when a later fragment only writes some of its samples.
+/// \note As for ImageBuffer, clear() is deferred per tile.
+/// \note Wireframe lines are not drawn to multisample targets.
+template <int N_samples, class T_pixel = math::sdr::Rgb, DepthFormat T_depthFormat = DepthDouble>
+struct MultisampleBuffer
 {
-    // NOTE: The pipeline expects the output of the vertex processing stage to be in clip space
-    // (i.e. OpenGL convention).
-    // Thus, clipping is done against the simple case of unit cube.
-    ViewVolume volume{math::Box<double>::CenterOnOrigin({2., 2., 2.})};
+    static constexpr int gSampleCount = N_samples;
+    static constexpr std::uint32_t gAllSamples = SampleCoverage<N_samples>::gAllSamples;
 
-    // NOTE: The initial view volume (and the NDC unit cube) should be mapped to the whole viewport,
-    // not to the pixel center range (which goes from (0, 0) to resolution - (1, 1)).
-    // Since the pixel center are assigned integer indices in the viewport, its origin is at {-0.5, -0.5}.
-    // NOTE: For the same reason than in NaivePipeline, the exact viewport has to be offset by a small epsilon,
-    // otherwise the floating point rounding errors (and round() behaviour) might map 
-    // a position exactly on the edge of the view volume to a pixel just outside the viewport.
-    constexpr math::Vec<2> epsilon{0.1, 0.1};
-    const math::AffineMatrix<4> viewportTransform =
-        math::trans3d::ndcToViewport(
-            { 
-                math::Position<2>{-0.5, -0.5} + epsilon,
-                static_cast<math::Size<2, double>>(aTarget.getResolution())  - 2 * epsilon.as<math::Size>()
-            },
-            aNear, aFar);
+    using pixel_type = T_pixel;
+    using depth_format = T_depthFormat;
+    using depth_type = typename T_depthFormat::value_type;
 
-    // TODO adress proper line drawing via shader and depth buffer
-    //for (const auto & line : aScene.lines)
-    //{
-    //    if (auto clippedLine = clip(line, volume))
-    //    {
-    //        rasterizeLine(*clippedLine, aTarget.color, ad::math::sdr::gWhite);
-    //    }
-    //}
+    MultisampleBuffer(math::Size<2, int> aResolution, T_pixel aClearColor = T_pixel{0, 0, 0});
 
-    for (const auto & triangleScene : aScene.triangles)
+    math::Size<2, int> getResolution() const
+    { return resolution; }
+
+    template <class T_position>
+    depth_type & depthAt(T_position aPosition, int aSample)
+    {
+        materialize(aPosition.x(), aPosition.y());
+        return depth[getIndex(aPosition.x(), aPosition.y()) * N_samples + aSample];
+    }
+
+    /// \brief Write aColor to the samples of aSampleMask, at aPosition.
+    template <class T_position>
+    void writeColor(T_position aPosition, std::uint32_t aSampleMask, const T_pixel & aColor);
+
+    /// \brief Only flags the tiles as cleared.
+    void clear()
+    { clearedTiles.setAll(); }
+
+    /// \brief Write the clear values in the tiles not accessed since the last clear().
+    MultisampleBuffer & resolveClears()
+    {
+        clearedTiles.materializeAll([this](math::Position<2, int> aOrigin, math::Size<2, int> aSize)
+                                    { fillTile(aOrigin, aSize); });
+        return *this;
+    }
+
+    /// \brief Write the average of the samples of each pixel to aDestination (after resolving the clears).
+    ///
+    /// Compressed pixels are copied as is.
+    /// \note Samples are averaged as stored, without conversion to linear intensities.
+    arte::Image<T_pixel> & resolve(arte::Image<T_pixel> & aDestination);
+
+    math::Size<2, int> resolution;
+    // N_samples consecutive colors per pixel, only the first one being valid if the pixel is compressed.
+    std::vector<T_pixel> samples;
+    // 1 for the pixels whose samples all have the color of their first sample.
+    std::vector<std::uint8_t> compressed;
+    // N_samples consecutive depths per pixel.
+    std::vector<depth_type> depth;
+    T_pixel clearColor;
+    TileClearFlags clearedTiles;
+
+private:
+    std::size_t getIndex(int aX, int aY) const
+    { return aX + (std::size_t)aY * resolution.width(); }
+
+    void materialize(int aX, int aY)
     {
-        auto triangleVertexStage = triangleScene;
-        // Vertex shader
-        // TODO encapsulate this logic
-        triangleVertexStage.a.pos = aProgram.vertex(triangleVertexStage.a, triangleVertexStage.a.frag);
-        triangleVertexStage.b.pos = aProgram.vertex(triangleVertexStage.b, triangleVertexStage.b.frag);
-        triangleVertexStage.c.pos = aProgram.vertex(triangleVertexStage.c, triangleVertexStage.c.frag);
+        clearedTiles.materialize(aX, aY, [this](math::Position<2, int> aOrigin, math::Size<2, int> aSize)
+                                         { fillTile(aOrigin, aSize); });
+    }
+
+    void fillTile(math::Position<2, int> aOrigin, math::Size<2, int> aSize);
+};
+
 
-        // Now, the vertices coordinates are expressed in clip space
+template <int N_samples, class T_pixel, DepthFormat T_depthFormat>
+MultisampleBuffer<N_samples, T_pixel, T_depthFormat>::MultisampleBuffer(math::Size<2, int> aResolution,
+                                                                        T_pixel aClearColor) :
+    resolution{aResolution},
+    samples((std::size_t)aResolution.area() * N_samples, aClearColor),
+    compressed((std::size_t)aResolution.area(), 1),
+    depth((std::size_t)aResolution.area() * N_samples, T_depthFormat::gCleared),
+    clearColor{aClearColor},
+    clearedTiles{aResolution}
+{}
+
+
+template <int N_samples, class T_pixel, DepthFormat T_depthFormat>
+template <class T_position>
+void MultisampleBuffer<N_samples, T_pixel, T_depthFormat>::writeColor(T_position aPosition,
+                                                                      std::uint32_t aSampleMask,
+                                                                      const T_pixel & aColor)
+{
+    materialize(aPosition.x(), aPosition.y());
+    const std::size_t pixel = getIndex(aPosition.x(), aPosition.y());
+    T_pixel * pixelSamples = samples.data() + pixel * N_samples;
 
-        // Clipping
-        for (const auto & triangleClipped: clip(triangleVertexStage, volume))
+    if (aSampleMask == gAllSamples)
+    {
+        pixelSamples[0] = aColor;
+        compressed[pixel] = 1;
+        return;
+    }
+
+    if (compressed[pixel])
+    {
+        std::fill(pixelSamples + 1, pixelSamples + N_samples, pixelSamples[0]);
+        compressed[pixel] = 0;
+    }
+    for (int sample = 0; sample != N_samples; ++sample)
+    {
+        if (aSampleMask & (1u << sample))
         {
-            auto triangle = triangleClipped;
-            // Perspective divide
-            triangle.perspectiveDivide();
+            pixelSamples[sample] = aColor;
+        }
+    }
+}
 
-            // Viewport transform
-            triangle.transform(viewportTransform);
 
-            // Now, the vertices coordinates are expressed in window space
+template <int N_samples, class T_pixel, DepthFormat T_depthFormat>
+arte::Image<T_pixel> &
+MultisampleBuffer<N_samples, T_pixel, T_depthFormat>::resolve(arte::Image<T_pixel> & aDestination)
+{
+    assert(aDestination.dimensions() == resolution);
+    resolveClears();
 
-            // Backface culling in window space
-            // Note: I was not able to make it work reliably in clip space
-            if ( !triangle.isFacingFront() )
+    for (int y = 0; y != resolution.height(); ++y)
+    {
+        for (int x = 0; x != resolution.width(); ++x)
+        {
+            const std::size_t pixel = getIndex(x, y);
+            const T_pixel * pixelSamples = samples.data() + pixel * N_samples;
+            if (compressed[pixel])
             {
+                aDestination.at(x, y) = pixelSamples[0];
                 continue;
             }
 
-            // Rasterization of primitives in viewport space
-            if ((renderMode & Fill).any())
+            // Box filter, rounded to nearest.
+            std::array<int, 3> sum{N_samples / 2, N_samples / 2, N_samples / 2};
+            for (int sample = 0; sample != N_samples; ++sample)
             {
-                rasterizeIncremental(
-                    triangle,
-                    aTarget,
-                    [&aProgram](T_targetBuffer & aTarget,
-                        math::Position<2, int> aScreenPosition, 
-                        double aFragmentDepth, 
-                        double aFragmentInverseDepth, 
-                        const typename T_vertex::FragmentInterpolated & aIn)
-                    {
-                        // Depth test (Z buffer)
-                        // Note: Near plane > Far plane, so the test is for superiority.
-                        if (aFragmentDepth > aTarget.depthAt(aScreenPosition))
-                        {
-                            math::Position<4> fragmentCoordinates{
-                                (double)aScreenPosition.x(), (double)aScreenPosition.y(), aFragmentDepth, aFragmentInverseDepth};
-                            // Fragment Shader
-                            aTarget.color.at(aScreenPosition) = aProgram.fragment(fragmentCoordinates, aIn);
-                            aTarget.depthAt(aScreenPosition) = aFragmentDepth;
-                        }
-                    });
-            }
-            // TODO Implement depth test (and shaders?) for line rasterization.
-            if ((renderMode & Wireframe).any())
+                sum[0] += pixelSamples[sample].r();
+                sum[1] += pixelSamples[sample].g();
+                sum[2] += pixelSamples[sample].b();
+            }
+            aDestination.at(x, y) = T_pixel{
+                static_cast<typename T_pixel::value_type>(sum[0] / N_samples),
+                static_cast<typename T_pixel::value_type>(sum[1] / N_samples),
+                static_cast<typename T_pixel::value_type>(sum[2] / N_samples),
+            };
+        }
+    }
+    return aDestination;
+}
+
+
+template <int N_samples, class T_pixel, DepthFormat T_depthFormat>
+void MultisampleBuffer<N_samples, T_pixel, T_depthFormat>::fillTile(math::Position<2, int> aOrigin,
+                                                                    math::Size<2, int> aSize)
+{
+    for (int y = aOrigin.y(); y != aOrigin.y() + aSize.height(); ++y)
+    {
+        const std::size_t first = getIndex(aOrigin.x(), y);
+        const std::size_t end = first + aSize.width();
+        for (std::size_t pixel = first; pixel != end; ++pixel)
+        {
+            samples[pixel * N_samples] = clearColor;
+        }
+        std::fill(compressed.begin() + first, compressed.begin() + end, std::uint8_t{1});
+        std::fill(depth.begin() + first * N_samples, depth.begin() + end * N_samples, T_depthFormat::gCleared);
+    }
+}
+
+
+/// \brief A target storing several samples per pixel, rasterized with rasterizeMultisample().
+template <class T_targetBuffer>
+concept MultisampleTarget = requires(T_targetBuffer & aTarget,
+                                     math::Position<2, int> aPosition,
+                                     const typename T_targetBuffer::pixel_type & aColor)
+{
+    { T_targetBuffer::gSampleCount } -> std::convertible_to<int>;
+    aTarget.depthAt(aPosition, 0);
+    aTarget.writeColor(aPosition, std::uint32_t{1}, aColor);
+};
+
+
+/// \brief A target with a color attachment, written by the fragment shader.
+template <class T_targetBuffer>
+concept ColorTarget = requires(T_targetBuffer & aTarget, math::Position<2, int> aPosition)
+{
+    aTarget.colorAt(aPosition);
+};
+
+
+namespace detail {
+
+
+    template <class T_targetBuffer, std::size_t N_size, bool = ColorTarget<T_targetBuffer>>
+    struct TileColor
+    {
+        using type = std::array<typename T_targetBuffer::pixel_type, N_size>;
+    };
+
+
+    template <class T_targetBuffer, std::size_t N_size>
+    struct TileColor<T_targetBuffer, N_size, false>
+    {
+        struct type {};
+    };
+
+
+} // namespace detail
+
+
+/// \brief A square region of a render target, small enough to remain cache resident
+/// while all the triangles overlapping it are rasterized.
+///
+/// It offers the same fragment access as ImageBuffer, using the target (i.e. screen) coordinates.
+template <class T_targetBuffer>
+struct TileBuffer
+{
+    using depth_format = typename T_targetBuffer::depth_format;
+    using depth_type = typename T_targetBuffer::depth_type;
+
+    // Aligned on the target clear tiles, so a cleared tile is filled without reading the target.
+    static constexpr int gSize = TileClearFlags::gTileSize;
+    // Depth-only targets have no color to load and store.
+    static constexpr bool gHasColor = ColorTarget<T_targetBuffer>;
+
+    /// \brief Make this buffer the tile of aTarget at aOrigin, copying its current content.
+    void load(const T_targetBuffer & aTarget, math::Position<2, int> aOrigin, math::Size<2, int> aSize);
+
+    /// \brief Copy the tile content back to aTarget.
+    void store(T_targetBuffer & aTarget) const;
+
+    template <class T_position>
+    auto & colorAt(T_position aPosition) requires gHasColor
+    { return color[getIndex(aPosition.x(), aPosition.y())]; }
+
+    template <class T_position>
+    depth_type & depthAt(T_position aPosition)
+    { return depth[getIndex(aPosition.x(), aPosition.y())]; }
+
+    math::Position<2, int> origin;
+    math::Size<2, int> size;
+    [[no_unique_address]] typename detail::TileColor<T_targetBuffer, gSize * gSize>::type color;
+    std::array<depth_type, gSize * gSize> depth;
+
+private:
+    std::size_t getIndex(int aX, int aY) const
+    { 
+        assert(aX >= origin.x() && aX < origin.x() + size.width()
+               && aY >= origin.y() && aY < origin.y() + size.height());
+        return (aX - origin.x()) + (aY - origin.y()) * (std::size_t)gSize;
+    }
+};
+
+
+template <class T_targetBuffer>
+void TileBuffer<T_targetBuffer>::load(const T_targetBuffer & aTarget,
+                                      math::Position<2, int> aOrigin,
+                                      math::Size<2, int> aSize)
+{
+    assert(aSize.width() <= gSize && aSize.height() <= gSize);
+    origin = aOrigin;
+    size = aSize;
+
+    // The flag is reset by store(), which writes the whole tile.
+    if (aTarget.clearedTiles.isCleared(origin.x(), origin.y()))
+    {
+        if constexpr (gHasColor)
+        {
+            color.fill(aTarget.clearColor);
+        }
+        depth.fill(depth_format::gCleared);
+        return;
+    }
+
+    const int targetWidth = aTarget.getResolution().width();
+    for (int y = origin.y(); y != origin.y() + size.height(); ++y)
+    {
+        for (int x = origin.x(); x != origin.x() + size.width(); ++x)
+        {
+            if constexpr (gHasColor)
             {
-                rasterizeLine(triangle.getLineC(), aTarget.color);
-                rasterizeLine(triangle.getLineB(), aTarget.color);
-                rasterizeLine(triangle.getLineA(), aTarget.color);
+                color[getIndex(x, y)] = aTarget.color.at(x, y);
+            }
+            depth[getIndex(x, y)] = aTarget.depth[x + (std::size_t)y * targetWidth];
+        }
+    }
+}
+
+
+template <class T_targetBuffer>
+void TileBuffer<T_targetBuffer>::store(T_targetBuffer & aTarget) const
+{
+    const int targetWidth = aTarget.getResolution().width();
+    for (int y = origin.y(); y != origin.y() + size.height(); ++y)
+    {
+        for (int x = origin.x(); x != origin.x() + size.width(); ++x)
+        {
+            if constexpr (gHasColor)
+            {
+                aTarget.color.at(x, y) = color[getIndex(x, y)];
             }
+            aTarget.depth[x + (std::size_t)y * targetWidth] = depth[getIndex(x, y)];
         }
     }
+    aTarget.clearedTiles.reset(origin.x(), origin.y());
+}
+
+
+/// \brief The ShadedVertex returned by the vertex shader of T_program for a T_vertex.
+template <class T_program, class T_vertex>
+using ShadedVertexOf =
+    std::remove_cvref_t<decltype(std::declval<const T_program &>().vertex(std::declval<const T_vertex &>()))>;
+
+
+/// \brief The varyings output by the vertex shader of T_program for a T_vertex, input of its fragment shader.
+template <class T_program, class T_vertex>
+using VaryingsOf = typename ShadedVertexOf<T_program, T_vertex>::varyings_type;
+
+
+/// \brief A program whose fragment shader writes the fragment depth.
+///
+/// The depth is an in-out parameter, initialized with the interpolated depth (as gl_FragDepth).
+/// The depth test can then only happen after the fragment shader (late depth test).
+template <class T_program, class T_varyings>
+concept DepthWritingProgram = requires(const T_program & aProgram,
+                                       const math::Position<4> & aFragCoord,
+                                       const T_varyings & aIn,
+                                       double & aDepth)
+{
+    { aProgram.fragment(aFragCoord, aIn, aDepth) };
+};
+
+
+/// \brief A program provides the programmable stages of the pipeline, as regular member functions.
+///
+/// The pipeline is instantiated for the concrete program type, so the calls to the stages
+/// are statically dispatched (and can be inlined in the rasterization loop).
+/// The varyings type is defined by the program, as the return type of its vertex shader.
+template <class T_program, class T_vertex>
+concept ShaderProgram = requires(const T_program & aProgram,
+                                 const T_vertex & aVertex)
+{
+    // Vertex shader, returning the clip space position and the attributes to interpolate.
+    { aProgram.vertex(aVertex) } -> std::same_as<ShadedVertex<VaryingsOf<T_program, T_vertex>>>;
+}
+&& (
+    // Fragment shader, returning the fragment color.
+    requires(const T_program & aProgram,
+             const math::Position<4> & aFragCoord,
+             const VaryingsOf<T_program, T_vertex> & aIn)
+    {
+        { aProgram.fragment(aFragCoord, aIn) };
+    }
+    || DepthWritingProgram<T_program, VaryingsOf<T_program, T_vertex>>
+);
+
+
+/// \brief A program that has uniforms derived from other uniforms (e.g. concatenated matrices).
+///
+/// bake() returns a copy of the program where the derived uniforms are computed,
+/// so they are computed once per draw instead of once per vertex (or fragment).
+template <class T_program>
+concept BakeableProgram = requires(const T_program & aProgram)
+{
+    { aProgram.bake() } -> std::convertible_to<T_program>;
+};
+
+
+/// \brief A program whose vertex stage transforms positions from local space to clip space
+/// by the matrix returned by getLocalToClip().
+///
+/// The pipeline can then cull bounding volumes against the view frustum, before any vertex processing.
+template <class T_program>
+concept ProjectingProgram = requires(const T_program & aProgram)
+{
+    { aProgram.getLocalToClip() } -> std::convertible_to<math::Matrix<4, 4>>;
+};
+
+
+/// \brief The baked copy of aProgram if it is bakeable, aProgram itself otherwise.
+template <class T_program>
+decltype(auto) bakeUniforms(const T_program & aProgram)
+{
+    if constexpr (BakeableProgram<T_program>)
+    {
+        return aProgram.bake();
+    }
+    else
+    {
+        return (aProgram);
+    }
+}
+
+
+struct GraphicsPipeline
+{
+private:
+    using RenderFlag = std::bitset<2>;
+
+public:
+    /// Have each object in aScene travers the graphics pipeline, rasterizing to aTarget.
+    ///
+    /// When threadCount is above 1 (and in Fill mode), dispatches to traverseTiled().
+    /// \note Each traversal is a draw: the uniforms of aProgram are baked once at its start.
+    template <class T_vertex, class T_targetBuffer, ShaderProgram<T_vertex> T_program>
+    T_targetBuffer & traverse(
+        const Scene<T_vertex> & aScene, T_targetBuffer & aTarget, const T_program & aProgram,
+        double aNear, double aFar) const;
+
+    /// \brief Sort-middle parallel traversal, producing the exact same result as the serial traversal.
+    ///
+    /// It works in three steps:
+    /// * vertex processing, clipping and culling of chunks of triangles in parallel,
+    /// * binning of the window space triangles in screen tiles (in submission order),
+    /// * rasterization of tiles in parallel, each in a cache resident TileBuffer.
+    /// Within a tile, triangles are rasterized in submission order, so the depth test
+    /// resolves exactly as in the serial traversal.
+    /// \note The vertex and fragment stages of aProgram are invoked concurrently.
+    /// \note In Deferred shading, the resolve is also parallel (by rows).
+    template <class T_vertex, class T_targetBuffer, ShaderProgram<T_vertex> T_program>
+    T_targetBuffer & traverseTiled(
+        const Scene<T_vertex> & aScene, T_targetBuffer & aTarget, const T_program & aProgram,
+        double aNear, double aFar) const;
+
+    static constexpr RenderFlag Wireframe = 0b01;
+    static constexpr RenderFlag Fill = 0b10;
+    RenderFlag renderMode{Fill};
+
+    enum class Rasterizer
+    {
+        Incremental, // Reference implementation, pixel by pixel (see rasterizeIncremental()).
+        HalfSpace,   // By blocks of pixels, emitting 2x2 quads (see rasterizeHalfSpace()).
+        FixedPoint,  // HalfSpace, with vertices snapped to a subpixel grid and exact integer edge functions
+                     // (see rasterizeFixedPoint()). Micro triangles test their few pixel centers directly
+                     // (see rasterizeMicroTriangle()), thin triangles are traversed by spans (see scanlineFillRatio).
+    };
+    Rasterizer rasterizer{Rasterizer::FixedPoint};
+
+    // With the FixedPoint rasterizer, triangles filling less than this ratio of their bounding box
+    // (see getFillRatio()) are traversed row by row, only visiting their covered spans (see rasterizeScanline()).
+    // Both traversals produce the same fragments. Set to 0 to always traverse by blocks.
+    double scanlineFillRatio{0.25};
+
+    enum class Shading
+    {
+        // Each fragment passing the depth test is shaded, so a pixel might be shaded several times.
+        Forward,
+        // A geometry pass only writes depth and the visible primitive of each pixel (visibility buffer),
+        // then a resolve pass shades each covered pixel exactly once.
+        // The resolve ends each traversal (draw): a pixel covered by several draws is still shaded by each.
+        // Requires Fill mode, a program not writing depth and a single sample color target,
+        // otherwise Forward shading is used.
+        Deferred,
+    };
+    Shading shading{Shading::Forward};
+
+    // Factor enlarging the clipping volume in x and y (in Fill mode),
+    // so triangles crossing the viewport borders are discarded by the rasterizer scissor, without clipping.
+    // Near and far planes are always clipped exactly.
+    double guardBand{4.};
+
+    // Above 1, Fill mode is rendered by traverseTiled().
+    // Wireframe always uses the serial traversal (lines are not scissored to tiles).
+    unsigned int threadCount{1};
+
+    static constexpr std::size_t gTriangleChunkSize = 512;
+
+private:
+    // Primitive index of the pixels not covered by the draw, in the visibility buffer.
+    static constexpr std::uint32_t gNoPrimitive = std::numeric_limits<std::uint32_t>::max();
+
+    template <class T_vertex, class T_program, class T_targetBuffer>
+    bool isDeferred() const
+    {
+        return shading == Shading::Deferred && renderMode == Fill
+               && !DepthWritingProgram<T_program, VaryingsOf<T_program, T_vertex>>
+               && ColorTarget<T_targetBuffer> && !MultisampleTarget<T_targetBuffer>;
+    }
+
+    /// \param aExact Map the view volume exactly to the viewport, without the epsilon required by lines.
+    static math::AffineMatrix<4> getViewportTransform(math::Size<2, int> aResolution, double aNear, double aFar,
+                                                      bool aExact = false);
+
+    /// \brief The clip space view volume, i.e. the unit cube.
+    static const ViewVolume & getViewVolume()
+    {
+        static const ViewVolume volume{math::Box<double>::CenterOnOrigin({2., 2., 2.})};
+        return volume;
+    }
+
+    /// \brief Frustum culling of aMesh clusters, the result is 1 for each visible cluster.
+    ///
+    /// All clusters are visible if aProgram is not a ProjectingProgram, or if aMesh has no bounds.
+    template <class T_vertex, class T_program>
+    static std::vector<std::uint8_t> cullClusters(const IndexedMesh<T_vertex> & aMesh, const T_program & aProgram);
+
+    /// \brief Run the vertex stage exactly once on each vertex of aMesh referenced by a visible cluster.
+    /// \return Empty if no cluster is visible.
+    template <class T_vertex, class T_program>
+    std::vector<ShadedVertexOf<T_program, T_vertex>> shadeVertices(
+        const IndexedMesh<T_vertex> & aMesh,
+        const T_program & aProgram,
+        const std::vector<std::uint8_t> & aVisibleClusters) const;
+
+    /// \brief Vertex processing, then processClipSpaceTriangle().
+    template <class T_vertex, class T_program, class F_emit>
+    void processTriangle(const Triangle<T_vertex> & aTriangle,
+                         const T_program & aProgram,
+                         const math::AffineMatrix<4> & aViewportTransform,
+                         F_emit && aEmit) const;
+
+    /// \brief Clipping, perspective divide, viewport transform and backface culling.
+    /// \param aEmit Invoked with each resulting window space triangle.
+    /// \note Resulting triangles can extend outside of the viewport, within the guard band.
+    template <class T_vertex, class F_emit>
+    void processClipSpaceTriangle(const Triangle<T_vertex> & aTriangle,
+                                  const math::AffineMatrix<4> & aViewportTransform,
+                                  F_emit && aEmit) const;
+
+    /// \brief Assemble the triangle aTriangleId of aMesh, from its shaded vertices.
+    template <class T_vertex, class T_shaded>
+    static Triangle<T_shaded> assembleTriangle(const IndexedMesh<T_vertex> & aMesh,
+                                               const std::vector<T_shaded> & aShadedVertices,
+                                               std::size_t aTriangleId)
+    {
+        return {
+            aShadedVertices[aMesh.indices[3 * aTriangleId + 0]],
+            aShadedVertices[aMesh.indices[3 * aTriangleId + 1]],
+            aShadedVertices[aMesh.indices[3 * aTriangleId + 2]],
+        };
+    }
+
+    /// \note Multisample targets are always rasterized by rasterizeMultisample(), whatever the rasterizer.
+    template <class T_vertex, class T_raster, class F_fragmentStage>
+    void rasterize(const Triangle<T_vertex> & aTriangle,
+                   T_raster & aRaster,
+                   const F_fragmentStage & aFragmentStage,
+                   const Scissor & aScissor = {}) const
+    {
+        if constexpr (MultisampleTarget<T_raster>)
+        {
+            return rasterizeMultisample<T_raster::gSampleCount>(aTriangle, aRaster, aFragmentStage, aScissor);
+        }
+        else
+        {
+            switch (rasterizer)
+            {
+            case Rasterizer::Incremental:
+                return rasterizeIncremental(aTriangle, aRaster, aFragmentStage, aScissor);
+            case Rasterizer::HalfSpace:
+                return rasterizeHalfSpace(aTriangle, aRaster, aFragmentStage, aScissor);
+            case Rasterizer::FixedPoint:
+                // The fast paths produce the same fragments as the block traversal.
+                if (rasterizeMicroTriangle(aTriangle, aRaster, aFragmentStage, aScissor))
+                {
+                    return;
+                }
+                else if (getFillRatio(aTriangle) < scanlineFillRatio)
+                {
+                    return rasterizeScanline(aTriangle, aRaster, aFragmentStage, aScissor);
+                }
+                return rasterizeFixedPoint(aTriangle, aRaster, aFragmentStage, aScissor);
+            }
+        }
+    }
+
+    /// \brief The fragment stage drawing to T_targetBuffer:
+    /// makeMultisampleStage() for a MultisampleTarget, makeSingleSampleStage() otherwise.
+    /// \note For the fragment stages, T_vertex is the ShadedVertex of the window space triangles.
+    template <class T_vertex, class T_targetBuffer, class T_program>
+    static auto makeFragmentStage(const T_program & aProgram, DepthRange aDepthRange);
+
+    /// \brief Depth test and fragment shading, for any target providing depthAt() and colorAt().
+    ///
+    /// The depth test happens before the varyings are interpolated and the fragment shader invoked,
+    /// unless the program writes depth (see DepthWritingProgram).
+    /// Fragment depths are encoded in the depth format of the target before being tested.
+    /// \note For depth-only targets (not ColorTarget), fragments are only shaded if the program writes depth.
+    template <class T_vertex, class T_program>
+    static auto makeSingleSampleStage(const T_program & aProgram, DepthRange aDepthRange);
+
+    /// \brief Per sample depth test, with a single fragment shading per pixel, for multisample targets.
+    ///
+    /// The fragment is shaded if at least one of its covered samples passes the depth test,
+    /// then its color is written to the passing samples.
+    /// A program writing depth is shaded first, and its depth is tested for all covered samples.
+    template <class T_vertex, class T_program>
+    static auto makeMultisampleStage(const T_program & aProgram, DepthRange aDepthRange);
+
+    /// \brief Depth test, then write of aPrimitive in the visibility buffer (geometry pass of Deferred shading).
+    template <class T_vertex>
+    static auto makeVisibilityStage(std::vector<std::uint32_t> & aPrimitives, int aWidth, std::uint32_t aPrimitive,
+                                    DepthRange aDepthRange);
+
+    /// \brief Shade each pixel of aTarget covered in the visibility buffer, with its visible primitive.
+    /// \param aTriangles The window space triangles, indexed by the visibility buffer.
+    template <class T_vertex, class T_targetBuffer, class T_program>
+    void resolveVisibility(const std::vector<Triangle<T_vertex>> & aTriangles,
+                           const std::vector<std::uint32_t> & aPrimitives,
+                           T_targetBuffer & aTarget,
+                           const T_program & aProgram) const;
+};
+
+
+inline math::AffineMatrix<4> GraphicsPipeline::getViewportTransform(math::Size<2, int> aResolution,
+                                                                  double aNear, double aFar,
+                                                                  bool aExact)
+{
+    // NOTE: The initial view volume (and the NDC unit cube) should be mapped to the whole viewport,
+    // not to the pixel center range (which goes from (0, 0) to resolution - (1, 1)).
+    // Since the pixel center are assigned integer indices in the viewport, its origin is at {-0.5, -0.5}.
+    // NOTE: For the same reason than in NaivePipeline, the exact viewport has to be offset by a small epsilon,
+    // otherwise the floating point rounding errors (and round() behaviour) might map 
+    // a position exactly on the edge of the view volume to a pixel just outside the viewport.
+    // Triangles are scissored to the viewport (and Rasterizer::FixedPoint does not round at all),
+    // so it is only required by the wireframe lines.
+    // Multisample targets, which have samples up to the viewport borders and no lines, use the exact viewport.
+    const math::Vec<2> epsilon = aExact ? math::Vec<2>{0., 0.} : math::Vec<2>{0.1, 0.1};
+    return math::trans3d::ndcToViewport(
+            { 
+                math::Position<2>{-0.5, -0.5} + epsilon,
+                static_cast<math::Size<2, double>>(aResolution)  - 2 * epsilon.as<math::Size>()
+            },
+            aNear, aFar);
+}
+
+
+template <class T_vertex, class T_program>
+std::vector<std::uint8_t> GraphicsPipeline::cullClusters(const IndexedMesh<T_vertex> & aMesh,
+                                                         const T_program & aProgram)
+{
+    std::vector<std::uint8_t> visible(aMesh.getClusterCount(), 1);
+    if constexpr (ProjectingProgram<T_program>)
+    {
+        if (aMesh.hasBounds())
+        {
+            const math::Matrix<4, 4> localToClip = aProgram.getLocalToClip();
+            if (isOutside(aMesh.bounds, localToClip, getViewVolume()))
+            {
+                std::fill(visible.begin(), visible.end(), 0);
+            }
+            else
+            {
+                for (std::size_t cluster = 0; cluster != visible.size(); ++cluster)
+                {
+                    visible[cluster] = !isOutside(aMesh.clusterBounds[cluster], localToClip, getViewVolume());
+                }
+            }
+        }
+    }
+    return visible;
+}
+
+
+template <class T_vertex, class T_program>
+std::vector<ShadedVertexOf<T_program, T_vertex>> GraphicsPipeline::shadeVertices(
+    const IndexedMesh<T_vertex> & aMesh,
+    const T_program & aProgram,
+    const std::vector<std::uint8_t> & aVisibleClusters) const
+{
+    constexpr std::size_t gVertexChunkSize = 1024;
+
+    const std::size_t visibleCount = std::count(aVisibleClusters.begin(), aVisibleClusters.end(), 1);
+    if (visibleCount == 0)
+    {
+        return {};
+    }
+
+    // When some clusters are culled, only the vertices they reference are shaded.
+    const bool allVisible = visibleCount == aVisibleClusters.size();
+    std::vector<std::uint8_t> referenced;
+    if (!allVisible)
+    {
+        referenced.resize(aMesh.vertices.size(), 0);
+        for (std::size_t cluster = 0; cluster != aVisibleClusters.size(); ++cluster)
+        {
+            if (aVisibleClusters[cluster])
+            {
+                const std::size_t end = std::min(aMesh.indices.size(), (cluster + 1) * aMesh.gClusterSize * 3);
+                for (std::size_t index = cluster * aMesh.gClusterSize * 3; index != end; ++index)
+                {
+                    referenced[aMesh.indices[index]] = 1;
+                }
+            }
+        }
+    }
+
+    // Vertices not referenced by a visible cluster are left default initialized.
+    std::vector<ShadedVertexOf<T_program, T_vertex>> shaded(aMesh.vertices.size());
+    const std::size_t chunkCount = (shaded.size() + gVertexChunkSize - 1) / gVertexChunkSize;
+    parallelFor(chunkCount, [&](std::size_t aChunk)
+    {
+        const std::size_t end = std::min(shaded.size(), (aChunk + 1) * gVertexChunkSize);
+        for (std::size_t vertexId = aChunk * gVertexChunkSize; vertexId != end; ++vertexId)
+        {
+            if (allVisible || referenced[vertexId])
+            {
+                shaded[vertexId] = aProgram.vertex(aMesh.vertices[vertexId]);
+            }
+        }
+    },
+    threadCount);
+    return shaded;
+}
+
+
+template <class T_vertex, class T_program, class F_emit>
+void GraphicsPipeline::processTriangle(const Triangle<T_vertex> & aTriangle,
+                                       const T_program & aProgram,
+                                       const math::AffineMatrix<4> & aViewportTransform,
+                                       F_emit && aEmit) const
+{
+    // Vertex shader
+    const Triangle<ShadedVertexOf<T_program, T_vertex>> triangleVertexStage{
+        aProgram.vertex(aTriangle.a),
+        aProgram.vertex(aTriangle.b),
+        aProgram.vertex(aTriangle.c),
+    };
+
+    processClipSpaceTriangle(triangleVertexStage, aViewportTransform, std::forward<F_emit>(aEmit));
+}
+
+
+template <class T_vertex, class F_emit>
+void GraphicsPipeline::processClipSpaceTriangle(const Triangle<T_vertex> & aTriangle,
+                                                const math::AffineMatrix<4> & aViewportTransform,
+                                                F_emit && aEmit) const
+{
+    // NOTE: The pipeline expects the output of the vertex processing stage to be in clip space
+    // (i.e. OpenGL convention).
+    // Thus, clipping is done against the simple case of unit cube.
+    const ViewVolume & volume = getViewVolume();
+    // Lines are not scissored, so wireframe is clipped exactly.
+    const double band = renderMode == Fill ? guardBand : 1.;
+    const ViewVolume guardBandVolume{math::Box<double>::CenterOnOrigin({2. * band, 2. * band, 2.})};
+
+    // Reused by all the triangles clipped on this thread.
+    thread_local ClipBuffer<T_vertex> clipped;
+
+    // Now, the vertices coordinates are expressed in clip space
+
+    // Clipping
+    clip(aTriangle, volume, guardBandVolume, clipped);
+    for (std::size_t clippedId = 0; clippedId != clipped.getTriangleCount(); ++clippedId)
+    {
+        auto triangle = clipped.getTriangle(clippedId);
+        // Perspective divide
+        triangle.perspectiveDivide();
+
+        // Viewport transform
+        triangle.transform(aViewportTransform);
+
+        // Now, the vertices coordinates are expressed in window space
+
+        // Backface culling in window space
+        // Note: I was not able to make it work reliably in clip space
+        if ( !triangle.isFacingFront() )
+        {
+            continue;
+        }
+
+        aEmit(triangle);
+    }
+}
+
+
+template <class T_vertex, class T_targetBuffer, class T_program>
+auto GraphicsPipeline::makeFragmentStage(const T_program & aProgram, DepthRange aDepthRange)
+{
+    if constexpr (MultisampleTarget<T_targetBuffer>)
+    {
+        return makeMultisampleStage<T_vertex>(aProgram, aDepthRange);
+    }
+    else
+    {
+        return makeSingleSampleStage<T_vertex>(aProgram, aDepthRange);
+    }
+}
+
+
+template <class T_vertex, class T_program>
+auto GraphicsPipeline::makeSingleSampleStage(const T_program & aProgram, DepthRange aDepthRange)
+{
+    return [&aProgram, aDepthRange](auto & aTarget,
+                                    math::Position<2, int> aScreenPosition, 
+                                    double aFragmentDepth, 
+                                    double aFragmentInverseDepth, 
+                                    const DeferredVaryings<T_vertex> & aVaryings)
+    {
+        using Target = std::remove_reference_t<decltype(aTarget)>;
+        using Format = typename Target::depth_format;
+
+        math::Position<4> fragmentCoordinates{
+            (double)aScreenPosition.x(), (double)aScreenPosition.y(), aFragmentDepth, aFragmentInverseDepth};
+
+        // Note: Near plane > Far plane, so the depth test is for superiority.
+        if constexpr (DepthWritingProgram<T_program, typename T_vertex::varyings_type>)
+        {
+            // Late depth test, the fragment depth is only known after the fragment shader.
+            double depth = aFragmentDepth;
+            auto color = aProgram.fragment(fragmentCoordinates, aVaryings.interpolate(), depth);
+            const auto encoded = Format::encode(depth, aDepthRange);
+            if (encoded > aTarget.depthAt(aScreenPosition))
+            {
+                if constexpr (ColorTarget<Target>)
+                {
+                    aTarget.colorAt(aScreenPosition) = color;
+                }
+                aTarget.depthAt(aScreenPosition) = encoded;
+            }
+        }
+        else
+        {
+            // Early depth test (Z buffer), occluded fragments are neither interpolated nor shaded.
+            const auto encoded = Format::encode(aFragmentDepth, aDepthRange);
+            if (encoded > aTarget.depthAt(aScreenPosition))
+            {
+                if constexpr (ColorTarget<Target>)
+                {
+                    // Fragment Shader
+                    aTarget.colorAt(aScreenPosition) = aProgram.fragment(fragmentCoordinates, aVaryings.interpolate());
+                }
+                aTarget.depthAt(aScreenPosition) = encoded;
+            }
+        }
+    };
+}
+
+
+template <class T_vertex, class T_program>
+auto GraphicsPipeline::makeMultisampleStage(const T_program & aProgram, DepthRange aDepthRange)
+{
+    return [&aProgram, aDepthRange](auto & aTarget,
+                                    math::Position<2, int> aScreenPosition,
+                                    const auto & aCoverage,
+                                    double aFragmentDepth,
+                                    double aFragmentInverseDepth,
+                                    const DeferredVaryings<T_vertex> & aVaryings)
+    {
+        using Target = std::remove_reference_t<decltype(aTarget)>;
+        using Format = typename Target::depth_format;
+
+        math::Position<4> fragmentCoordinates{
+            (double)aScreenPosition.x(), (double)aScreenPosition.y(), aFragmentDepth, aFragmentInverseDepth};
+
+        // Samples passing the depth test, whose depth is written.
+        std::uint32_t passed = 0;
+        if constexpr (DepthWritingProgram<T_program, typename T_vertex::varyings_type>)
+        {
+            // Late depth test, the same written depth is tested for all covered samples.
+            double depth = aFragmentDepth;
+            auto color = aProgram.fragment(fragmentCoordinates, aVaryings.interpolate(), depth);
+            const auto encoded = Format::encode(depth, aDepthRange);
+            for (int sample = 0; sample != Target::gSampleCount; ++sample)
+            {
+                if ((aCoverage.mask & (1u << sample)) && encoded > aTarget.depthAt(aScreenPosition, sample))
+                {
+                    aTarget.depthAt(aScreenPosition, sample) = encoded;
+                    passed |= 1u << sample;
+                }
+            }
+            if (passed != 0)
+            {
+                aTarget.writeColor(aScreenPosition, passed, color);
+            }
+        }
+        else
+        {
+            // Early depth test, per sample.
+            for (int sample = 0; sample != Target::gSampleCount; ++sample)
+            {
+                if (aCoverage.mask & (1u << sample))
+                {
+                    const auto encoded = Format::encode(aCoverage.depths[sample], aDepthRange);
+                    if (encoded > aTarget.depthAt(aScreenPosition, sample))
+                    {
+                        aTarget.depthAt(aScreenPosition, sample) = encoded;
+                        passed |= 1u << sample;
+                    }
+                }
+            }
+            // Fragment Shader, once for all the passing samples.
+            if (passed != 0)
+            {
+                aTarget.writeColor(aScreenPosition, passed,
+                                   aProgram.fragment(fragmentCoordinates, aVaryings.interpolate()));
+            }
+        }
+    };
+}
+
+
+template <class T_vertex>
+auto GraphicsPipeline::makeVisibilityStage(std::vector<std::uint32_t> & aPrimitives,
+                                           int aWidth,
+                                           std::uint32_t aPrimitive,
+                                           DepthRange aDepthRange)
+{
+    return [&aPrimitives, aWidth, aPrimitive, aDepthRange](auto & aTarget,
+                                                           math::Position<2, int> aScreenPosition,
+                                                           double aFragmentDepth,
+                                                           double /*aFragmentInverseDepth*/,
+                                                           const DeferredVaryings<T_vertex> & /*aVaryings*/)
+    {
+        using Format = typename std::remove_reference_t<decltype(aTarget)>::depth_format;
+        const auto encoded = Format::encode(aFragmentDepth, aDepthRange);
+        if (encoded > aTarget.depthAt(aScreenPosition))
+        {
+            aTarget.depthAt(aScreenPosition) = encoded;
+            aPrimitives[aScreenPosition.x() + (std::size_t)aScreenPosition.y() * aWidth] = aPrimitive;
+        }
+    };
+}
+
+
+template <class T_vertex, class T_targetBuffer, class T_program>
+void GraphicsPipeline::resolveVisibility(const std::vector<Triangle<T_vertex>> & aTriangles,
+                                         const std::vector<std::uint32_t> & aPrimitives,
+                                         T_targetBuffer & aTarget,
+                                         const T_program & aProgram) const
+{
+    // Such programs and targets are never deferred (see isDeferred()), but this is still instantiated.
+    if constexpr (DepthWritingProgram<T_program, typename T_vertex::varyings_type>
+                  || !ColorTarget<T_targetBuffer>)
+    {
+        assert(false);
+        return;
+    }
+    else
+    {
+        const math::Size<2, int> resolution = aTarget.getResolution();
+
+        // Visibility is already resolved, there is no depth test.
+        auto shadingStage = [&aProgram](T_targetBuffer & aTarget,
+                                        math::Position<2, int> aScreenPosition,
+                                        double aFragmentDepth,
+                                        double aFragmentInverseDepth,
+                                        const DeferredVaryings<T_vertex> & aVaryings)
+        {
+            math::Position<4> fragmentCoordinates{
+                (double)aScreenPosition.x(), (double)aScreenPosition.y(), aFragmentDepth, aFragmentInverseDepth};
+            aTarget.colorAt(aScreenPosition) = aProgram.fragment(fragmentCoordinates, aVaryings.interpolate());
+        };
+
+        // Triangle setup once per primitive, instead of once per shaded pixel.
+        std::vector<InterpolationSetup<T_vertex>> interpolations(aTriangles.size());
+        parallelFor(aTriangles.size(), [&](std::size_t aPrimitive)
+        {
+            interpolations[aPrimitive] = InterpolationSetup<T_vertex>{aTriangles[aPrimitive]};
+        },
+        threadCount);
+
+        parallelFor((std::size_t)resolution.height(), [&](std::size_t aRow)
+        {
+            const int y = static_cast<int>(aRow);
+            for (int x = 0; x != resolution.width(); ++x)
+            {
+                std::uint32_t primitive = aPrimitives[x + aRow * resolution.width()];
+                if (primitive == gNoPrimitive)
+                {
+                    continue;
+                }
+
+                // Barycentric coordinates of the pixel center are recomputed from the triangle.
+                const Triangle<T_vertex> & triangle = aTriangles[primitive];
+                const HPos center{(double)x, (double)y, 0., 1.};
+                emitFragment(interpolations[primitive], aTarget, shadingStage, {x, y},
+                             triangle.getFa()(center) / triangle.getFa()(triangle.a),
+                             triangle.getFb()(center) / triangle.getFb()(triangle.b),
+                             triangle.getFc()(center) / triangle.getFc()(triangle.c));
+            }
+        },
+        threadCount);
+    }
+}
+
+
+template <class T_vertex, class T_targetBuffer, ShaderProgram<T_vertex> T_program>
+T_targetBuffer & GraphicsPipeline::traverse(const Scene<T_vertex> & aScene,
+                                            T_targetBuffer & aTarget,
+                                            const T_program & aProgram,
+                                            double aNear, double aFar) const
+{
+    if (threadCount > 1 && renderMode == Fill)
+    {
+        return traverseTiled(aScene, aTarget, aProgram, aNear, aFar);
+    }
+
+    using Shaded = ShadedVertexOf<T_program, T_vertex>;
+
+    // Derived uniforms are computed once for the whole draw.
+    decltype(auto) program = bakeUniforms(aProgram);
+
+    const math::AffineMatrix<4> viewportTransform =
+        getViewportTransform(aTarget.getResolution(), aNear, aFar, MultisampleTarget<T_targetBuffer>);
+    const DepthRange depthRange{aNear, aFar};
+    const auto fragmentStage = makeFragmentStage<Shaded, T_targetBuffer>(program, depthRange);
+    // Triangles are only clipped to the guard band.
+    const Scissor viewport{0, 0, aTarget.getResolution().width() - 1, aTarget.getResolution().height() - 1};
+
+    // Deferred shading: window space triangles, and the visibility buffer indexing them.
+    const bool deferred = isDeferred<T_vertex, T_program, T_targetBuffer>();
+    std::vector<Triangle<Shaded>> windowTriangles;
+    std::vector<std::uint32_t> primitives;
+    if (deferred)
+    {
+        primitives.assign((std::size_t)aTarget.getResolution().area(), gNoPrimitive);
+    }
+
+    // TODO adress proper line drawing via shader and depth buffer
+    //for (const auto & line : aScene.lines)
+    //{
+    //    if (auto clippedLine = clip(line, volume))
+    //    {
+    //        rasterizeLine(*clippedLine, aTarget.color, ad::math::sdr::gWhite);
+    //    }
+    //}
+
+    // Lines are drawn directly in the color image, which must not have pending clears.
+    if ((renderMode & Wireframe).any())
+    {
+        aTarget.resolveClears();
+    }
+
+    auto drawTriangle = [&](const Triangle<Shaded> & triangle)
+    {
+        // Rasterization of primitives in viewport space
+        if (deferred)
+        {
+            // Multisample targets are never deferred, and would not accept the visibility stage.
+            if constexpr (!MultisampleTarget<T_targetBuffer>)
+            {
+                windowTriangles.push_back(triangle);
+                rasterize(windowTriangles.back(), aTarget,
+                          makeVisibilityStage<Shaded>(primitives, aTarget.getResolution().width(),
+                                                      static_cast<std::uint32_t>(windowTriangles.size() - 1),
+                                                      depthRange),
+                          viewport);
+            }
+        }
+        else if ((renderMode & Fill).any())
+        {
+            rasterize(triangle, aTarget, fragmentStage, viewport);
+        }
+        // TODO Implement depth test (and shaders?) for line rasterization.
+        if constexpr (ColorTarget<T_targetBuffer>)
+        {
+            if ((renderMode & Wireframe).any())
+            {
+                rasterizeLine(triangle.getLineC(), aTarget.color);
+                rasterizeLine(triangle.getLineB(), aTarget.color);
+                rasterizeLine(triangle.getLineA(), aTarget.color);
+            }
+        }
+    };
+
+    for (const auto & triangleScene : aScene.triangles)
+    {
+        processTriangle(triangleScene, program, viewportTransform, drawTriangle);
+    }
+
+    // Indexed draws, skipping the clusters outside of the view frustum
+    for (const auto & mesh : aScene.meshes)
+    {
+        const std::vector<std::uint8_t> visibleClusters = cullClusters(mesh, program);
+        const std::vector<Shaded> shaded = shadeVertices(mesh, program, visibleClusters);
+        for (std::size_t cluster = 0; cluster != visibleClusters.size(); ++cluster)
+        {
+            if (!visibleClusters[cluster])
+            {
+                continue;
+            }
+            const std::size_t end = std::min(mesh.getTriangleCount(), (cluster + 1) * mesh.gClusterSize);
+            for (std::size_t triangleId = cluster * mesh.gClusterSize; triangleId != end; ++triangleId)
+            {
+                processClipSpaceTriangle(assembleTriangle(mesh, shaded, triangleId), viewportTransform, drawTriangle);
+            }
+        }
+    }
+
+    if (deferred)
+    {
+        resolveVisibility(windowTriangles, primitives, aTarget, program);
+    }
+
+    return aTarget;
+}
+
+
+template <class T_vertex, class T_targetBuffer, ShaderProgram<T_vertex> T_program>
+T_targetBuffer & GraphicsPipeline::traverseTiled(const Scene<T_vertex> & aScene,
+                                                 T_targetBuffer & aTarget,
+                                                 const T_program & aProgram,
+                                                 double aNear, double aFar) const
+{
+    using Tile = TileBuffer<T_targetBuffer>;
+
+    using Shaded = ShadedVertexOf<T_program, T_vertex>;
+
+    // Derived uniforms are computed once for the whole draw.
+    decltype(auto) program = bakeUniforms(aProgram);
+
+    const math::Size<2, int> resolution = aTarget.getResolution();
+    const math::AffineMatrix<4> viewportTransform =
+        getViewportTransform(resolution, aNear, aFar, MultisampleTarget<T_targetBuffer>);
+    const DepthRange depthRange{aNear, aFar};
+    const auto fragmentStage = makeFragmentStage<Shaded, T_targetBuffer>(program, depthRange);
+
+    //
+    // Geometry processing, each chunk keeping its window space triangles in submission order.
+    //
+    // Indexed meshes vertices are shaded once, then their triangles are assembled.
+    // Clusters outside of the view frustum are skipped.
+    std::vector<std::vector<std::uint8_t>> visibleClusters;
+    std::vector<std::vector<Shaded>> shadedMeshes;
+    // Submission order is the scene triangles, then the triangles of each mesh:
+    // the first submission index of each mesh, with the total count as last element.
+    std::vector<std::size_t> meshFirstTriangle{aScene.triangles.size()};
+    for (const auto & mesh : aScene.meshes)
+    {
+        visibleClusters.push_back(cullClusters(mesh, program));
+        shadedMeshes.push_back(shadeVertices(mesh, program, visibleClusters.back()));
+        meshFirstTriangle.push_back(meshFirstTriangle.back() + mesh.getTriangleCount());
+    }
+    const std::size_t triangleCount = meshFirstTriangle.back();
+
+    const std::size_t chunkCount = (triangleCount + gTriangleChunkSize - 1) / gTriangleChunkSize;
+    std::vector<std::vector<Triangle<Shaded>>> chunks(chunkCount);
+    parallelFor(chunkCount, [&](std::size_t aChunk)
+    {
+        auto emit = [&](const Triangle<Shaded> & aTriangle)
+        {
+            chunks[aChunk].push_back(aTriangle);
+        };
+
+        const std::size_t end = std::min(triangleCount, (aChunk + 1) * gTriangleChunkSize);
+        for (std::size_t triangleId = aChunk * gTriangleChunkSize; triangleId != end; ++triangleId)
+        {
+            if (triangleId < aScene.triangles.size())
+            {
+                processTriangle(aScene.triangles[triangleId], program, viewportTransform, emit);
+            }
+            else
+            {
+                std::size_t meshId =
+                    std::upper_bound(meshFirstTriangle.begin(), meshFirstTriangle.end(), triangleId)
+                    - meshFirstTriangle.begin() - 1;
+                const std::size_t meshTriangle = triangleId - meshFirstTriangle[meshId];
+                if (visibleClusters[meshId][meshTriangle / aScene.meshes[meshId].gClusterSize])
+                {
+                    processClipSpaceTriangle(
+                        assembleTriangle(aScene.meshes[meshId], shadedMeshes[meshId], meshTriangle),
+                        viewportTransform, emit);
+                }
+            }
+        }
+    },
+    threadCount);
+
+    // Concatenate chunks, so each window space triangle is identified by its index.
+    std::vector<Triangle<Shaded>> windowTriangles;
+    for (auto & chunk : chunks)
+    {
+        windowTriangles.insert(windowTriangles.end(), chunk.begin(), chunk.end());
+        chunk = {};
+    }
+
+    //
+    // Binning, in submission order.
+    //
+    const int tilesX = (resolution.width() + Tile::gSize - 1) / Tile::gSize;
+    const int tilesY = (resolution.height() + Tile::gSize - 1) / Tile::gSize;
+    std::vector<std::vector<std::uint32_t>> bins((std::size_t)tilesX * tilesY);
+    // The samples of a pixel can be covered by a triangle not covering its center.
+    const double sampleReach = MultisampleTarget<T_targetBuffer> ? 0.5 : 0.;
+    for (std::uint32_t triangleId = 0; triangleId != windowTriangles.size(); ++triangleId)
+    {
+        const Triangle<Shaded> & triangle = windowTriangles[triangleId];
+        // Same pixel bounding box as the rasterizer
+        auto toTile = [](double aCoordinate, int aTileCount)
+        {
+            return std::clamp(static_cast<int>(std::nearbyint(aCoordinate)) / Tile::gSize, 0, aTileCount - 1);
+        };
+        const int firstX = toTile(std::max(0., triangle.xmin() - sampleReach), tilesX);
+        const int lastX  = toTile(std::max(0., triangle.xmax() + sampleReach), tilesX);
+        const int firstY = toTile(std::max(0., triangle.ymin() - sampleReach), tilesY);
+        const int lastY  = toTile(std::max(0., triangle.ymax() + sampleReach), tilesY);
+        for (int tileY = firstY; tileY <= lastY; ++tileY)
+        {
+            for (int tileX = firstX; tileX <= lastX; ++tileX)
+            {
+                bins[tileX + (std::size_t)tileY * tilesX].push_back(triangleId);
+            }
+        }
+    }
+
+    // Deferred shading: the visibility buffer is written by the tiles, each to its own pixels.
+    const bool deferred = isDeferred<T_vertex, T_program, T_targetBuffer>();
+    std::vector<std::uint32_t> primitives;
+    if (deferred)
+    {
+        primitives.assign((std::size_t)resolution.area(), gNoPrimitive);
+    }
+
+    //
+    // Rasterization, each tile being exclusively owned by one thread.
+    //
+    parallelFor(bins.size(), [&](std::size_t aTileId)
+    {
+        if (bins[aTileId].empty())
+        {
+            return;
+        }
+
+        const math::Position<2, int> origin{
+            static_cast<int>(aTileId % tilesX) * Tile::gSize,
+            static_cast<int>(aTileId / tilesX) * Tile::gSize,
+        };
+        const math::Size<2, int> size{
+            std::min(Tile::gSize, resolution.width() - origin.x()),
+            std::min(Tile::gSize, resolution.height() - origin.y()),
+        };
+        const Scissor scissor{
+            origin.x(),
+            origin.y(),
+            origin.x() + size.width() - 1,
+            origin.y() + size.height() - 1,
+        };
+
+        if constexpr (MultisampleTarget<T_targetBuffer>)
+        {
+            // Rasterized in place: the tile pixels (and their clear tile) are only accessed by this thread.
+            // (Multisample targets are never deferred.)
+            for (std::uint32_t triangleId : bins[aTileId])
+            {
+                rasterize(windowTriangles[triangleId], aTarget, fragmentStage, scissor);
+            }
+        }
+        else
+        {
+            // Reused by all the tiles rasterized on this thread.
+            thread_local Tile tile;
+            tile.load(aTarget, origin, size);
+
+            for (std::uint32_t triangleId : bins[aTileId])
+            {
+                if (deferred)
+                {
+                    rasterize(windowTriangles[triangleId], tile,
+                              makeVisibilityStage<Shaded>(primitives, resolution.width(), triangleId, depthRange),
+                              scissor);
+                }
+                else
+                {
+                    rasterize(windowTriangles[triangleId], tile, fragmentStage, scissor);
+                }
+            }
+
+            tile.store(aTarget);
+        }
+    },
+    threadCount);
+
+    if (deferred)
+    {
+        resolveVisibility(windowTriangles, primitives, aTarget, program);
+    }
 
     return aTarget;
 }
@@ -0,0 +1,408 @@
+#pragma once
+
+
+#include "Rasterization.h"
+#include "Triangle.h"
+
+#include <algorithm>
+#include <array>
+#include <optional>
+
+#include <cmath>
+#include <cstdint>
+
+
+namespace ad {
+namespace focg {
+
+
+// Notes:
+// Half-space rasterization: a pixel is covered when its center is on the inner side of the three edges,
+// each edge being the implicit line equation E(x, y) = a.x + b.y + c (FoCG 3rd 8.1.2 p166).
+// Contrary to rasterizeIncremental(), pixels are not visited one by one:
+// edge functions are evaluated for a block of gLaneCount pixels at once, which is made of two 2x2 quads.
+// The evaluation is a branchless loop over the lanes of the block, which the compiler vectorizes,
+// and it produces a coverage mask (one bit per lane).
+// Fragments are then emitted quad by quad, for the covered lanes only.
+//
+// Blocks are aligned on a global grid, and edge functions are evaluated from each block origin
+// (not accumulated), so a pixel gets the exact same values whatever the scissor (e.g. the tile).
+//
+// Pixels exactly on an edge are covered by only one of the two triangles sharing this edge.
+// FoCG 3rd p168 assigns them to the triangle for which the offscreen point (-1, -1) is on the inner side,
+// which leaves them uncovered when the edge goes through (-1, -1) (e.g. the diagonal of a screen aligned quad).
+// Instead, the tie is decided by the orientation of the edge (top-left rule, with y pointing up):
+// the triangle owning the edge is the one with its interior towards +x (or towards +y for horizontal edges).
+// The two triangles sharing an edge have exactly opposite edge functions, so exactly one of them owns it.
+//
+// Traversal is hierarchical, to avoid per-pixel tests on large triangles (floors, sky quads):
+// the bounds are visited by gCoarseBlockSize square blocks, then gFineBlockSize square blocks.
+// Edge functions being linear, their extrema over a block are found at its corners:
+// a block entirely on the outer side of an edge is rejected, a block on the inner side of all edges
+// is emitted without any coverage test. Only partially covered fine blocks are tested per pixel.
+
+
+/// \brief Block of pixels evaluated at once: two 2x2 quads side by side (4 pixels wide, 2 pixels high).
+constexpr int gLaneCount = 8;
+constexpr int gBlockWidth = 4;
+constexpr int gBlockHeight = 2;
+constexpr int gQuadSize = 4;
+// Lanes of the first quad, then lanes of the second quad.
+constexpr std::array<int, gLaneCount> gLaneX{0, 1, 0, 1, 2, 3, 2, 3};
+constexpr std::array<int, gLaneCount> gLaneY{0, 0, 1, 1, 0, 0, 1, 1};
+constexpr std::uint32_t gAllLanes = (1u << gLaneCount) - 1;
+
+/// \brief Sizes (in pixels) of the square blocks of the hierarchical traversal.
+/// Each must be a multiple of the next, and the smallest a multiple of the lanes block.
+constexpr int gCoarseBlockSize = 8;
+constexpr int gFineBlockSize = 4;
+static_assert(gCoarseBlockSize % gFineBlockSize == 0);
+static_assert(gFineBlockSize % gBlockWidth == 0 && gFineBlockSize % gBlockHeight == 0);
+
+
+enum class BlockClass
+{
+    Outside,
+    Partial,
+    Covered,
+};
+
+
+/// \brief Edge function, positive on the inner side of the edge.
+struct EdgeFunction
+{
+    double operator()(double x, double y) const
+    { return a * x + b * y + c; }
+
+    double a;
+    double b;
+    double c;
+    bool acceptsTie; // Whether a pixel center exactly on the edge is covered.
+};
+
+
+/// \brief Values of the edge functions for the lanes of a block, and the lanes coverage.
+struct BlockCoverage
+{
+    std::array<std::array<double, gLaneCount>, 3> edgeValues;
+    std::uint32_t mask; // Bit i is set when lane i is covered.
+};
+
+
+/// \brief Per-triangle constants of the half-space rasterization.
+struct HalfSpaceSetup
+{
+    /// \return Empty if the triangle is degenerate, or does not overlap aScissor.
+    template <class T_vertex>
+    static std::optional<HalfSpaceSetup> Make(const Triangle<T_vertex> & aTriangle, const Scissor & aScissor);
+
+    /// \brief Coverage of the gLaneCount pixels of the lanes block with origin (aX, aY).
+    BlockCoverage evaluateBlock(int aX, int aY) const;
+
+    /// \brief Edge values of the lanes block with origin (aX, aY), which must be entirely covered.
+    /// The values are computed exactly as in evaluateBlock(), but nothing is tested.
+    BlockCoverage interpolateBlock(int aX, int aY) const;
+
+    /// \brief Classify the aSize x aSize square block with origin (aX, aY), from its corners.
+    BlockClass classifyBlock(int aX, int aY, int aSize) const;
+
+    // Opposite to vertices a, b and c (i.e. lines A, B and C of the triangle).
+    std::array<EdgeFunction, 3> edges;
+    // Value of each edge function at its opposite vertex, dividing edge values gives barycentric coordinates.
+    std::array<double, 3> denominators;
+    // Offset of each edge function from the block origin to each lane.
+    std::array<std::array<double, gLaneCount>, 3> laneOffsets;
+    // Inclusive bounds of the pixels to rasterize.
+    int xMin, yMin, xMax, yMax;
+};
+
+
+/// \brief Rasterize aTriangle hierarchically, down to blocks of gLaneCount pixels,
+/// emitting fragments by 2x2 quads.
+///
+/// Produces the same coverage as rasterizeIncremental() (the reference implementation),
+/// except for pixels centers exactly on an edge, where it implements the top-left tie-breaking rule
+/// (the reference uses the offscreen point rule from FoCG).
+template <class T_vertex, class T_raster, class F_postRasterization>
+void rasterizeHalfSpace(const Triangle<T_vertex> & aTriangle,
+                        T_raster & aRaster,
+                        const F_postRasterization & aFragmentCallback,
+                        const Scissor & aScissor = {});
+
+
+//
+// Implementations
+//
+namespace detail {
+
+
+    /// \brief Largest multiple of aAlignment lower or equal to aValue (including for negative values).
+    inline int alignDown(int aValue, int aAlignment)
+    {
+        int remainder = aValue % aAlignment;
+        return aValue - (remainder < 0 ? remainder + aAlignment : remainder);
+    }
+
+
+    /// \brief Tie-breaking rule, for the edge function a.x + b.y + c positive on the inner side.
+    ///
+    /// Exactly one of (a, b) and (-a, -b) owns the ties, as long as they are not both null.
+    template <class T_factor>
+    bool ownsTies(T_factor a, T_factor b)
+    {
+        return a > 0 || (a == 0 && b > 0);
+    }
+
+
+    inline EdgeFunction makeEdge(const Line & aLine, const HPos & aOppositeVertex, double & aDenominator)
+    {
+        auto f = aLine.getImplicitEquation();
+        aDenominator = f(aOppositeVertex);
+        // Orient the edge so that the opposite vertex (i.e. the triangle interior) is on the positive side.
+        const double sign = aDenominator > 0. ? 1. : -1.;
+        aDenominator *= sign;
+
+        EdgeFunction edge{
+            sign * aLine.getEquationFactorX(),
+            sign * aLine.getEquationFactorY(),
+            sign * (aLine.pointA.x() * aLine.pointB.y() - aLine.pointB.x() * aLine.pointA.y()),
+            false,
+        };
+        edge.acceptsTie = ownsTies(edge.a, edge.b);
+        return edge;
+    }
+
+
+    template <class T_vertex, class T_setup, class T_block, class T_raster, class F_postRasterization>
+    void emitBlock(const InterpolationSetup<T_vertex> & aInterpolation,
+                   const T_setup & aSetup,
+                   const T_block & aBlock,
+                   int aX, int aY,
+                   T_raster & aRaster,
+                   const F_postRasterization & aFragmentCallback)
+    {
+        for (int quad = 0; quad != gLaneCount / gQuadSize; ++quad)
+        {
+            for (int lane = quad * gQuadSize; lane != (quad + 1) * gQuadSize; ++lane)
+            {
+                if (aBlock.mask & (1u << lane))
+                {
+                    emitFragment(aInterpolation, aRaster, aFragmentCallback,
+                                 {aX + gLaneX[lane], aY + gLaneY[lane]},
+                                 static_cast<double>(aBlock.edgeValues[0][lane]) / aSetup.denominators[0],
+                                 static_cast<double>(aBlock.edgeValues[1][lane]) / aSetup.denominators[1],
+                                 static_cast<double>(aBlock.edgeValues[2][lane]) / aSetup.denominators[2]);
+                }
+            }
+        }
+    }
+
+
+    /// \brief Emit all lanes blocks of the aSize square block at (aX, aY),
+    /// testing each pixel only if N_testCoverage.
+    template <bool N_testCoverage, class T_vertex, class T_setup, class T_raster, class F_postRasterization>
+    void emitSquareBlock(const InterpolationSetup<T_vertex> & aInterpolation,
+                         const T_setup & aSetup,
+                         int aX, int aY, int aSize,
+                         T_raster & aRaster,
+                         const F_postRasterization & aFragmentCallback)
+    {
+        for (int y = aY; y != aY + aSize; y += gBlockHeight)
+        {
+            for (int x = aX; x != aX + aSize; x += gBlockWidth)
+            {
+                const auto block = N_testCoverage ? aSetup.evaluateBlock(x, y)
+                                                  : aSetup.interpolateBlock(x, y);
+                if (block.mask != 0)
+                {
+                    emitBlock(aInterpolation, aSetup, block, x, y, aRaster, aFragmentCallback);
+                }
+            }
+        }
+    }
+
+
+    /// \brief Hierarchical traversal of the bounds of aSetup, by coarse then fine square blocks.
+    ///
+    /// T_setup provides the bounds, classifyBlock(), evaluateBlock(), interpolateBlock()
+    /// and the denominators of the barycentric coordinates (see HalfSpaceSetup).
+    template <class T_vertex, class T_setup, class T_raster, class F_postRasterization>
+    void traverseBlocks(const InterpolationSetup<T_vertex> & aInterpolation,
+                        const T_setup & aSetup,
+                        T_raster & aRaster,
+                        const F_postRasterization & aFragmentCallback)
+    {
+        for (int y = alignDown(aSetup.yMin, gCoarseBlockSize); y <= aSetup.yMax; y += gCoarseBlockSize)
+        {
+            for (int x = alignDown(aSetup.xMin, gCoarseBlockSize); x <= aSetup.xMax; x += gCoarseBlockSize)
+            {
+                switch (aSetup.classifyBlock(x, y, gCoarseBlockSize))
+                {
+                case BlockClass::Outside:
+                    break;
+                case BlockClass::Covered:
+                    emitSquareBlock<false>(aInterpolation, aSetup, x, y, gCoarseBlockSize, aRaster, aFragmentCallback);
+                    break;
+                case BlockClass::Partial:
+                    for (int fineY = y; fineY != y + gCoarseBlockSize; fineY += gFineBlockSize)
+                    {
+                        for (int fineX = x; fineX != x + gCoarseBlockSize; fineX += gFineBlockSize)
+                        {
+                            switch (aSetup.classifyBlock(fineX, fineY, gFineBlockSize))
+                            {
+                            case BlockClass::Outside:
+                                break;
+                            case BlockClass::Covered:
+                                emitSquareBlock<false>(aInterpolation, aSetup, fineX, fineY, gFineBlockSize,
+                                                       aRaster, aFragmentCallback);
+                                break;
+                            case BlockClass::Partial:
+                                emitSquareBlock<true>(aInterpolation, aSetup, fineX, fineY, gFineBlockSize,
+                                                      aRaster, aFragmentCallback);
+                                break;
+                            }
+                        }
+                    }
+                    break;
+                }
+            }
+        }
+    }
+
+
+} // namespace detail
+
+
+template <class T_vertex>
+std::optional<HalfSpaceSetup> HalfSpaceSetup::Make(const Triangle<T_vertex> & aTriangle, const Scissor & aScissor)
+{
+    HalfSpaceSetup setup;
+    setup.edges = {
+        detail::makeEdge(aTriangle.getLineA(), aTriangle.a.pos, setup.denominators[0]),
+        detail::makeEdge(aTriangle.getLineB(), aTriangle.b.pos, setup.denominators[1]),
+        detail::makeEdge(aTriangle.getLineC(), aTriangle.c.pos, setup.denominators[2]),
+    };
+
+    // Test for degenerate triangle (zero area), which should not be rasterized.
+    if (setup.denominators[0] == 0. || setup.denominators[1] == 0. || setup.denominators[2] == 0.)
+    {
+        return std::nullopt;
+    }
+
+    for (std::size_t edge = 0; edge != 3; ++edge)
+    {
+        for (int lane = 0; lane != gLaneCount; ++lane)
+        {
+            setup.laneOffsets[edge][lane] = setup.edges[edge].a * gLaneX[lane] + setup.edges[edge].b * gLaneY[lane];
+        }
+    }
+
+    // Pixel centers have integer coordinates.
+    setup.xMin = std::max(static_cast<int>(std::ceil(aTriangle.xmin())), aScissor.xMin);
+    setup.yMin = std::max(static_cast<int>(std::ceil(aTriangle.ymin())), aScissor.yMin);
+    setup.xMax = std::min(static_cast<int>(std::floor(aTriangle.xmax())), aScissor.xMax);
+    setup.yMax = std::min(static_cast<int>(std::floor(aTriangle.ymax())), aScissor.yMax);
+    if (setup.xMin > setup.xMax || setup.yMin > setup.yMax)
+    {
+        return std::nullopt;
+    }
+
+    return setup;
+}
+
+
+inline BlockCoverage HalfSpaceSetup::interpolateBlock(int aX, int aY) const
+{
+    BlockCoverage result;
+    for (std::size_t edge = 0; edge != 3; ++edge)
+    {
+        const double origin = edges[edge](aX, aY);
+        const double * offsets = laneOffsets[edge].data();
+        double * values = result.edgeValues[edge].data();
+        for (int lane = 0; lane != gLaneCount; ++lane)
+        {
+            values[lane] = origin + offsets[lane];
+        }
+    }
+    result.mask = gAllLanes;
+    return result;
+}
+
+
+inline BlockClass HalfSpaceSetup::classifyBlock(int aX, int aY, int aSize) const
+{
+    // Inclusive coordinates of the last pixel center in the block.
+    const int xLast = aX + aSize - 1;
+    const int yLast = aY + aSize - 1;
+    if (xLast < xMin || aX > xMax || yLast < yMin || aY > yMax)
+    {
+        return BlockClass::Outside;
+    }
+    bool partial = aX < xMin || xLast > xMax || aY < yMin || yLast > yMax;
+
+    const double span = aSize - 1;
+    for (const EdgeFunction & edge : edges)
+    {
+        const double origin = edge(aX, aY);
+        const double maximum = origin + std::max(edge.a, 0.) * span + std::max(edge.b, 0.) * span;
+        const double minimum = origin + std::min(edge.a, 0.) * span + std::min(edge.b, 0.) * span;
+        if (maximum < 0. || (maximum == 0. && !edge.acceptsTie))
+        {
+            return BlockClass::Outside;
+        }
+        partial |= !(minimum > 0. || (minimum == 0. && edge.acceptsTie));
+    }
+    return partial ? BlockClass::Partial : BlockClass::Covered;
+}
+
+
+inline BlockCoverage HalfSpaceSetup::evaluateBlock(int aX, int aY) const
+{
+    BlockCoverage result;
+    std::array<std::uint32_t, gLaneCount> covered;
+
+    // Lanes outside of the bounds (triangle bounding box and scissor).
+    for (int lane = 0; lane != gLaneCount; ++lane)
+    {
+        const int x = aX + gLaneX[lane];
+        const int y = aY + gLaneY[lane];
+        covered[lane] = (x >= xMin) & (x <= xMax) & (y >= yMin) & (y <= yMax);
+    }
+
+    for (std::size_t edge = 0; edge != 3; ++edge)
+    {
+        const double origin = edges[edge](aX, aY);
+        const std::uint32_t acceptsTie = edges[edge].acceptsTie;
+        const double * offsets = laneOffsets[edge].data();
+        double * values = result.edgeValues[edge].data();
+        for (int lane = 0; lane != gLaneCount; ++lane)
+        {
+            values[lane] = origin + offsets[lane];
+            covered[lane] &= (values[lane] > 0.) | ((values[lane] == 0.) & acceptsTie);
+        }
+    }
+
+    result.mask = 0;
+    for (int lane = 0; lane != gLaneCount; ++lane)
+    {
+        result.mask |= covered[lane] << lane;
+    }
+    return result;
+}
+
+
+template <class T_vertex, class T_raster, class F_postRasterization>
+void rasterizeHalfSpace(const Triangle<T_vertex> & aTriangle,
+                        T_raster & aRaster,
+                        const F_postRasterization & aFragmentCallback,
+                        const Scissor & aScissor)
+{
+    if (std::optional<HalfSpaceSetup> setup = HalfSpaceSetup::Make(aTriangle, aScissor))
+    {
+        detail::traverseBlocks(InterpolationSetup<T_vertex>{aTriangle}, *setup, aRaster, aFragmentCallback);
+    }
+}
+
+
+} // namespace focg
+} // namespace ad
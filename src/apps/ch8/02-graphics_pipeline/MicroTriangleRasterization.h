@@ -0,0 +1,135 @@
+#pragma once
+
+
+#include "FixedPointRasterization.h"
+#include "Rasterization.h"
+#include "Triangle.h"
+
+#include <algorithm>
+#include <array>
+#include <optional>
+
+#include <cstdint>
+
+
+namespace ad {
+namespace focg {
+
+
+// Notes:
+// Fast path of the fixed-point rasterization (see FixedPointRasterization.h) for micro triangles,
+// whose bounding box contains at most gMicroTriangleSize x gMicroTriangleSize pixel centers.
+// Dense meshes far from the camera (or at low resolutions) are mostly made of such triangles.
+// For them, it skips the per-triangle setup of the block traversal (lane offsets, hierarchical classification)
+// and of the spans, testing the few candidate pixel centers directly.
+// It is not a measured speedup of the demo: at 800x800, only about 1% of the bunny triangles are micro.
+//
+// The snapped vertices and the edge functions are the same as rasterizeFixedPoint(),
+// so are the coverage (watertight) and the barycentric coordinates.
+// Many micro triangles do not cover any pixel center (their bounding box contains none, or they miss it):
+// the interpolation setup is only computed once a pixel is covered.
+
+
+/// \brief Largest number of pixel centers along each axis of the bounding box of a micro triangle.
+constexpr int gMicroTriangleSize = 2;
+
+
+/// \brief Rasterize aTriangle with its vertices snapped to the subpixel grid,
+/// by testing each pixel center of its bounding box, if it is a micro triangle.
+///
+/// Produces the exact same fragments as rasterizeFixedPoint().
+/// \return false if aTriangle is not a micro triangle, in which case nothing is rasterized.
+template <class T_vertex, class T_raster, class F_postRasterization>
+bool rasterizeMicroTriangle(const Triangle<T_vertex> & aTriangle,
+                            T_raster & aRaster,
+                            const F_postRasterization & aFragmentCallback,
+                            const Scissor & aScissor = {});
+
+
+//
+// Implementations
+//
+template <class T_vertex, class T_raster, class F_postRasterization>
+bool rasterizeMicroTriangle(const Triangle<T_vertex> & aTriangle,
+                            T_raster & aRaster,
+                            const F_postRasterization & aFragmentCallback,
+                            const Scissor & aScissor)
+{
+    // Early rejection of larger triangles, before snapping: beyond gMicroTriangleSize + 2 pixels,
+    // the snapped bounding box contains more pixel centers whatever the rounding.
+    constexpr double gRejectedExtent = gMicroTriangleSize + 2.;
+    if (aTriangle.xmax() - aTriangle.xmin() > gRejectedExtent
+        || aTriangle.ymax() - aTriangle.ymin() > gRejectedExtent)
+    {
+        return false;
+    }
+
+    const detail::SubpixelPosition a = detail::snap(aTriangle.a.pos);
+    const detail::SubpixelPosition b = detail::snap(aTriangle.b.pos);
+    const detail::SubpixelPosition c = detail::snap(aTriangle.c.pos);
+
+    // The size test is done on the bounding box of the triangle, whatever the scissor.
+    int xMin = detail::ceilToPixel(std::min({a.x, b.x, c.x}));
+    int yMin = detail::ceilToPixel(std::min({a.y, b.y, c.y}));
+    int xMax = detail::floorToPixel(std::max({a.x, b.x, c.x}));
+    int yMax = detail::floorToPixel(std::max({a.y, b.y, c.y}));
+    // Between two rows (or columns) of pixel centers, there is nothing to rasterize.
+    if (xMin > xMax || yMin > yMax)
+    {
+        return true;
+    }
+    else if (xMax - xMin >= gMicroTriangleSize || yMax - yMin >= gMicroTriangleSize)
+    {
+        return false;
+    }
+
+    xMin = std::max(xMin, aScissor.xMin);
+    yMin = std::max(yMin, aScissor.yMin);
+    xMax = std::min(xMax, aScissor.xMax);
+    yMax = std::min(yMax, aScissor.yMax);
+    if (xMin > xMax || yMin > yMax)
+    {
+        return true;
+    }
+
+    std::int64_t doubleArea;
+    const std::array<FixedEdgeFunction, 3> edges{
+        detail::makeFixedEdge(b, c, a, doubleArea),
+        detail::makeFixedEdge(c, a, b, doubleArea),
+        detail::makeFixedEdge(a, b, c, doubleArea),
+    };
+    // Degenerate after snapping (zero area), which should not be rasterized.
+    if (doubleArea == 0)
+    {
+        return true;
+    }
+    const double denominator = static_cast<double>(doubleArea);
+
+    std::optional<InterpolationSetup<T_vertex>> interpolation;
+    for (int y = yMin; y <= yMax; ++y)
+    {
+        for (int x = xMin; x <= xMax; ++x)
+        {
+            const std::array<std::int64_t, 3> values{edges[0](x, y), edges[1](x, y), edges[2](x, y)};
+            if (values[0] >= edges[0].threshold
+                && values[1] >= edges[1].threshold
+                && values[2] >= edges[2].threshold)
+            {
+                if (!interpolation)
+                {
+                    interpolation.emplace(aTriangle);
+                }
+                emitFragment(*interpolation, aRaster, aFragmentCallback,
+                             {x, y},
+                             static_cast<double>(values[0]) / denominator,
+                             static_cast<double>(values[1]) / denominator,
+                             static_cast<double>(values[2]) / denominator);
+            }
+        }
+    }
+    return true;
+}
+
+
+} // namespace focg
+} // namespace ad
@@ -0,0 +1,195 @@
+#pragma once
+
+
+#include "FixedPointRasterization.h"
+#include "Rasterization.h"
+#include "Triangle.h"
+
+#include <algorithm>
+#include <array>
+
+#include <cstdint>
+
+
+namespace ad {
+namespace focg {
+
+
+// Notes:
+// Multisample rasterization: coverage is evaluated at N_samples positions within each pixel,
+// instead of only at its center. Edge functions are the exact fixed-point ones (see FixedPointRasterization.h),
+// and sample positions lie on the subpixel grid, so the per-sample coverage is watertight as well:
+// a sample exactly on an edge shared by two triangles is covered by exactly one of them.
+//
+// Each pixel with at least one covered sample produces a single fragment, carrying its coverage mask
+// and the depth of each covered sample. The fragment is shaded once (at the pixel center),
+// while the depth test and the writes happen per sample.
+// The pixel center can be outside of the triangle (only some samples being covered):
+// as with hardware without centroid interpolation, varyings are then slightly extrapolated.
+
+
+/// \brief Offsets of the samples from the pixel center, in 1/16th of pixel.
+///
+/// Those are the standard rotated grid patterns (as in Direct3D), which resolve
+/// near horizontal and near vertical edges with N_samples distinct intensities.
+template <int N_samples>
+constexpr auto getSamplePattern()
+{
+    static_assert(N_samples == 1 || N_samples == 2 || N_samples == 4 || N_samples == 8,
+                  "Supported sample counts are 1, 2, 4 and 8.");
+
+    using Offset = std::array<int, 2>;
+    if constexpr (N_samples == 1)
+    {
+        return std::array<Offset, 1>{{{0, 0}}};
+    }
+    else if constexpr (N_samples == 2)
+    {
+        return std::array<Offset, 2>{{{4, 4}, {-4, -4}}};
+    }
+    else if constexpr (N_samples == 4)
+    {
+        return std::array<Offset, 4>{{{-2, -6}, {6, -2}, {-6, 2}, {2, 6}}};
+    }
+    else
+    {
+        return std::array<Offset, 8>{{
+            {1, -3}, {-1, 3}, {5, 1}, {-3, -5}, {-5, 5}, {-7, -1}, {3, 7}, {7, -7}
+        }};
+    }
+}
+
+
+/// \brief Coverage of the samples of a pixel by a triangle.
+template <int N_samples>
+struct SampleCoverage
+{
+    static constexpr std::uint32_t gAllSamples = (1u << N_samples) - 1;
+
+    std::uint32_t mask; // Bit i is set when sample i is covered.
+    // Window space depth at each sample, only meaningful for covered samples.
+    std::array<double, N_samples> depths;
+};
+
+
+/// \brief Rasterize aTriangle evaluating coverage and depth at N_samples per pixel.
+///
+/// aFragmentCallback is invoked once per pixel with at least one covered sample, with the arguments
+/// (aRaster, position, const SampleCoverage<N_samples> &, center depth, center depth inverse, DeferredVaryings).
+template <int N_samples, class T_vertex, class T_raster, class F_postRasterization>
+void rasterizeMultisample(const Triangle<T_vertex> & aTriangle,
+                          T_raster & aRaster,
+                          const F_postRasterization & aFragmentCallback,
+                          const Scissor & aScissor = {});
+
+
+//
+// Implementations
+//
+template <int N_samples, class T_vertex, class T_raster, class F_postRasterization>
+void rasterizeMultisample(const Triangle<T_vertex> & aTriangle,
+                          T_raster & aRaster,
+                          const F_postRasterization & aFragmentCallback,
+                          const Scissor & aScissor)
+{
+    constexpr auto pattern = getSamplePattern<N_samples>();
+    // Sample offsets are in 1/16th of pixel, which the subpixel grid represents exactly.
+    constexpr std::int64_t gSampleUnit = 16;
+    static_assert(gSubpixelScale % gSampleUnit == 0);
+
+    const detail::SubpixelPosition a = detail::snap(aTriangle.a.pos);
+    const detail::SubpixelPosition b = detail::snap(aTriangle.b.pos);
+    const detail::SubpixelPosition c = detail::snap(aTriangle.c.pos);
+
+    std::int64_t doubleArea;
+    const std::array<FixedEdgeFunction, 3> edges{
+        detail::makeFixedEdge(b, c, a, doubleArea),
+        detail::makeFixedEdge(c, a, b, doubleArea),
+        detail::makeFixedEdge(a, b, c, doubleArea),
+    };
+    // Degenerate after snapping (zero area), which should not be rasterized.
+    if (doubleArea == 0)
+    {
+        return;
+    }
+    const double denominator = static_cast<double>(doubleArea);
+    const InterpolationSetup<T_vertex> interpolation{aTriangle};
+
+    // Offset of each edge function from the pixel center to each sample.
+    // Steps are multiples of gSubpixelScale, so the division is exact.
+    std::array<std::array<std::int64_t, N_samples>, 3> sampleOffsets;
+    for (std::size_t edge = 0; edge != 3; ++edge)
+    {
+        for (int sample = 0; sample != N_samples; ++sample)
+        {
+            sampleOffsets[edge][sample] = (edges[edge].stepX * pattern[sample][0]
+                                           + edges[edge].stepY * pattern[sample][1]) / gSampleUnit;
+        }
+    }
+
+    // Pixels whose samples can be covered: the samples are less than half a pixel away from the center.
+    const std::int64_t reach = gSubpixelScale / 2;
+    const int xMin = std::max(detail::ceilToPixel(std::min({a.x, b.x, c.x}) - reach), aScissor.xMin);
+    const int yMin = std::max(detail::ceilToPixel(std::min({a.y, b.y, c.y}) - reach), aScissor.yMin);
+    const int xMax = std::min(detail::floorToPixel(std::max({a.x, b.x, c.x}) + reach), aScissor.xMax);
+    const int yMax = std::min(detail::floorToPixel(std::max({a.y, b.y, c.y}) + reach), aScissor.yMax);
+
+    SampleCoverage<N_samples> coverage;
+    for (int y = yMin; y <= yMax; ++y)
+    {
+        for (int x = xMin; x <= xMax; ++x)
+        {
+            const std::array<std::int64_t, 3> centerValues{edges[0](x, y), edges[1](x, y), edges[2](x, y)};
+
+            // Branchless evaluation of all the samples.
+            std::array<std::uint32_t, N_samples> covered;
+            covered.fill(1);
+            for (std::size_t edge = 0; edge != 3; ++edge)
+            {
+                for (int sample = 0; sample != N_samples; ++sample)
+                {
+                    covered[sample] &= (centerValues[edge] + sampleOffsets[edge][sample] >= edges[edge].threshold);
+                }
+            }
+            coverage.mask = 0;
+            for (int sample = 0; sample != N_samples; ++sample)
+            {
+                coverage.mask |= covered[sample] << sample;
+            }
+            if (coverage.mask == 0)
+            {
+                continue;
+            }
+
+            for (int sample = 0; sample != N_samples; ++sample)
+            {
+                if (coverage.mask & (1u << sample))
+                {
+                    coverage.depths[sample] =
+                        (centerValues[0] + sampleOffsets[0][sample]) / denominator * aTriangle.a.pos.z()
+                        + (centerValues[1] + sampleOffsets[1][sample]) / denominator * aTriangle.b.pos.z()
+                        + (centerValues[2] + sampleOffsets[2][sample]) / denominator * aTriangle.c.pos.z();
+                }
+            }
+
+            // The fragment itself is interpolated at the pixel center.
+            emitFragment(interpolation, aRaster,
+                         [&coverage, &aFragmentCallback](T_raster & aRaster,
+                                                         math::Position<2, int> aPosition,
+                                                         double aDepth,
+                                                         double aDepthInverse,
+                                                         const DeferredVaryings<T_vertex> & aVaryings)
+                         {
+                             aFragmentCallback(aRaster, aPosition, coverage, aDepth, aDepthInverse, aVaryings);
+                         },
+                         {x, y},
+                         centerValues[0] / denominator,
+                         centerValues[1] / denominator,
+                         centerValues[2] / denominator);
+        }
+    }
+}
+
+
+} // namespace focg
+} // namespace ad
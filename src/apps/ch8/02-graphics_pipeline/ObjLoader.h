@@ -3,8 +3,10 @@
 
 # include "Scene.h"
 
+#include <array>
 #include <fstream>
 #include <istream>
+#include <map>
 #include <sstream>
 #include <string>
 #include <vector>
@@ -35,107 +37,178 @@ std::vector<std::string> splitString(const std::string & aString, char aDelimite
 }
 
 
-template <class T_colorStore, class T_vertex>
-void appendToScene(std::istream & aInputObj, Scene<T_vertex> & aScene, const T_colorStore & aColors)
-{
-    std::vector<T_vertex> vertices;
-    std::vector<HVec> normals;
-    std::vector<math::Position<2>> textureCoords;
-    for (std::string line; std::getline(aInputObj, line);)
+namespace detail {
+
+
+    /// \brief A vertex referenced by a face, with the OBJ indices identifying its attributes.
+    template <class T_vertex>
+    struct ObjCorner
+    {
+        // (position, texture coordinates, normal), texture is npos when the face does not provide it.
+        using Key = std::array<std::size_t, 3>;
+
+        T_vertex vertex;
+        Key key;
+    };
+
+
+    /// \brief Parse aInputObj, invoking aFace with the 3 corners of each face.
+    template <class T_vertex, class T_colorStore, class F_face>
+    void parseObj(std::istream & aInputObj, const T_colorStore & aColors, F_face && aFace)
     {
-        std::istringstream input{line};
-        std::string type;
-        input >> type;
-
-        // Empty line
-        if (type.empty())
-        {}
-        // comment
-        else if (type[0] == '#')
-        {}
-        // object name
-        else if (type == "o")
-        {}
-        // smoothing group (?)
-        else if (type == "s")
-        {}
-        // Vertex
-        else if (type == "v")
+        std::vector<T_vertex> vertices;
+        std::vector<math::Vec<3, float>> normals;
+        std::vector<math::Position<2, float>> textureCoords;
+        for (std::string line; std::getline(aInputObj, line);)
         {
-            double x, y, z;
-            input >> x; input >> y; input >> z;
-            if (input)
+            std::istringstream input{line};
+            std::string type;
+            input >> type;
+
+            // Empty line
+            if (type.empty())
+            {}
+            // comment
+            else if (type[0] == '#')
+            {}
+            // object name
+            else if (type == "o")
+            {}
+            // smoothing group (?)
+            else if (type == "s")
+            {}
+            // Vertex
+            else if (type == "v")
             {
-                vertices.push_back(T_vertex{
-                        HPos{x, y, z, 1.0},
-                        aColors[vertices.size() % aColors.size()]
-                });
+                float x, y, z;
+                input >> x; input >> y; input >> z;
+                if (input)
+                {
+                    vertices.push_back(T_vertex{
+                            .pos = {x, y, z},
+                            .normal = {},
+                            .uv = {0.f, 0.f},
+                            .color = to_sdr(aColors[vertices.size() % aColors.size()]),
+                    });
+                }
+                else
+                {
+                    ERR("Invalid vertex format.");
+                }
             }
-            else
+            // Vertex normal
+            else if (type == "vn")
             {
-                ERR("Invalid vertex format.");
+                float x, y, z;
+                input >> x; input >> y; input >> z;
+                normals.push_back({x, y, z});
             }
-        }
-        // Vertex normal
-        else if (type == "vn")
-        {
-            double x, y, z;
-            input >> x; input >> y; input >> z;
-            normals.push_back({x, y, z, 0.0});
-        }
-        // Texture coordinate
-        else if (type == "vt")
-        {
-            double u, v;
-            input >> u; input >> v;
-            textureCoords.push_back({u, v});
-        }
-        else if (type == "f")
-        {
-            std::array<std::size_t, 3> triangleVertices;
-            int count = 0;
-            for (std::string indicesStr; input >> indicesStr;)
+            // Texture coordinate
+            else if (type == "vt")
             {
-                std::vector<std::string> indices = splitString(indicesStr, '/');
-                assert(indices.size() == 3);
-
-                // ATTENTION Obj format is 1-indexed
-                std::size_t vertexIndex = std::stoul(indices[0]) - 1;
-                triangleVertices[count++] = vertexIndex;
-
-                // Normal
-                std::size_t normalIndex = std::stoul(indices[2]) - 1;
-                // Dirty: patch the vertex in the initial list each time with the normal.
-                vertices.at(vertexIndex).normal = normals.at(normalIndex);
-
-                // Texture Coordinates
-                // Allow for models without texture coordinates (keep the default value)
-                if (indices[1].length() != 0)
+                float u, v;
+                input >> u; input >> v;
+                textureCoords.push_back({u, v});
+            }
+            else if (type == "f")
+            {
+                std::array<ObjCorner<T_vertex>, 3> corners;
+                int count = 0;
+                for (std::string indicesStr; input >> indicesStr;)
                 {
-                    std::size_t textureCoordIndex = std::stoul(indices[1]) - 1;
-                    // Dirty: patch the vertex in the initial list each time with the UV.
-                    vertices.at(vertexIndex).uv = textureCoords.at(textureCoordIndex);
+                    if (count == 3)
+                    {
+                        ERR("Only handle faces with 3 vertices, not more.");
+                    }
+
+                    std::vector<std::string> indices = splitString(indicesStr, '/');
+                    assert(indices.size() == 3);
+
+                    // ATTENTION Obj format is 1-indexed
+                    std::size_t vertexIndex = std::stoul(indices[0]) - 1;
+
+                    // Normal
+                    std::size_t normalIndex = std::stoul(indices[2]) - 1;
+                    // Dirty: patch the vertex in the initial list each time with the normal.
+                    vertices.at(vertexIndex).normal = PackedNormal{normals.at(normalIndex)};
+
+                    // Texture Coordinates
+                    // Allow for models without texture coordinates (keep the default value)
+                    std::size_t textureCoordIndex = std::string::npos;
+                    if (indices[1].length() != 0)
+                    {
+                        textureCoordIndex = std::stoul(indices[1]) - 1;
+                        // Dirty: patch the vertex in the initial list each time with the UV.
+                        vertices.at(vertexIndex).uv = textureCoords.at(textureCoordIndex);
+                    }
+
+                    corners[count++] = {vertices.at(vertexIndex), {vertexIndex, textureCoordIndex, normalIndex}};
                 }
-            }
 
-            if (count != 3)
-            {
-                ERR("Only handle faces with 3 vertices, not " + std::to_string(count) + ".");
+                if (count != 3)
+                {
+                    ERR("Only handle faces with 3 vertices, not " + std::to_string(count) + ".");
+                }
+                else
+                {
+                    aFace(corners);
+                }
             }
             else
             {
-                aScene.triangles.push_back({
-                        vertices.at(triangleVertices[0]),
-                        vertices.at(triangleVertices[1]),
-                        vertices.at(triangleVertices[2])
-                });
+                ERR("Unsupported line type: " + type);
             }
         }
-        else
+    }
+
+
+} // namespace detail
+
+
+template <class T_colorStore, class T_vertex>
+void appendToScene(std::istream & aInputObj, Scene<T_vertex> & aScene, const T_colorStore & aColors)
+{
+    detail::parseObj<T_vertex>(aInputObj, aColors, [&aScene](const auto & aCorners)
+    {
+        aScene.triangles.push_back({aCorners[0].vertex, aCorners[1].vertex, aCorners[2].vertex});
+    });
+}
+
+
+/// \brief Append the content of aInputObj as a single indexed mesh.
+///
+/// Face corners referencing the same position, texture coordinates and normal share a single vertex.
+template <class T_colorStore, class T_vertex>
+void appendIndexedToScene(std::istream & aInputObj, Scene<T_vertex> & aScene, const T_colorStore & aColors)
+{
+    IndexedMesh<T_vertex> mesh;
+    std::map<typename detail::ObjCorner<T_vertex>::Key, std::uint32_t> uniqueVertices;
+
+    detail::parseObj<T_vertex>(aInputObj, aColors, [&](const auto & aCorners)
+    {
+        for (const auto & corner : aCorners)
         {
-            ERR("Unsupported line type: " + type);
+            auto [found, inserted] =
+                uniqueVertices.try_emplace(corner.key, static_cast<std::uint32_t>(mesh.vertices.size()));
+            if (inserted)
+            {
+                mesh.vertices.push_back(corner.vertex);
+            }
+            mesh.indices.push_back(found->second);
         }
-    }
+    });
+
+    mesh.computeBounds();
+    aScene.meshes.push_back(std::move(mesh));
+}
+
+
+template <class T_vertex>
+inline void appendIndexedToScene(std::istream & aInputObj,
+                                 Scene<T_vertex> & aScene,
+                                 math::hdr::Rgb_d aColor = math::hdr::gWhite<>)
+{
+    appendIndexedToScene(aInputObj, aScene, std::vector<math::hdr::Rgb_d>{aColor});
 }
 
 
@@ -10,6 +10,9 @@
 #include <math/Color.h>
 #include <math/Vector.h>
 
+#include <limits>
+#include <tuple>
+#include <type_traits>
 #include <utility>
 
 
@@ -113,14 +116,238 @@ void rasterizeLine(
 //
 // The rasterization only generate a fragment if the pixel center is inside the triangle
 // (or exactly on its edge).
+//
+// Varyings are interpolated through a per-triangle setup (InterpolationSetup), computing once
+// the window space plane equations of the attributes divided by w.
+// The planes are evaluated on demand at each fragment, rather than stepped along with the edge functions:
+// fragments failing the early depth test do not pay for the interpolation at all.
+
+
+namespace detail {
+
+
+    template <class T_member>
+    struct MemberType;
+
+    template <class T_class, class T_member>
+    struct MemberType<T_member T_class::*>
+    {
+        using type = T_member;
+    };
+
+
+    /// \brief Plane equation of an attribute divided by w, in window space.
+    template <class T_attribute>
+    struct AttributePlane
+    {
+        using Linear = LinearAttribute<T_attribute>;
+        using Scalar = typename AttributeScalar<Linear>::type;
+
+        Linear at(Scalar aDeltaX, Scalar aDeltaY) const
+        { return value + aDeltaX * dx + aDeltaY * dy; }
+
+        Linear value; // At the origin of the plane.
+        Linear dx;
+        Linear dy;
+    };
+
+
+    template <class T_attributes>
+    struct AttributePlanesOf;
+
+    template <class... T_members>
+    struct AttributePlanesOf<std::tuple<T_members...>>
+    {
+        using type = std::tuple<AttributePlane<typename MemberType<T_members>::type>...>;
+    };
+
+
+    /// \brief A tuple with the AttributePlane of each attribute in T_varyings::gAttributes.
+    template <class T_varyings>
+    using AttributePlanes =
+        typename AttributePlanesOf<std::remove_cv_t<decltype(T_varyings::gAttributes)>>::type;
+
+
+} // namespace detail
+
+
+/// \brief Per-triangle constants of the varyings interpolation (triangle setup).
+///
+/// Each attribute divided by w is an affine function of the window space position.
+/// Its plane equation (value at vertex a, derivatives along x and y) is computed once per triangle,
+/// so the perspective correct interpolation of a fragment is a plane evaluation per attribute,
+/// then a multiplication by w: a single reciprocal per fragment, whatever the number of attributes.
+template <class T_vertex>
+class InterpolationSetup
+{
+public:
+    using Varyings = typename T_vertex::varyings_type;
+
+    InterpolationSetup() = default;
+
+    /// \param aTriangle Window space triangle, which must outlive the setup.
+    explicit InterpolationSetup(const Triangle<T_vertex> & aTriangle);
+
+    const Triangle<T_vertex> & getTriangle() const
+    { return *mTriangle; }
+
+    /// \brief Perspective correct varyings at the pixel center aPosition, where 1/w is aDepthInverse.
+    Varyings interpolate(math::Position<2, int> aPosition, double aDepthInverse) const;
+
+private:
+    const Triangle<T_vertex> * mTriangle{nullptr};
+    detail::AttributePlanes<Varyings> mPlanes;
+};
+
+
+/// \brief Varyings of a fragment, which are only interpolated on demand.
+///
+/// This allows the fragment stage to test depth first, and to interpolate the varyings
+/// only for the fragments that are actually shaded (early depth test).
+template <class T_vertex>
+struct DeferredVaryings
+{
+    /// \brief Perspective correct interpolation of the varyings of the triangle at the fragment.
+    typename T_vertex::varyings_type interpolate() const
+    { return setup.interpolate(position, depthInverse); }
+
+    const InterpolationSetup<T_vertex> & setup;
+    math::Position<2, int> position;
+    double depthInverse;
+};
+
+
+/// \brief Interpolate depth of the triangle at the barycentric coordinates of aPosition,
+/// then invoke aFragmentCallback with the DeferredVaryings of the fragment.
+///
+/// Shared by all the triangle rasterizers, so they produce the same fragments for the same coverage.
+template <class T_vertex, class T_raster, class F_postRasterization>
+void emitFragment(const InterpolationSetup<T_vertex> & aSetup,
+                  T_raster & aRaster,
+                  const F_postRasterization & aFragmentCallback,
+                  math::Position<2, int> aPosition,
+                  double alpha, double beta, double gamma)
+{
+    const Triangle<T_vertex> & triangle = aSetup.getTriangle();
+    // Linearly interpolate depth and depth inverse in window space
+    double depthInverse =
+        alpha * triangle.a.depthInverse
+        + beta  * triangle.b.depthInverse
+        + gamma * triangle.c.depthInverse;
+    // TODO Understand why the depth is interpolated without perspective correction?
+    // Because it is perspective-correct to interpolate all quantities that are
+    // divided by w (the homogeneous coordinate), and z has been divided by w.
+    // see: FoCG 4th p257 bottom
+    auto z = alpha * triangle.a.pos.z()
+           + beta  * triangle.b.pos.z()
+           + gamma * triangle.c.pos.z();
+
+    aFragmentCallback(aRaster, aPosition, z, depthInverse,
+                      DeferredVaryings<T_vertex>{aSetup, aPosition, depthInverse});
+}
+
+
+template <class T_vertex>
+InterpolationSetup<T_vertex>::InterpolationSetup(const Triangle<T_vertex> & aTriangle) :
+    mTriangle{&aTriangle}
+{
+    // Perspective correct interpolation: attributes divided by w are linear in window space.
+    // see: https://stackoverflow.com/a/24460895/1027706
+    // see: https://www.scratchapixel.com/lessons/3d-basic-rendering/rasterization-practical-implementation/perspective-correct-interpolation-vertex-attributes
+    const T_vertex & a = aTriangle.a;
+    const T_vertex & b = aTriangle.b;
+    const T_vertex & c = aTriangle.c;
+    const double abX = b.pos.x() - a.pos.x();
+    const double abY = b.pos.y() - a.pos.y();
+    const double acX = c.pos.x() - a.pos.x();
+    const double acY = c.pos.y() - a.pos.y();
+    const double doubleArea = abX * acY - acX * abY;
+    // A degenerate triangle has constant attributes (it can only be covered after snapping its vertices).
+    const double inverseArea = doubleArea != 0. ? 1. / doubleArea : 0.;
+
+    auto setupPlane = [&](auto & aPlane, auto aMember)
+    {
+        using Plane = std::remove_reference_t<decltype(aPlane)>;
+        using Scalar = typename Plane::Scalar;
+        using Traits = AttributeTraits<typename detail::MemberType<decltype(aMember)>::type>;
+
+        const typename Plane::Linear valueA =
+            static_cast<Scalar>(a.depthInverse) * detail::toLinear(Traits::decode(a.varyings.*aMember));
+        const typename Plane::Linear deltaB =
+            static_cast<Scalar>(b.depthInverse) * detail::toLinear(Traits::decode(b.varyings.*aMember)) - valueA;
+        const typename Plane::Linear deltaC =
+            static_cast<Scalar>(c.depthInverse) * detail::toLinear(Traits::decode(c.varyings.*aMember)) - valueA;
+
+        aPlane.value = valueA;
+        aPlane.dx = static_cast<Scalar>(acY * inverseArea) * deltaB - static_cast<Scalar>(abY * inverseArea) * deltaC;
+        aPlane.dy = static_cast<Scalar>(abX * inverseArea) * deltaC - static_cast<Scalar>(acX * inverseArea) * deltaB;
+    };
+
+    std::apply([&](auto &... aPlanes)
+               {
+                   std::apply([&](auto... aMembers)
+                              {
+                                  (setupPlane(aPlanes, aMembers), ...);
+                              },
+                              Varyings::gAttributes);
+               },
+               mPlanes);
+}
+
+
+template <class T_vertex>
+typename InterpolationSetup<T_vertex>::Varyings
+InterpolationSetup<T_vertex>::interpolate(math::Position<2, int> aPosition, double aDepthInverse) const
+{
+    const double deltaX = aPosition.x() - mTriangle->a.pos.x();
+    const double deltaY = aPosition.y() - mTriangle->a.pos.y();
+    const double w = 1. / aDepthInverse;
+
+    Varyings result;
+    auto interpolatePlane = [&](const auto & aPlane, auto aMember)
+    {
+        using Plane = std::remove_cvref_t<decltype(aPlane)>;
+        using Scalar = typename Plane::Scalar;
+        using Attribute = typename detail::MemberType<decltype(aMember)>::type;
+
+        result.*aMember = AttributeTraits<Attribute>::encode(
+            detail::fromLinear<detail::DecodedAttribute<Attribute>>(
+                static_cast<Scalar>(w)
+                * aPlane.at(static_cast<Scalar>(deltaX), static_cast<Scalar>(deltaY))));
+    };
+
+    std::apply([&](const auto &... aPlanes)
+               {
+                   std::apply([&](auto... aMembers)
+                              {
+                                  (interpolatePlane(aPlanes, aMembers), ...);
+                              },
+                              Varyings::gAttributes);
+               },
+               mPlanes);
+    return result;
+}
+
+
+/// \brief Inclusive pixel bounds, outside of which no fragment is generated.
+struct Scissor
+{
+    int xMin{std::numeric_limits<int>::lowest()};
+    int yMin{std::numeric_limits<int>::lowest()};
+    int xMax{std::numeric_limits<int>::max()};
+    int yMax{std::numeric_limits<int>::max()};
+};
 
 
 /// \note aRaster is passed in because of legacy API of NaivePipeline,
 /// otherwise it makes more sense that the fragment callback knows the target.
+/// \note The incremental evaluation always starts from the triangle bounding box,
+/// so a fragment gets the exact same values whatever the scissor.
 template <class T_vertex, class T_raster, class F_postRasterization>
 void rasterizeIncremental(const Triangle<T_vertex> & aTriangle,
                           T_raster & aRaster,
-                          const F_postRasterization & aFragmentCallback)
+                          const F_postRasterization & aFragmentCallback,
+                          const Scissor & aScissor = {})
 {
     // Use to assign exactly tangent pixels on adjacent triangles (p 168)
     const HPos offscreenPoint{-1., -1., 0., 1.};
@@ -153,6 +380,8 @@ void rasterizeIncremental(const Triangle<T_vertex> & aTriangle,
         return;
     }
 
+    const InterpolationSetup<T_vertex> interpolation{aTriangle};
+
     const math::Vec<3> xIncrements{
         aTriangle.getLineA().getEquationFactorX(),
         aTriangle.getLineB().getEquationFactorX(),
@@ -167,15 +396,24 @@ void rasterizeIncremental(const Triangle<T_vertex> & aTriangle,
 
     math::Vec<3, double> numerators = previousNumerators;
 
+    const int xMax = std::min(static_cast<int>(std::nearbyint(aTriangle.xmax())), aScissor.xMax);
+    const int yMax = std::min(static_cast<int>(std::nearbyint(aTriangle.ymax())), aScissor.yMax);
+
     // Increments
     for (auto y = static_cast<int>(yMinRound);
-         y <= static_cast<int>(std::nearbyint(aTriangle.ymax()));
+         y <= yMax;
          ++y)
     {
         for (auto x = static_cast<int>(xMinRound);
-             x <= static_cast<int>(std::nearbyint(aTriangle.xmax()));
+             x <= xMax && y >= aScissor.yMin;
              ++x)
         {
+            if (x < aScissor.xMin)
+            {
+                numerators += xIncrements;
+                continue;
+            }
+
             math::Vec<3, double> barycentric = numerators.cwDiv(denominators);
 
             // No structured binding on vectors at the moment
@@ -189,37 +427,7 @@ void rasterizeIncremental(const Triangle<T_vertex> & aTriangle,
                     && beta  > 0 || denominators.y() * fb(offscreenPoint) > 0
                     && gamma > 0 || denominators.z() * fc(offscreenPoint) > 0)
                 {
-                    // Linearly interpolate depth and depth inverse in window space
-                    double depthInverse =
-                        alpha * aTriangle.a.depthInverse
-                        + beta  * aTriangle.b.depthInverse
-                        + gamma * aTriangle.c.depthInverse;
-                    // TODO Understand why the depth is interpolated without perspective correction?
-                    // Because it is perspective-correct to interpolate all quantities that are
-                    // divided by w (the homogeneous coordinate), and z has been divided by w.
-                    // see: FoCG 4th p257 bottom
-                    auto z = alpha * aTriangle.a.pos.z()
-                           + beta  * aTriangle.b.pos.z()
-                           + gamma * aTriangle.c.pos.z();
-
-                    // Perspective correct interpolation.
-                    // see: https://stackoverflow.com/a/24460895/1027706
-                    // see: https://www.scratchapixel.com/lessons/3d-basic-rendering/rasterization-practical-implementation/perspective-correct-interpolation-vertex-attributes
-                    math::Vec<3> perspectiveCoeff = math::Vec<3>{
-                        alpha * aTriangle.a.depthInverse,
-                        beta  * aTriangle.b.depthInverse,
-                        gamma * aTriangle.c.depthInverse
-                    }
-                    / depthInverse; // IMPORTANT: divided by depth inverse
-
-                    // Perspective corrected interpolation of varying attributes
-                    typename T_vertex::FragmentInterpolated interpolated = interpolateLinear({
-                        {perspectiveCoeff[0], aTriangle.a.frag},
-                        {perspectiveCoeff[1], aTriangle.b.frag},
-                        {perspectiveCoeff[2], aTriangle.c.frag},
-                    });
-
-                    aFragmentCallback(aRaster, {x, y}, z, depthInverse, interpolated);
+                    emitFragment(interpolation, aRaster, aFragmentCallback, {x, y}, alpha, beta, gamma);
                 }
             }
             numerators += xIncrements;
@@ -0,0 +1,151 @@
+#pragma once
+
+
+#include "FixedPointRasterization.h"
+#include "Rasterization.h"
+#include "Triangle.h"
+
+#include <algorithm>
+#include <array>
+#include <optional>
+
+#include <cmath>
+#include <cstdint>
+
+
+namespace ad {
+namespace focg {
+
+
+// Notes:
+// Scanline traversal of the fixed-point rasterization (see FixedPointRasterization.h).
+// The block traversal visits the whole bounding box of a triangle (rejecting blocks entirely outside),
+// which is wasteful for thin triangles: a long diagonal sliver covers a small fraction of its bounding box.
+//
+// Instead, each edge function is solved on each row for the first (or last) pixel center on its inner side,
+// which is exact in integer arithmetic. The intersection of the three half-rows is the span of covered pixels,
+// so only covered pixels are visited, and the coverage is exactly the one of rasterizeFixedPoint().
+// Edge values are then stepped along the span, giving the same barycentric coordinates as the blocks.
+//
+// The span setup (three divisions per row) is not worth it for triangles filling most of their bounding box:
+// the pipeline only selects it under a bounding box fill ratio (see getFillRatio()).
+
+
+/// \brief Ratio of the area of aTriangle to the number of pixels in its bounding box, in [0, 0.5].
+template <class T_vertex>
+double getFillRatio(const Triangle<T_vertex> & aTriangle);
+
+
+/// \brief Rasterize aTriangle with its vertices snapped to the subpixel grid, row by row,
+/// only visiting the covered span of each row.
+///
+/// Produces the exact same fragments as rasterizeFixedPoint(), in a different order.
+template <class T_vertex, class T_raster, class F_postRasterization>
+void rasterizeScanline(const Triangle<T_vertex> & aTriangle,
+                       T_raster & aRaster,
+                       const F_postRasterization & aFragmentCallback,
+                       const Scissor & aScissor = {});
+
+
+//
+// Implementations
+//
+namespace detail {
+
+
+    /// \brief Largest integer lower or equal to aNumerator / aDenominator, with aDenominator > 0.
+    inline std::int64_t floorDivide(std::int64_t aNumerator, std::int64_t aDenominator)
+    {
+        const std::int64_t quotient = aNumerator / aDenominator;
+        return (aNumerator % aDenominator < 0) ? quotient - 1 : quotient;
+    }
+
+
+    /// \brief Restrict [aFirst, aLast] to the pixels of row aY on the inner side of aEdge.
+    inline void clipSpan(const FixedEdgeFunction & aEdge, int aY, std::int64_t & aFirst, std::int64_t & aLast)
+    {
+        // Inner side: stepX * x >= remainder
+        const std::int64_t remainder = aEdge.threshold - aEdge.stepY * aY - aEdge.c;
+        if (aEdge.stepX > 0)
+        {
+            // Smallest x such that stepX * x >= remainder.
+            aFirst = std::max(aFirst, -floorDivide(-remainder, aEdge.stepX));
+        }
+        else if (aEdge.stepX < 0)
+        {
+            // Largest x such that -stepX * x <= -remainder.
+            aLast = std::min(aLast, floorDivide(-remainder, -aEdge.stepX));
+        }
+        else if (remainder > 0)
+        {
+            // Horizontal edge, with the row on its outer side.
+            aLast = aFirst - 1;
+        }
+    }
+
+
+} // namespace detail
+
+
+template <class T_vertex>
+double getFillRatio(const Triangle<T_vertex> & aTriangle)
+{
+    const double doubleArea = std::abs(
+        (aTriangle.b.pos.x() - aTriangle.a.pos.x()) * (aTriangle.c.pos.y() - aTriangle.a.pos.y())
+        - (aTriangle.c.pos.x() - aTriangle.a.pos.x()) * (aTriangle.b.pos.y() - aTriangle.a.pos.y()));
+    // Pixel centers in the bounding box, which is never empty.
+    const double boxPixels = (aTriangle.xmax() - aTriangle.xmin() + 1.) * (aTriangle.ymax() - aTriangle.ymin() + 1.);
+    return doubleArea / 2. / boxPixels;
+}
+
+
+template <class T_vertex, class T_raster, class F_postRasterization>
+void rasterizeScanline(const Triangle<T_vertex> & aTriangle,
+                       T_raster & aRaster,
+                       const F_postRasterization & aFragmentCallback,
+                       const Scissor & aScissor)
+{
+    const std::optional<FixedPointSetup> setup = FixedPointSetup::Make(aTriangle, aScissor);
+    if (!setup)
+    {
+        return;
+    }
+    const InterpolationSetup<T_vertex> interpolation{aTriangle};
+
+    for (int y = setup->yMin; y <= setup->yMax; ++y)
+    {
+        std::int64_t first = setup->xMin;
+        std::int64_t last = setup->xMax;
+        for (const FixedEdgeFunction & edge : setup->edges)
+        {
+            detail::clipSpan(edge, y, first, last);
+        }
+        if (first > last)
+        {
+            continue;
+        }
+
+        const int xFirst = static_cast<int>(first);
+        std::array<std::int64_t, 3> edgeValues{
+            setup->edges[0](xFirst, y),
+            setup->edges[1](xFirst, y),
+            setup->edges[2](xFirst, y),
+        };
+        for (int x = xFirst; x <= static_cast<int>(last); ++x)
+        {
+            emitFragment(interpolation, aRaster, aFragmentCallback,
+                         {x, y},
+                         static_cast<double>(edgeValues[0]) / setup->denominators[0],
+                         static_cast<double>(edgeValues[1]) / setup->denominators[1],
+                         static_cast<double>(edgeValues[2]) / setup->denominators[2]);
+            for (std::size_t edge = 0; edge != 3; ++edge)
+            {
+                edgeValues[edge] += setup->edges[edge].stepX;
+            }
+        }
+    }
+}
+
+
+} // namespace focg
+} // namespace ad
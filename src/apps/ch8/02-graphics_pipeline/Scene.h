@@ -8,15 +8,53 @@
 
 #include <arte/Image.h>
 
+#include <math/Box.h>
 #include <math/Vector.h>
 
+#include <algorithm>
+#include <limits>
 #include <vector>
 
+#include <cstdint>
+
 
 namespace ad {
 namespace focg {
 
 
+/// \brief Vertex buffer and index buffer, each consecutive triplet of indices forming a triangle.
+///
+/// Vertices shared by several triangles are stored (and processed by the vertex stage) only once.
+///
+/// Clusters are the consecutive runs of gClusterSize triangles (the last one might be shorter).
+/// Their object space bounding boxes, as well as the whole mesh bounding box, allow the pipeline
+/// to cull the parts of the mesh outside of the view frustum before any vertex processing.
+template <class T_vertex>
+struct IndexedMesh
+{
+    static constexpr std::size_t gClusterSize = 256;
+
+    std::size_t getTriangleCount() const
+    { return indices.size() / 3; }
+
+    std::size_t getClusterCount() const
+    { return (getTriangleCount() + gClusterSize - 1) / gClusterSize; }
+
+    /// \brief Compute bounds and clusterBounds, must be called again each time the geometry changes.
+    void computeBounds();
+
+    /// \brief Bounds are only used if they match the geometry (see computeBounds()).
+    bool hasBounds() const
+    { return clusterBounds.size() == getClusterCount(); }
+
+    std::vector<T_vertex> vertices;
+    std::vector<std::uint32_t> indices;
+
+    math::Box<double> bounds{math::Position<3>{0., 0., 0.}, math::Size<3>{0., 0., 0.}};
+    std::vector<math::Box<double>> clusterBounds;
+};
+
+
 template <class T_vertex>
 struct Scene
 {
@@ -24,8 +62,74 @@ struct Scene
 
     std::vector<Line> lines;
     std::vector<Triangle<T_vertex>> triangles;
+    std::vector<IndexedMesh<T_vertex>> meshes;
 };
 
 
+//
+// Implementations
+//
+namespace detail {
+
+
+    class BoundsAccumulator
+    {
+    public:
+        /// \brief Accumulate the first 3 coordinates of aPosition (whatever its dimension and precision).
+        template <class T_position>
+        void add(const T_position & aPosition)
+        {
+            for (std::size_t axis = 0; axis != 3; ++axis)
+            {
+                mMin[axis] = std::min(mMin[axis], static_cast<double>(aPosition[axis]));
+                mMax[axis] = std::max(mMax[axis], static_cast<double>(aPosition[axis]));
+            }
+        }
+
+        math::Box<double> getBox() const
+        {
+            return math::Box<double>{
+                mMin,
+                math::Size<3>{mMax.x() - mMin.x(), mMax.y() - mMin.y(), mMax.z() - mMin.z()},
+            };
+        }
+
+    private:
+        math::Position<3> mMin{
+            std::numeric_limits<double>::max(),
+            std::numeric_limits<double>::max(),
+            std::numeric_limits<double>::max(),
+        };
+        math::Position<3> mMax{
+            std::numeric_limits<double>::lowest(),
+            std::numeric_limits<double>::lowest(),
+            std::numeric_limits<double>::lowest(),
+        };
+    };
+
+
+} // namespace detail
+
+
+template <class T_vertex>
+void IndexedMesh<T_vertex>::computeBounds()
+{
+    detail::BoundsAccumulator meshBounds;
+    clusterBounds.clear();
+    for (std::size_t cluster = 0; cluster != getClusterCount(); ++cluster)
+    {
+        detail::BoundsAccumulator bounds;
+        const std::size_t end = std::min(indices.size(), (cluster + 1) * gClusterSize * 3);
+        for (std::size_t index = cluster * gClusterSize * 3; index != end; ++index)
+        {
+            bounds.add(vertices[indices[index]].pos);
+            meshBounds.add(vertices[indices[index]].pos);
+        }
+        clusterBounds.push_back(bounds.getBox());
+    }
+    bounds = meshBounds.getBox();
+}
+
+
 } // namespace focg
 } // namespace ad
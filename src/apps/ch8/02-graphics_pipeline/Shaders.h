@@ -3,34 +3,65 @@
 
 #include "GraphicsPipeline.h"
 
-#include <functional>
+#include <optional>
+#include <tuple>
 
 
 namespace ad {
 namespace focg {
 
 
-using namespace std::placeholders;  // for _1, _2, _3...
-
-
+/// \brief Realizes the ShaderProgram, BakeableProgram and ProjectingProgram concepts.
 struct TransformAndLighting
 {
-    // TODO When the FragmentInterpolated is takend out of Vertex, it should return it by value
-    // (not taking it as out param)
-    HPos vertexImpl(focg::Vertex & aVertex, Vertex::FragmentInterpolated & aOut) const
+    /// \brief Attributes interpolated from the vertex shader to the fragment shader, in single precision.
+    struct Varyings
+    {
+        math::hdr::Rgb_f color;
+        math::Position<3, float> position_c;
+        math::Vec<3, float> normal_c;
+        math::Position<2, float> uv;
+
+        static constexpr auto gAttributes =
+            std::tuple{&Varyings::color, &Varyings::position_c, &Varyings::normal_c, &Varyings::uv};
+    };
+
+    ShadedVertex<Varyings> vertex(const focg::Vertex & aVertex) const
     {
-        aOut.color = aVertex.color;
-        aOut.position_c = aVertex.pos * localToCamera;
-        aOut.normal_c = aVertex.normal * localToCamera;
-        aOut.uv = aVertex.uv;
-        return aVertex.pos * (localToCamera * projection);
+        const HPos position{aVertex.pos.x(), aVertex.pos.y(), aVertex.pos.z(), 1.};
+        const math::Vec<3, float> normal = aVertex.normal.unpack();
+        const HPos position_c = position * localToCamera;
+        const HVec normal_c = HVec{normal.x(), normal.y(), normal.z(), 0.} * localToCamera;
+        return {
+            .pos = position * getLocalToClip(),
+            .varyings = {
+                .color = AttributeTraits<math::sdr::Rgb>::decode(aVertex.color),
+                .position_c = {
+                    static_cast<float>(position_c.x()),
+                    static_cast<float>(position_c.y()),
+                    static_cast<float>(position_c.z()),
+                },
+                .normal_c = {
+                    static_cast<float>(normal_c.x()),
+                    static_cast<float>(normal_c.y()),
+                    static_cast<float>(normal_c.z()),
+                },
+                .uv = aVertex.uv,
+            },
+        };
     }
 
-    math::sdr::Rgb fragmentImpl(const math::Position<4> & aFragCoord, const Vertex::FragmentInterpolated & aIn)
+    math::sdr::Rgb fragment(const math::Position<4> &, const Varyings & aIn) const
     {
+        // Lighting is computed in double precision.
+        const math::Position<4> position_c{aIn.position_c.x(), aIn.position_c.y(), aIn.position_c.z(), 1.};
+        const math::Vec<4> normal_c = math::Vec<4>{aIn.normal_c.x(), aIn.normal_c.y(), aIn.normal_c.z(), 0.}
+                                      .normalize();
+        const math::hdr::Rgb_d color{aIn.color.r(), aIn.color.g(), aIn.color.b()};
+
         constexpr math::Position<4> cameraPos_c{0., 0., 1., 1.};
-        math::Vec<4> viewDirection = (cameraPos_c - aIn.position_c).normalize();
-        math::Vec<4> lightDirection = (lightPosition_c - aIn.position_c).normalize();
+        math::Vec<4> viewDirection = (cameraPos_c - position_c).normalize();
+        math::Vec<4> lightDirection = (lightPosition_c - position_c).normalize();
         math::Vec<4> halfVector = (viewDirection + lightDirection).normalize();
 
         // Texturing
@@ -42,9 +73,9 @@ struct TransformAndLighting
         }
 
         return to_sdr(
-            aIn.color.cwMul(
-                lightDiffuseColor * std::max(0., aIn.normal_c.dot(lightDirection))
-                + lightSpecularColor * std::pow(std::max(0., aIn.normal_c.dot(halfVector)),
+            color.cwMul(
+                lightDiffuseColor * std::max(0., normal_c.dot(lightDirection))
+                + lightSpecularColor * std::pow(std::max(0., normal_c.dot(halfVector)),
                                                 phongExponent)
                 + lightAmbiantColor
             )
@@ -60,10 +91,26 @@ struct TransformAndLighting
     math::hdr::Rgb_d lightAmbiantColor = math::hdr::gCyan<> * 0.25;
     double phongExponent = 14;
 
-    std::function<HPos(focg::Vertex &, Vertex::FragmentInterpolated &)> vertex = 
-        std::bind(&TransformAndLighting::vertexImpl, this, _1, _2);
-    std::function<math::sdr::Rgb(const math::Position<4> &, const Vertex::FragmentInterpolated &)>fragment =
-        std::bind(&TransformAndLighting::fragmentImpl, this, _1, _2);
+    /// \brief Copy of this program with its derived uniforms computed, invoked once per draw by the pipeline.
+    TransformAndLighting bake() const
+    {
+        TransformAndLighting baked{*this};
+        baked.localToClip = localToCamera * projection;
+        return baked;
+    }
+
+    /// \brief The transformation applied to positions by vertex(), used for frustum culling.
+    ///
+    /// On a program that was not baked, it is computed from localToCamera and projection on each call.
+    /// \note A baked program does not see later changes to localToCamera or projection, bake it again.
+    math::Matrix<4, 4> getLocalToClip() const
+    {
+        return localToClip ? *localToClip : localToCamera * projection;
+    }
+
+private:
+    // Derived uniforms (see bake())
+    std::optional<math::Matrix<4, 4>> localToClip;
 };
 
 
@@ -6,8 +6,17 @@
 #include "Scene.h"
 #include "Shaders.h"
 
+#include <focg-common/AsyncOutput.h>
+#include <focg-common/ImageStream.h>
+
 #include <graphics/CameraUtilities.h>
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <ostream>
 #include <sstream>
 
 
@@ -29,6 +38,12 @@ struct Timeline
         return currentFrame >= frameCount;
     }
 
+    /// \brief Time of aFrame, without accumulating the deltas.
+    double getTime(int aFrame) const
+    {
+        return aFrame * delta;
+    }
+
     const double delta; // period in seconds
     const int frameCount;
 
@@ -37,25 +52,23 @@ struct Timeline
 };
 
 
+/// \brief The animation is a pure function of time: the scenes are never mutated,
+/// so any number of frames can be computed concurrently.
 struct AnimatedScene
 {
-    void update(const Timeline & aTimeline)
+    /// \brief Transform of the scene aPosedScene at aTime (in seconds), from its rest pose.
+    math::AffineMatrix<4> getLocalToWorld(std::size_t aPosedScene, double aTime) const
     {
-        constexpr double rotationsPerSecond = 0.25;
-        for (auto & [scene, transform] : posedScenes)
-        {
-
-            transform *= math::trans3d::rotateY(math::Radian<double>{
-                rotationsPerSecond * 2 * math::pi<double> * aTimeline.delta});
-        }
+        return posedScenes[aPosedScene].second
+               * math::trans3d::rotateY(math::Radian<double>{gRotationsPerSecond * 2 * math::pi<double> * aTime});
     }
 
-    math::AffineMatrix<4> camera()
+    math::AffineMatrix<4> camera() const
     {
         return graphics::getCameraTransform(cameraPosition, looksAt - cameraPosition);
     }
 
-    math::Matrix<4, 4> projection(double aViewportRatio)
+    math::Matrix<4, 4> projection(double aViewportRatio) const
     {
         math::Box<double> projected = math::Box<double>::CenterOnOrigin({
             math::makeSizeFromHeight<double>(shownHeight, aViewportRatio), nearPlaneZ - farPlaneZ});
@@ -65,6 +78,7 @@ struct AnimatedScene
                * math::trans3d::orthographicProjection(projected);
     }
 
+    // Each scene with its rest pose.
     std::vector<std::pair<Scene<Vertex>, math::AffineMatrix<4>>> posedScenes;
 
     math::Position<3> cameraPosition{0., 0., 100.};
@@ -74,78 +88,303 @@ struct AnimatedScene
 
     double nearPlaneZ = -20.;
     double farPlaneZ  = -1000.; 
+
+    static constexpr double gRotationsPerSecond = 0.25;
 };
 
 
 struct ShadingRenderer
 {
+    /// \brief Receives each frame index with the rendered frame.
+    ///
+    /// It is invoked on a single background thread, in frame order (so it can write to a stream).
+    using FrameWriter = std::function<void(int aFrame, ImageBuffer<> & aTarget)>;
+
     ShadingRenderer(math::Size<2, int> aResolution, math::sdr::Rgb aBackgroundColor);
 
-    void render(AnimatedScene & aAnimation,
+    /// \brief Render each remaining frame of aTimeline, and pass it to aWriter.
+    ///
+    /// With frameThreadCount above 1, distinct frames are rendered concurrently,
+    /// each with its own target and uniforms, using a serial pipeline.
+    /// Each frame is queued as soon as it (and the frames before it) is rendered, then written
+    /// on a background thread, while the next frames are rendered in the other frame buffers.
+    /// The frameBufferCount buffers are shared by all frame threads: they bound the memory,
+    /// and the number of frames rendered concurrently.
+    void render(const AnimatedScene & aAnimation,
+                Timeline & aTimeline,
+                const FrameWriter & aWriter);
+
+    /// \brief Render and save each remaining frame of aTimeline as a PPM file in aFolder.
+    void render(const AnimatedScene & aAnimation,
                 Timeline & aTimeline,
                 const filesystem::path & aFolder,
-                const std::string & aFileprefix) ;
+                const std::string & aFileprefix);
+
+    /// \brief Render each remaining frame of aTimeline, written to aStream.
+    void render(const AnimatedScene & aAnimation,
+                Timeline & aTimeline,
+                VideoStreamWriter & aStream);
+
+    /// \brief Render aAnimation at aTime in the render target.
+    /// \return The render target, with its clears resolved.
+    ImageBuffer<> & renderFrame(const AnimatedScene & aAnimation, double aTime);
+
+    /// \brief Render aAnimation at aTime in aTarget with aPipeline, resolving its clears.
+    ///
+    /// The uniforms are set on a copy of program, so frames can be rendered concurrently.
+    void renderFrame(const AnimatedScene & aAnimation, double aTime,
+                     const GraphicsPipeline & aPipeline, ImageBuffer<> & aTarget) const;
 
     GraphicsPipeline pipeline;
     ImageBuffer<> renderTarget;
     TransformAndLighting program;
+
+    // Frames in flight in render() (rendered, queued, or being written), at least 2:
+    // 2 for double buffering, 3 for triple buffering...
+    std::size_t frameBufferCount{2};
+    // What render() does when all frame buffers are waiting to be written.
+    Backpressure backpressure{Backpressure::Block};
+    // Above 1, render() renders distinct frames concurrently (instead of parallelizing each frame).
+    unsigned int frameThreadCount{1};
 };
 
 
 ShadingRenderer::ShadingRenderer(math::Size<2, int> aResolution, math::sdr::Rgb aBackgroundColor) :
     renderTarget{aResolution, aBackgroundColor}
-{}
+{
+    pipeline.threadCount = getDefaultThreadCount();
+    // Within each draw (posed scene), the lighting is shaded once per visible pixel, whatever its depth complexity.
+    // Overdraw between the posed scenes, which are distinct draws, is still shaded.
+    pipeline.shading = GraphicsPipeline::Shading::Deferred;
+}
+
+
+namespace detail {
+
+
+    inline filesystem::path getFramePath(const filesystem::path & aFolder,
+                                         const std::string & aFileprefix,
+                                         int aFrame)
+    {
+        return aFolder / (aFileprefix + "-" + std::to_string(aFrame) + ".ppm");
+    }
+
 
+} // namespace detail
 
-void ShadingRenderer::render(AnimatedScene & aAnimation,
+
+void ShadingRenderer::render(const AnimatedScene & aAnimation,
                              Timeline & aTimeline,
-                             const filesystem::path & aFolder,
-                             const std::string & aFileprefix) 
+                             const FrameWriter & aWriter)
 {
-    for(; !aTimeline.done(); aTimeline.next())
+    const unsigned int workerCount = std::max(1u, frameThreadCount);
+
+    // Concurrent frames already provide all the parallelism.
+    GraphicsPipeline framePipeline = pipeline;
+    if (workerCount > 1)
     {
-        // Update animation based on time
-        aAnimation.update(aTimeline);
-        renderTarget.clear();
+        framePipeline.threadCount = 1;
+    }
 
-        for (const auto & [scene, localToWorld] : aAnimation.posedScenes)
+    AsyncFrameOutput<ImageBuffer<>> output{
+        std::vector<ImageBuffer<>>(std::max<std::size_t>(2, frameBufferCount),
+                                   ImageBuffer<>{renderTarget.getResolution(), renderTarget.clearColor}),
+        backpressure};
+
+    // Buffers are acquired in frame order, so the earliest frame not yet submitted always holds one:
+    // the frames waiting for their turn to be submitted cannot starve it.
+    std::mutex acquisitionMutex;
+    // Frames are submitted in order, for the writer to receive them in sequence.
+    std::mutex submissionMutex;
+    std::condition_variable submitted;
+    int nextSubmission = aTimeline.currentFrame;
+    // Only set with submissionMutex locked, but also read when acquiring, to stop early.
+    std::atomic<bool> failed{false};
+
+    parallelFor(workerCount, [&](std::size_t)
+    {
+        for (;;)
         {
-            program.localToCamera = localToWorld * aAnimation.camera();
-            program.projection = aAnimation.projection(math::getRatio<double>(renderTarget.getResolution()));
-            pipeline.traverse(scene, renderTarget, program, aAnimation.nearPlaneZ, aAnimation.farPlaneZ)
-                .color.saveFile(aFolder / (aFileprefix + "-" + std::to_string(aTimeline.currentFrame) + ".ppm"),
-                                arte::ImageOrientation::InvertVerticalAxis);
+            int frame;
+            ImageBuffer<> * target;
+            {
+                std::scoped_lock lock{acquisitionMutex};
+                if (aTimeline.done() || failed)
+                {
+                    return;
+                }
+                // Rethrows the exception of a failed writer.
+                target = &output.acquire();
+                frame = aTimeline.currentFrame;
+                aTimeline.next();
+            }
+
+            bool discarded = false;
+            try
+            {
+                renderFrame(aAnimation, aTimeline.getTime(frame), framePipeline, *target);
+            }
+            catch (...)
+            {
+                // Return the buffer, and release the frames waiting for their turn.
+                output.submit(*target, [](ImageBuffer<> &){});
+                {
+                    std::scoped_lock lock{submissionMutex};
+                    failed = true;
+                }
+                submitted.notify_all();
+                throw;
+            }
+
+            {
+                std::unique_lock lock{submissionMutex};
+                submitted.wait(lock, [&](){ return nextSubmission == frame || failed; });
+                if (failed)
+                {
+                    discarded = true;
+                }
+                else
+                {
+                    output.submit(*target, [&aWriter, frame](ImageBuffer<> & aTarget)
+                                           {
+                                               aWriter(frame, aTarget);
+                                           });
+                    ++nextSubmission;
+                }
+            }
+            submitted.notify_all();
+
+            if (discarded)
+            {
+                output.submit(*target, [](ImageBuffer<> &){});
+                return;
+            }
         }
-    }
+    },
+    workerCount);
+
+    output.finish();
 }
 
 
-void renderDemoScene(const filesystem::path & aFolder,
-                     const std::string & aObj = focg::gCubeObj,
-                     double aModelSize = 100,
-                     math::Vec<3> aTranslation = {-0.5, -0.5, -0.5},
-                     math::Size<2, int> aResolution = {640, 640},
-                     double aFps = 5.,
-                     double aDuration = 4)
+void ShadingRenderer::render(const AnimatedScene & aAnimation,
+                             Timeline & aTimeline,
+                             const filesystem::path & aFolder,
+                             const std::string & aFileprefix)
+{
+    render(aAnimation, aTimeline, [&](int aFrame, ImageBuffer<> & aTarget)
+    {
+        aTarget.color.saveFile(detail::getFramePath(aFolder, aFileprefix, aFrame),
+                               arte::ImageOrientation::InvertVerticalAxis);
+    });
+}
+
+
+void ShadingRenderer::render(const AnimatedScene & aAnimation,
+                             Timeline & aTimeline,
+                             VideoStreamWriter & aStream)
+{
+    render(aAnimation, aTimeline, [&](int, ImageBuffer<> & aTarget)
+    {
+        aStream.writeFrame(aTarget.color, arte::ImageOrientation::InvertVerticalAxis);
+    });
+}
+
+
+ImageBuffer<> & ShadingRenderer::renderFrame(const AnimatedScene & aAnimation, double aTime)
+{
+    renderFrame(aAnimation, aTime, pipeline, renderTarget);
+    return renderTarget;
+}
+
+
+void ShadingRenderer::renderFrame(const AnimatedScene & aAnimation, double aTime,
+                                  const GraphicsPipeline & aPipeline, ImageBuffer<> & aTarget) const
 {
-    AnimatedScene animation;
+    TransformAndLighting frameProgram = program;
+    aTarget.clear();
+    for (std::size_t posedScene = 0; posedScene != aAnimation.posedScenes.size(); ++posedScene)
     {
+        frameProgram.localToCamera = aAnimation.getLocalToWorld(posedScene, aTime) * aAnimation.camera();
+        frameProgram.projection = aAnimation.projection(math::getRatio<double>(aTarget.getResolution()));
+        aPipeline.traverse(aAnimation.posedScenes[posedScene].first, aTarget, frameProgram,
+                           aAnimation.nearPlaneZ, aAnimation.farPlaneZ);
+    }
+    // Tiles not covered by the scene are only written here.
+    aTarget.resolveClears();
+}
+
+
+namespace detail {
+
+
+    inline AnimatedScene makeDemoAnimation(const std::string & aObj,
+                                           double aModelSize,
+                                           math::Vec<3> aTranslation)
+    {
+        AnimatedScene animation;
         focg::Scene<Vertex> scene;
         std::istringstream input{aObj};
-        appendToScene(input, scene, math::hdr::gCyan<>);
+        appendIndexedToScene(input, scene, math::hdr::gCyan<>);
 
         math::AffineMatrix<4> modelling = 
             math::trans3d::translate(aTranslation)
             * math::trans3d::scale(aModelSize, aModelSize, aModelSize);
 
         animation.posedScenes.emplace_back(scene, modelling);
+        return animation;
+    }
+
+
+    inline ShadingRenderer makeDemoRenderer(math::Size<2, int> aResolution)
+    {
+        ShadingRenderer renderer{aResolution, math::sdr::gBlack};
+        // Frames are independent, rendering them concurrently scales better than parallelizing each frame.
+        renderer.frameThreadCount = getDefaultThreadCount();
+        // A buffer per frame thread, plus one being written, within a memory budget.
+        constexpr std::size_t gFrameBufferBudget = std::size_t{256} << 20; // bytes
+        const std::size_t bufferSize =
+            (std::size_t)aResolution.area() * (sizeof(math::sdr::Rgb) + sizeof(ImageBuffer<>::depth_type));
+        renderer.frameBufferCount = std::clamp<std::size_t>(renderer.frameThreadCount + 1,
+                                                            2,
+                                                            std::max<std::size_t>(2, gFrameBufferBudget / bufferSize));
+        //renderer.pipeline.renderMode = focg::NaivePipeline::Wireframe;
+        return renderer;
     }
 
+
+} // namespace detail
+
+
+void renderDemoScene(const filesystem::path & aFolder,
+                     const std::string & aObj = focg::gCubeObj,
+                     double aModelSize = 100,
+                     math::Vec<3> aTranslation = {-0.5, -0.5, -0.5},
+                     math::Size<2, int> aResolution = {640, 640},
+                     double aFps = 5.,
+                     double aDuration = 4)
+{
+    AnimatedScene animation = detail::makeDemoAnimation(aObj, aModelSize, aTranslation);
     Timeline timeline{1.0 / aFps, (int)(aDuration * aFps)};
+    detail::makeDemoRenderer(aResolution).render(animation,  timeline, aFolder, "demoscene");
+}
+
 
-    ShadingRenderer renderer{aResolution, math::sdr::gBlack};
-    //renderer.pipeline.renderMode = focg::NaivePipeline::Wireframe;
-    renderer.render(animation,  timeline, aFolder, "demoscene");
+/// \brief Render the demo scene as a single video stream to aOut, e.g. stdout piped to an encoder.
+void streamDemoScene(std::ostream & aOut,
+                     VideoFormat aFormat,
+                     const std::string & aObj = focg::gCubeObj,
+                     double aModelSize = 100,
+                     math::Vec<3> aTranslation = {-0.5, -0.5, -0.5},
+                     math::Size<2, int> aResolution = {640, 640},
+                     double aFps = 5.,
+                     double aDuration = 4)
+{
+    AnimatedScene animation = detail::makeDemoAnimation(aObj, aModelSize, aTranslation);
+    Timeline timeline{1.0 / aFps, (int)(aDuration * aFps)};
+    VideoStreamWriter stream{aOut, aResolution, aFps, aFormat};
+    detail::makeDemoRenderer(aResolution).render(animation,  timeline, stream);
+    aOut.flush();
 }
 
 
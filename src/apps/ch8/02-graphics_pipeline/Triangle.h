@@ -2,12 +2,16 @@
 
 
 #include "Line.h"
+#include "VertexFormats.h"
 
 #include <math/Color.h>
 #include <math/Rectangle.h>
 #include <math/Vector.h>
 
+#include <initializer_list>
 #include <string>
+#include <tuple>
+#include <type_traits>
 
 #include <cassert>
 
@@ -21,8 +25,26 @@ using TextureCoordinates = math::Position<2>;
 using Rectangle = math::Rectangle<double>;
 
 
+/// \brief The default vertex input format, read by the vertex shader (28 bytes).
+///
+/// Positions and texture coordinates are single precision, the normal is packed and the color is 8 bits.
 struct Vertex
 {
+    math::Position<3, float> pos{0.f, 0.f, 0.f};
+    PackedNormal normal; // must have defaults, when creating the vertex set in the obj loader
+    math::Position<2, float> uv{0.f, 0.f}; // must have defaults, when creating the vertex set in the obj loader
+    math::sdr::Rgb color{255, 0, 0};
+};
+
+
+/// \brief Output of the vertex shader: the clip space position and the varyings to interpolate.
+///
+/// This is the vertex traversing clipping and rasterization.
+template <VaryingAttributes T_varyings>
+struct ShadedVertex
+{
+    using varyings_type = T_varyings;
+
     /*implicit*/ operator HPos & ()
     {
         return pos;
@@ -47,22 +69,8 @@ struct Vertex
     }
 
     HPos pos;
-    math::hdr::Rgb_d color = math::hdr::gRed<>;
+    T_varyings varyings{};
     double depthInverse = 0.;
-    HVec normal{0., 0., 0., 0.}; // must have defaults, when creating the vertex set in the obj loader
-    TextureCoordinates uv{0., 0.}; // must have defaults, when creating the vertex set in the obj loader
-
-    // TODO Ideally, this should not be hosted within the vertex
-    // Then, it does not neet to be default constructible
-    struct FragmentInterpolated
-    {
-        math::hdr::Rgb_d color = math::hdr::gRed<>;
-        HPos position_c{0., 0., 0., 1.};
-        HVec normal_c{0., 0., 0., 0.};
-        TextureCoordinates uv{0., 0.};
-    };
-
-    FragmentInterpolated frag;
 };
 
 
@@ -103,14 +111,98 @@ interpolateLinear(std::initializer_list<Interpolant<T_value>> aInterpolants, T_a
 }
 
 
-Vertex::FragmentInterpolated interpolateLinear(std::initializer_list<Interpolant<Vertex::FragmentInterpolated>> aInterpolants)
-{
-    return {
-        interpolateLinear(aInterpolants, [](const Vertex::FragmentInterpolated & frag){return frag.color;}),
-        interpolateLinear(aInterpolants, [](const Vertex::FragmentInterpolated & frag){return frag.position_c;}),
-        interpolateLinear(aInterpolants, [](const Vertex::FragmentInterpolated & frag){return frag.normal_c;}).normalize(),
-        interpolateLinear(aInterpolants, [](const Vertex::FragmentInterpolated & frag){return frag.uv;}),
+namespace detail {
+
+
+    /// \brief The scalar type weighting a decoded attribute.
+    template <class T_decoded>
+    struct AttributeScalar
+    {
+        using type = typename T_decoded::value_type;
     };
+
+    template <class T_decoded>
+    requires std::is_arithmetic_v<T_decoded>
+    struct AttributeScalar<T_decoded>
+    {
+        using type = T_decoded;
+    };
+
+
+    template <class T_attribute>
+    using DecodedAttribute =
+        std::remove_cvref_t<decltype(AttributeTraits<T_attribute>::decode(std::declval<const T_attribute &>()))>;
+
+
+    /// \brief Positions cannot be summed nor scaled, so they are interpolated as vectors.
+    template <class T_decoded>
+    decltype(auto) toLinear(const T_decoded & aValue)
+    {
+        if constexpr(math::is_position_v<T_decoded>)
+        {
+            return aValue.template as<math::Vec>();
+        }
+        else
+        {
+            return (aValue);
+        }
+    }
+
+
+    template <class T_decoded, class T_linear>
+    T_decoded fromLinear(const T_linear & aValue)
+    {
+        if constexpr(math::is_position_v<T_decoded>)
+        {
+            return aValue.template as<math::Position>();
+        }
+        else
+        {
+            return aValue;
+        }
+    }
+
+
+    /// \brief The type in which an attribute is interpolated.
+    template <class T_attribute>
+    using LinearAttribute =
+        std::remove_cvref_t<decltype(toLinear(std::declval<const DecodedAttribute<T_attribute> &>()))>;
+
+
+    template <class T_varyings, class T_attribute>
+    T_attribute interpolateAttribute(std::initializer_list<Interpolant<const T_varyings &>> aInterpolants,
+                                     T_attribute T_varyings::* aMember)
+    {
+        using Traits = AttributeTraits<T_attribute>;
+        using Scalar = typename AttributeScalar<LinearAttribute<T_attribute>>::type;
+
+        assert(aInterpolants.size() > 0);
+        auto it = aInterpolants.begin();
+        LinearAttribute<T_attribute> accum =
+            static_cast<Scalar>(it->weight) * toLinear(Traits::decode(it->value.*aMember));
+        for (++it; it != aInterpolants.end(); ++it)
+        {
+            accum += static_cast<Scalar>(it->weight) * toLinear(Traits::decode(it->value.*aMember));
+        }
+        return Traits::encode(fromLinear<DecodedAttribute<T_attribute>>(accum));
+    }
+
+
+} // namespace detail
+
+
+/// \brief Weighted sum of each attribute listed in T_varyings::gAttributes.
+/// \note The interpolants reference the varyings, so they are not copied.
+template <VaryingAttributes T_varyings>
+T_varyings interpolateAttributes(std::initializer_list<Interpolant<const T_varyings &>> aInterpolants)
+{
+    T_varyings result;
+    std::apply([&](auto... aMembers)
+               {
+                   ((result.*aMembers = detail::interpolateAttribute(aInterpolants, aMembers)), ...);
+               },
+               T_varyings::gAttributes);
+    return result;
 }
 
 
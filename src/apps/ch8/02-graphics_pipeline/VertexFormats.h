@@ -0,0 +1,135 @@
+#pragma once
+
+
+#include <math/Color.h>
+#include <math/Vector.h>
+
+#include <algorithm>
+#include <concepts>
+#include <tuple>
+#include <type_traits>
+
+#include <cmath>
+#include <cstdint>
+
+
+namespace ad {
+namespace focg {
+
+
+// Notes:
+// Vertices are read by the vertex stage, then the shaded vertices are copied through clipping,
+// binning and rasterization: their size directly drives the memory traffic of the pipeline.
+// Vertex inputs are thus stored in compact formats (single precision, packed normals, 8 bits colors),
+// and the output of the vertex stage only holds the varyings the fragment stage actually uses.
+//
+// The varyings are a program defined struct, listing its interpolated members at compile time
+// in a static gAttributes tuple of pointers to members.
+// The pipeline interpolates each listed attribute through its AttributeTraits:
+// floating point attributes are interpolated as is, packed attributes are decoded to floating point,
+// interpolated, then encoded back.
+
+
+/// \brief Unit vector packed as 3 signed normalized 10 bits integers (4 bytes, instead of 24 for a Vec<3>).
+///
+/// The precision is 1/511 on each component, which is below what is noticeable in shading.
+class PackedNormal
+{
+public:
+    PackedNormal() = default;
+
+    explicit PackedNormal(const math::Vec<3, float> & aNormal) :
+        mBits{encode(aNormal.x(), 0) | encode(aNormal.y(), gBits) | encode(aNormal.z(), 2 * gBits)}
+    {}
+
+    math::Vec<3, float> unpack() const
+    { return {decode(mBits, 0), decode(mBits, gBits), decode(mBits, 2 * gBits)}; }
+
+    bool operator==(const PackedNormal &) const = default;
+
+private:
+    static constexpr int gBits = 10;
+    static constexpr int gMaximum = (1 << (gBits - 1)) - 1;
+    static constexpr std::uint32_t gMask = (1u << gBits) - 1;
+
+    static std::uint32_t encode(float aComponent, int aShift)
+    {
+        const int snorm = static_cast<int>(std::lround(std::clamp(aComponent, -1.f, 1.f) * gMaximum));
+        return (static_cast<std::uint32_t>(snorm) & gMask) << aShift;
+    }
+
+    static float decode(std::uint32_t aBits, int aShift)
+    {
+        // Moves the component to the most significant bits, so the arithmetic right shift extends its sign.
+        const auto snorm = static_cast<std::int32_t>(aBits << (32 - gBits - aShift)) >> (32 - gBits);
+        // Both -512 and -511 map to -1.
+        return std::max(static_cast<float>(snorm) / gMaximum, -1.f);
+    }
+
+    std::uint32_t mBits{0};
+};
+
+
+/// \brief How an attribute type is interpolated: decoded to a floating point type, weighted, encoded back.
+///
+/// This primary template is for floating point attributes (scalars, vectors, positions and colors),
+/// which are interpolated as is.
+template <class T_attribute>
+struct AttributeTraits
+{
+    using Decoded = T_attribute;
+
+    static const Decoded & decode(const T_attribute & aValue)
+    { return aValue; }
+
+    static T_attribute encode(const Decoded & aValue)
+    { return aValue; }
+};
+
+
+/// \brief 8 bits colors, interpolated as normalized single precision colors.
+template <>
+struct AttributeTraits<math::sdr::Rgb>
+{
+    using Decoded = math::hdr::Rgb_f;
+
+    static Decoded decode(const math::sdr::Rgb & aValue)
+    { return {aValue.r() / 255.f, aValue.g() / 255.f, aValue.b() / 255.f}; }
+
+    static math::sdr::Rgb encode(const Decoded & aValue)
+    { return {quantize(aValue.r()), quantize(aValue.g()), quantize(aValue.b())}; }
+
+    static std::uint8_t quantize(float aChannel)
+    { return static_cast<std::uint8_t>(std::lround(std::clamp(aChannel, 0.f, 1.f) * 255.f)); }
+};
+
+
+/// \brief Packed normals, interpolated unpacked.
+/// \note The interpolated normal is not renormalized, which is up to the fragment shader.
+template <>
+struct AttributeTraits<PackedNormal>
+{
+    using Decoded = math::Vec<3, float>;
+
+    static Decoded decode(const PackedNormal & aValue)
+    { return aValue.unpack(); }
+
+    static PackedNormal encode(const Decoded & aValue)
+    { return PackedNormal{aValue}; }
+};
+
+
+/// \brief The varyings output by a vertex shader, then interpolated for each fragment.
+///
+/// T_varyings::gAttributes is a tuple of pointers to the members to interpolate.
+template <class T_varyings>
+concept VaryingAttributes = std::default_initializable<T_varyings>
+                            && std::copyable<T_varyings>
+                            && requires
+{
+    std::tuple_size<std::remove_cvref_t<decltype(T_varyings::gAttributes)>>::value;
+};
+
+
+} // namespace focg
+} // namespace ad
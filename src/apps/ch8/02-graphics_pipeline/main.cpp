@@ -5,27 +5,32 @@
 
 #include <focg-assets/Assets.h>
 
+#include <focg-common/RenderService.h>
+
 #include <cstdlib>
+#include <fstream>
+#include <optional>
 
 
 using namespace ad;
 
 
-void renderAll(std::filesystem::path aImagePath, math::Size<2, int> aResolution)
+std::string readFile(const std::filesystem::path & aPath)
 {
-    auto readFile = [](const std::filesystem::path & aPath)
+    auto file = focg::gAssetFolderPath / aPath;
+    if (!exists(file))
     {
-        auto file = focg::gAssetFolderPath / aPath;
-        if (!exists(file))
-        {
-            throw std::runtime_error{file.string() + " does not exist."};
-        }
-        std::ifstream ifs{file.string()};
-        std::stringstream ss;
-        ss << ifs.rdbuf();
-        return ss.str();
-    };
+        throw std::runtime_error{file.string() + " does not exist."};
+    }
+    std::ifstream ifs{file.string()};
+    std::stringstream ss;
+    ss << ifs.rdbuf();
+    return ss.str();
+}
+
 
+void renderAll(std::filesystem::path aImagePath, math::Size<2, int> aResolution)
+{
 
     // Cube
     std::filesystem::path animationFolder = aImagePath / "ch8-demo-anim-cube";
@@ -41,17 +46,105 @@ void renderAll(std::filesystem::path aImagePath, math::Size<2, int> aResolution)
 }
 
 
+/// \brief Render the bunny animation as a single video stream to aDestination, "-" being stdout.
+///
+/// e.g. `ch8-02 --y4m - | ffmpeg -i - bunny.mp4`
+void stream(const std::string & aDestination, focg::VideoFormat aFormat)
+{
+    auto render = [aFormat](std::ostream & aOut)
+    {
+        focg::streamDemoScene(aOut, aFormat,
+                              readFile("meshes/bunny-normals.obj"), 100, {0., -0.7, 0.},
+                              {800, 800});
+    };
+
+    if (aDestination == "-")
+    {
+        focg::setBinaryMode(stdout);
+        render(std::cout);
+    }
+    else
+    {
+        std::ofstream file{aDestination, std::ios_base::binary};
+        if (!file)
+        {
+            throw std::runtime_error{"Cannot open " + aDestination + " for writing."};
+        }
+        render(file);
+    }
+}
+
+
+/// \brief Keep the bunny mesh resident, and render each request received on stdin to stdout.
+///
+/// Recognized parameters: eye, target, light (position in camera space), time (in seconds) and resolution.
+void serve()
+{
+    focg::AnimatedScene animation;
+    {
+        focg::Scene<focg::Vertex> scene;
+        std::istringstream input{readFile("meshes/bunny-normals.obj")};
+        appendIndexedToScene(input, scene, math::hdr::gCyan<>);
+
+        math::AffineMatrix<4> modelling = 
+            math::trans3d::translate({0., -0.7, 0.})
+            * math::trans3d::scale(100., 100., 100.);
+
+        animation.posedScenes.emplace_back(std::move(scene), modelling);
+    }
+
+    // Only re-allocated when a request changes the resolution.
+    std::optional<focg::ShadingRenderer> renderer;
+
+    focg::setBinaryMode(stdout);
+    focg::serve(std::cin, std::cout, [&](const focg::RenderRequest & aRequest) -> const arte::Image<math::sdr::Rgb> &
+    {
+        math::Size<2, int> resolution = aRequest.get("resolution", math::Size<2, int>{800, 800});
+        if (resolution.width() <= 0 || resolution.height() <= 0)
+        {
+            throw std::invalid_argument{"Resolution must be strictly positive."};
+        }
+        if (!renderer || renderer->renderTarget.getResolution() != resolution)
+        {
+            renderer.emplace(resolution, math::sdr::gBlack);
+        }
+
+        animation.cameraPosition = aRequest.get("eye", math::Position<3>{0., 0., 100.});
+        animation.looksAt = aRequest.get("target", math::Position<3>{0., 0., 0.});
+        renderer->program.lightPosition_c = aRequest.get("light", math::Position<4>{0., 0., 100., 1.});
+
+        return renderer->renderFrame(animation, aRequest.get("time", 0.)).color;
+    },
+    /*invert vertical axis*/ true);
+}
+
+
 int main(int argc, char ** argv)
 {
-    if (argc != 2)
+    const std::string mode = argc >= 2 ? argv[1] : "";
+    const bool isStream = (mode == "--y4m" || mode == "--raw-rgb");
+    if (argc != (isStream ? 3 : 2))
     {
-        std::cerr << "Usage: " << argv[0] << " output_image_folder\n";
+        std::cerr << "Usage: " << argv[0] << " output_image_folder\n"
+                  << "       " << argv[0] << " --serve\n"
+                  << "       " << argv[0] << " --y4m|--raw-rgb output_file (- for stdout)\n";
         return EXIT_FAILURE;
     }
 
     try 
     {   
-        renderAll(argv[1], {800, 800});
+        if (mode == "--serve")
+        {
+            serve();
+        }
+        else if (isStream)
+        {
+            stream(argv[2], mode == "--y4m" ? focg::VideoFormat::Y4m : focg::VideoFormat::RawRgb);
+        }
+        else
+        {
+            renderAll(argv[1], {800, 800});
+        }
         return EXIT_SUCCESS;
     }
     catch (std::exception & e)
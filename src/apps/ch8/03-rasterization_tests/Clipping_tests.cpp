@@ -0,0 +1,156 @@
+#include "../02-graphics_pipeline/Clipping.h"
+
+#include <catch2/catch_approx.hpp>
+#include <catch2/catch_test_macros.hpp>
+
+#include <tuple>
+
+#include <cstdint>
+
+
+using namespace ad;
+using namespace ad::focg;
+
+using Catch::Approx;
+
+
+namespace {
+
+
+    // A full precision and a packed varying, both interpolated at the intersections.
+    struct ClipVaryings
+    {
+        double x;
+        math::sdr::Rgb gray;
+
+        static constexpr auto gAttributes = std::tuple{&ClipVaryings::x, &ClipVaryings::gray};
+    };
+
+
+    using ClipVertex = ShadedVertex<ClipVaryings>;
+
+
+    // The varyings are the x coordinate, and a gray going from black at x = 0 to white at x = 2.
+    ClipVertex makeVertex(HPos aPosition)
+    {
+        const std::uint8_t gray = AttributeTraits<math::sdr::Rgb>::quantize(static_cast<float>(aPosition.x() / 2.));
+        return ClipVertex{.pos = aPosition, .varyings = {.x = aPosition.x(), .gray = {gray, gray, gray}}};
+    }
+
+
+    Triangle<ClipVertex> makeTriangle(HPos a, HPos b, HPos c)
+    {
+        return {makeVertex(a), makeVertex(b), makeVertex(c)};
+    }
+
+
+    // Signed area of the triangle projection on the xy plane, after perspective divide.
+    double projectedArea(Triangle<ClipVertex> aTriangle)
+    {
+        aTriangle.perspectiveDivide();
+        HVec ab{aTriangle.b.pos - aTriangle.a.pos};
+        HVec ac{aTriangle.c.pos - aTriangle.a.pos};
+        return (ab.x() * ac.y() - ab.y() * ac.x()) / 2.;
+    }
+
+
+    double projectedArea(const ClipBuffer<ClipVertex> & aBuffer)
+    {
+        double area = 0.;
+        for (std::size_t triangleId = 0; triangleId != aBuffer.getTriangleCount(); ++triangleId)
+        {
+            area += projectedArea(aBuffer.getTriangle(triangleId));
+        }
+        return area;
+    }
+
+
+} // anonymous namespace
+
+
+SCENARIO("Clipping triangles into a fixed-capacity buffer")
+{
+    GIVEN("The unit cube view volume, and a guard band enlarging it by 4 in x and y")
+    {
+        const ViewVolume volume{math::Box<double>::CenterOnOrigin({2., 2., 2.})};
+        const ViewVolume guardBand{math::Box<double>::CenterOnOrigin({8., 8., 2.})};
+        ClipBuffer<ClipVertex> buffer;
+
+        THEN("A triangle inside the volume is accepted unchanged.")
+        {
+            Triangle<ClipVertex> triangle = makeTriangle({-0.5, -0.5, 0., 1.}, {0.5, -0.5, 0., 1.}, {0., 0.5, 0., 1.});
+            clip(triangle, volume, buffer);
+            REQUIRE(buffer.getTriangleCount() == 1);
+            CHECK(buffer.getTriangle(0).a.pos == triangle.a.pos);
+            CHECK(buffer.getTriangle(0).b.pos == triangle.b.pos);
+            CHECK(buffer.getTriangle(0).c.pos == triangle.c.pos);
+        }
+
+        THEN("A triangle outside of a single plane is rejected.")
+        {
+            clip(makeTriangle({1.5, -0.5, 0., 1.}, {3., -0.5, 0., 1.}, {2., 0.5, 0., 1.}), volume, guardBand, buffer);
+            CHECK(buffer.getTriangleCount() == 0);
+        }
+
+        THEN("A triangle crossing the right plane is clipped to the volume, keeping its winding.")
+        {
+            Triangle<ClipVertex> triangle = makeTriangle({0., -0.5, 0., 1.}, {2., -0.5, 0., 1.}, {0., 0.5, 0., 1.});
+            clip(triangle, volume, buffer);
+            REQUIRE(buffer.getTriangleCount() == 2);
+            // Area of the trapezoid between x = 0 and x = 1.
+            CHECK(projectedArea(buffer) == Approx(0.75));
+            for (std::size_t triangleId = 0; triangleId != buffer.getTriangleCount(); ++triangleId)
+            {
+                CHECK(projectedArea(buffer.getTriangle(triangleId)) > 0.);
+            }
+
+            // Vertices on the right plane are the intersections, at the middle of the edges from x = 0 to x = 2.
+            for (std::size_t triangleId = 0; triangleId != buffer.getTriangleCount(); ++triangleId)
+            {
+                Triangle<ClipVertex> clipped = buffer.getTriangle(triangleId);
+                for (std::size_t vertexId = 0; vertexId != 3; ++vertexId)
+                {
+                    const ClipVertex & vertex = clipped.at(vertexId);
+                    CHECK(vertex.varyings.x == Approx(vertex.pos.x()));
+                    if (vertex.pos.x() == Approx(1.))
+                    {
+                        CHECK(vertex.varyings.gray == math::sdr::Rgb{128, 128, 128});
+                    }
+                }
+            }
+
+            WHEN("It is clipped with the guard band.")
+            {
+                clip(triangle, volume, guardBand, buffer);
+
+                THEN("It is accepted unchanged.")
+                {
+                    REQUIRE(buffer.getTriangleCount() == 1);
+                    CHECK(buffer.getTriangle(0).b.pos == triangle.b.pos);
+                }
+            }
+        }
+
+        THEN("The near plane is clipped even with the guard band.")
+        {
+            Triangle<ClipVertex> triangle = makeTriangle({-0.5, -0.5, 3., 1.}, {0.5, -0.5, 0., 1.}, {0., 0.5, 0., 1.});
+            clip(triangle, volume, guardBand, buffer);
+            REQUIRE(buffer.getTriangleCount() == 2);
+            for (std::size_t triangleId = 0; triangleId != buffer.getTriangleCount(); ++triangleId)
+            {
+                Triangle<ClipVertex> clipped = buffer.getTriangle(triangleId);
+                CHECK(clipped.a.pos.z() <= 1.);
+                CHECK(clipped.b.pos.z() <= 1.);
+                CHECK(clipped.c.pos.z() <= 1.);
+            }
+        }
+
+        THEN("A triangle crossing several planes does not exceed the buffer capacity.")
+        {
+            clip(makeTriangle({-3., -3., 0.5, 1.}, {3., -1.5, -0.5, 1.}, {0.5, 4., 0., 1.}), volume, buffer);
+            CHECK(buffer.getTriangleCount() >= 1);
+            CHECK(buffer.getTriangleCount() <= ClipBuffer<ClipVertex>::gMaxVertices - 2);
+            CHECK(projectedArea(buffer) > 0.);
+        }
+    }
+}
@@ -0,0 +1,694 @@
+#include "../02-graphics_pipeline/GraphicsPipeline.h"
+#include "../02-graphics_pipeline/Shaders.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <atomic>
+#include <optional>
+#include <tuple>
+
+
+using namespace ad;
+using namespace ad::focg;
+
+
+namespace {
+
+
+    // The only varying of the test programs.
+    struct ColorVaryings
+    {
+        math::hdr::Rgb_f color;
+
+        static constexpr auto gAttributes = std::tuple{&ColorVaryings::color};
+    };
+
+
+    // Vertices are directly given in clip space.
+    ShadedVertex<ColorVaryings> passThrough(const Vertex & aVertex)
+    {
+        return {
+            .pos = HPos{aVertex.pos.x(), aVertex.pos.y(), aVertex.pos.z(), 1.},
+            .varyings = {.color = AttributeTraits<math::sdr::Rgb>::decode(aVertex.color)},
+        };
+    }
+
+
+    struct PassThrough
+    {
+        ShadedVertex<ColorVaryings> vertex(const Vertex & aVertex) const
+        {
+            return passThrough(aVertex);
+        }
+
+        math::sdr::Rgb fragment(const math::Position<4> &, const ColorVaryings & aIn) const
+        {
+            ++*invocations;
+            return to_sdr(aIn.color);
+        }
+
+        std::atomic<int> * invocations;
+    };
+
+
+    // Pushes red fragments behind everything else.
+    struct PushRedBack
+    {
+        ShadedVertex<ColorVaryings> vertex(const Vertex & aVertex) const
+        {
+            return passThrough(aVertex);
+        }
+
+        math::sdr::Rgb fragment(const math::Position<4> &, const ColorVaryings & aIn, double & aDepth) const
+        {
+            ++*invocations;
+            if (aIn.color.r() > 0.5)
+            {
+                aDepth -= 1000.;
+            }
+            return to_sdr(aIn.color);
+        }
+
+        std::atomic<int> * invocations;
+    };
+
+
+    // Exposes its (identity) transformation, allowing frustum culling.
+    struct CountVertices
+    {
+        ShadedVertex<ColorVaryings> vertex(const Vertex & aVertex) const
+        {
+            ++*invocations;
+            return passThrough(aVertex);
+        }
+
+        math::sdr::Rgb fragment(const math::Position<4> &, const ColorVaryings & aIn) const
+        {
+            return to_sdr(aIn.color);
+        }
+
+        math::Matrix<4, 4> getLocalToClip() const
+        {
+            return math::Matrix<4, 4>::Identity();
+        }
+
+        std::atomic<int> * invocations;
+    };
+
+
+    static_assert(ShaderProgram<PassThrough, Vertex> && !DepthWritingProgram<PassThrough, ColorVaryings>);
+    static_assert(ProjectingProgram<CountVertices> && !ProjectingProgram<PassThrough>);
+    static_assert(ShaderProgram<PushRedBack, Vertex> && DepthWritingProgram<PushRedBack, ColorVaryings>);
+
+
+    // A vertex at the given clip space position (w being 1).
+    Vertex makeVertex(double aX, double aY, double aZ, math::hdr::Rgb_d aColor = math::hdr::gRed<>)
+    {
+        return Vertex{
+            .pos = {static_cast<float>(aX), static_cast<float>(aY), static_cast<float>(aZ)},
+            .normal = PackedNormal{},
+            .uv = {0.f, 0.f},
+            .color = to_sdr(aColor),
+        };
+    }
+
+
+    // A triangle covering the whole viewport, at the given clip space depth.
+    Triangle<Vertex> makeCoveringTriangle(double aZ, math::hdr::Rgb_d aColor)
+    {
+        Triangle<Vertex> triangle{
+            makeVertex(-1., -1., aZ, aColor),
+            makeVertex( 3., -1., aZ, aColor),
+            makeVertex(-1.,  3., aZ, aColor),
+        };
+        return triangle;
+    }
+
+
+    // A strip of aQuadCount quads along x, each with its own 4 vertices (i.e. 2 triangles).
+    IndexedMesh<Vertex> makeStrip(double aXBegin, double aQuadWidth, int aQuadCount)
+    {
+        IndexedMesh<Vertex> mesh;
+        for (int quad = 0; quad != aQuadCount; ++quad)
+        {
+            const double x = aXBegin + quad * aQuadWidth;
+            const auto first = static_cast<std::uint32_t>(mesh.vertices.size());
+            mesh.vertices.push_back(makeVertex(x, -0.5, 0.));
+            mesh.vertices.push_back(makeVertex(x + aQuadWidth, -0.5, 0.));
+            mesh.vertices.push_back(makeVertex(x + aQuadWidth, 0.5, 0.));
+            mesh.vertices.push_back(makeVertex(x, 0.5, 0.));
+            mesh.indices.insert(mesh.indices.end(), {first, first + 1, first + 2, first, first + 2, first + 3});
+        }
+        return mesh;
+    }
+
+
+    template <class T_target>
+    int countCoveredPixels(const T_target & aBuffer)
+    {
+        int covered = 0;
+        for (auto depth : aBuffer.depth)
+        {
+            covered += (depth != T_target::depth_format::gCleared);
+        }
+        return covered;
+    }
+
+
+    // Renders aScene serially and in parallel to a new T_target,
+    // passing the fragment shader invocation count and the target to aChecks.
+    template <class T_target, class T_program, class F_checks>
+    void renderWithThreads(const Scene<Vertex> & aScene, F_checks && aChecks)
+    {
+        for (unsigned int threadCount : {1u, 2u})
+        {
+            GraphicsPipeline pipeline;
+            pipeline.threadCount = threadCount;
+            T_target target{{100, 70}};
+            std::atomic<int> invocations{0};
+            pipeline.traverse(aScene, target, T_program{&invocations}, 10., -10.);
+            aChecks(invocations.load(), target);
+        }
+    }
+
+
+} // anonymous namespace
+
+
+SCENARIO("Depth is tested before fragment shading")
+{
+    GIVEN("A red triangle in front of a green triangle, drawn first")
+    {
+        Scene<Vertex> scene;
+        scene.triangles.push_back(makeCoveringTriangle( 0.5, math::hdr::Rgb_d{1., 0., 0.}));
+        scene.triangles.push_back(makeCoveringTriangle(-0.5, math::hdr::Rgb_d{0., 1., 0.}));
+
+        WHEN("It is rendered with a program that does not write depth.")
+        {
+            THEN("Only the red triangle is shaded, serially and in parallel.")
+            {
+                for (unsigned int threadCount : {1u, 2u})
+                {
+                    GraphicsPipeline pipeline;
+                    pipeline.threadCount = threadCount;
+                    ImageBuffer<> target{{100, 70}};
+                    std::atomic<int> invocations{0};
+                    pipeline.traverse(scene, target, PassThrough{&invocations}, 10., -10.);
+
+                    REQUIRE(countCoveredPixels(target) == target.getResolution().area());
+                    CHECK(invocations == target.getResolution().area());
+                    CHECK(target.color.at(50, 35) == math::sdr::Rgb{255, 0, 0});
+                }
+            }
+        }
+
+        WHEN("It is rendered with a program pushing red fragments back.")
+        {
+            THEN("Both triangles are shaded, and the depth test uses the written depth.")
+            {
+                for (unsigned int threadCount : {1u, 2u})
+                {
+                    GraphicsPipeline pipeline;
+                    pipeline.threadCount = threadCount;
+                    ImageBuffer<> target{{100, 70}};
+                    std::atomic<int> invocations{0};
+                    pipeline.traverse(scene, target, PushRedBack{&invocations}, 10., -10.);
+
+                    CHECK(invocations == 2 * target.getResolution().area());
+                    CHECK(target.color.at(50, 35) == math::sdr::Rgb{0, 255, 0});
+                }
+            }
+        }
+    }
+}
+
+
+SCENARIO("Deferred shading shades each visible pixel once")
+{
+    GIVEN("A green triangle behind a red triangle, drawn first")
+    {
+        Scene<Vertex> scene;
+        scene.triangles.push_back(makeCoveringTriangle(-0.5, math::hdr::Rgb_d{0., 1., 0.}));
+        scene.triangles.push_back(makeCoveringTriangle( 0.5, math::hdr::Rgb_d{1., 0., 0.}));
+
+        WHEN("It is rendered with deferred shading.")
+        {
+            THEN("Each pixel is shaded once, instead of once per overlapping triangle in forward.")
+            {
+                for (unsigned int threadCount : {1u, 2u})
+                {
+                    GraphicsPipeline pipeline;
+                    pipeline.threadCount = threadCount;
+
+                    ImageBuffer<> forwardTarget{{100, 70}};
+                    std::atomic<int> forwardInvocations{0};
+                    pipeline.traverse(scene, forwardTarget, PassThrough{&forwardInvocations}, 10., -10.);
+
+                    pipeline.shading = GraphicsPipeline::Shading::Deferred;
+                    ImageBuffer<> target{{100, 70}};
+                    std::atomic<int> invocations{0};
+                    pipeline.traverse(scene, target, PassThrough{&invocations}, 10., -10.);
+
+                    CHECK(forwardInvocations == 2 * target.getResolution().area());
+                    CHECK(invocations == target.getResolution().area());
+                    CHECK(target.color.at(50, 35) == math::sdr::Rgb{255, 0, 0});
+                    CHECK(target.color.dimensions() == forwardTarget.color.dimensions());
+                    CHECK(target.depth == forwardTarget.depth);
+                }
+            }
+        }
+
+        WHEN("It is rendered with deferred shading, by a program writing depth.")
+        {
+            THEN("It falls back to forward shading.")
+            {
+                for (unsigned int threadCount : {1u, 2u})
+                {
+                    GraphicsPipeline pipeline;
+                    pipeline.threadCount = threadCount;
+                    pipeline.shading = GraphicsPipeline::Shading::Deferred;
+                    ImageBuffer<> target{{100, 70}};
+                    std::atomic<int> invocations{0};
+                    pipeline.traverse(scene, target, PushRedBack{&invocations}, 10., -10.);
+
+                    CHECK(invocations == 2 * target.getResolution().area());
+                    CHECK(target.color.at(50, 35) == math::sdr::Rgb{0, 255, 0});
+                }
+            }
+        }
+    }
+}
+
+
+SCENARIO("Meshes and clusters outside of the view frustum are culled before vertex processing")
+{
+    GIVEN("A mesh of two clusters, the first one in view, the second one to the right of the view")
+    {
+        constexpr int gQuadsPerCluster = IndexedMesh<Vertex>::gClusterSize / 2;
+        Scene<Vertex> scene;
+        // The first cluster spans x in [-0.5, 0.5], the second x in [1.5, 2.5]
+        scene.meshes.push_back(makeStrip(-0.5, 1. / gQuadsPerCluster, gQuadsPerCluster));
+        IndexedMesh<Vertex> offscreen = makeStrip(1.5, 1. / gQuadsPerCluster, gQuadsPerCluster);
+        for (std::uint32_t & index : offscreen.indices)
+        {
+            index += static_cast<std::uint32_t>(scene.meshes.front().vertices.size());
+        }
+        scene.meshes.front().vertices.insert(scene.meshes.front().vertices.end(),
+                                             offscreen.vertices.begin(), offscreen.vertices.end());
+        scene.meshes.front().indices.insert(scene.meshes.front().indices.end(),
+                                            offscreen.indices.begin(), offscreen.indices.end());
+        const int vertexCount = static_cast<int>(scene.meshes.front().vertices.size());
+        REQUIRE(scene.meshes.front().getClusterCount() == 2);
+
+        // Renders serially and in parallel, passing the vertex shader invocation count and the target to aChecks.
+        auto render = [](const Scene<Vertex> & aScene, auto aChecks)
+        {
+            for (unsigned int threadCount : {1u, 2u})
+            {
+                GraphicsPipeline pipeline;
+                pipeline.threadCount = threadCount;
+                ImageBuffer<> target{{100, 70}};
+                std::atomic<int> invocations{0};
+                pipeline.traverse(aScene, target, CountVertices{&invocations}, 10., -10.);
+                aChecks(invocations.load(), target);
+            }
+        };
+
+        WHEN("It is rendered without bounds.")
+        {
+            THEN("All vertices are shaded.")
+            {
+                render(scene, [&](int aInvocations, const ImageBuffer<> &)
+                {
+                    CHECK(aInvocations == vertexCount);
+                });
+            }
+        }
+
+        WHEN("It is rendered with bounds.")
+        {
+            scene.meshes.front().computeBounds();
+
+            THEN("Only the vertices of the first cluster are shaded.")
+            {
+                render(scene, [&](int aInvocations, const ImageBuffer<> & aTarget)
+                {
+                    CHECK(aInvocations == vertexCount / 2);
+                    CHECK(aTarget.color.at(50, 35) != math::sdr::Rgb{0, 0, 0});
+                });
+            }
+        }
+
+        WHEN("The whole mesh is outside of the view frustum.")
+        {
+            for (Vertex & vertex : scene.meshes.front().vertices)
+            {
+                vertex.pos.y() += 3.;
+            }
+            scene.meshes.front().computeBounds();
+
+            THEN("No vertex is shaded.")
+            {
+                render(scene, [&](int aInvocations, const ImageBuffer<> & aTarget)
+                {
+                    CHECK(aInvocations == 0);
+                    CHECK(countCoveredPixels(aTarget) == 0);
+                });
+            }
+        }
+
+        WHEN("It is seen through a perspective projection, which brings both clusters in view.")
+        {
+            scene.meshes.front().computeBounds();
+
+            // The mesh is 5 units in front of the camera: x is divided by 5, both clusters are in [-0.1, 0.5].
+            const double nearZ = -1.;
+            const double farZ = -10.;
+            TransformAndLighting program;
+            program.localToCamera = math::trans3d::translate({0., 0., -5.});
+            program.projection = math::trans3d::perspective(nearZ, farZ)
+                                 * math::trans3d::orthographicProjection(
+                                     math::Box<double>{{-1., -1., farZ}, {2., 2., nearZ - farZ}});
+
+            THEN("Both clusters are kept by the culling, and rendered.")
+            {
+                for (unsigned int threadCount : {1u, 2u})
+                {
+                    GraphicsPipeline pipeline;
+                    pipeline.threadCount = threadCount;
+                    ImageBuffer<> target{{100, 70}};
+                    pipeline.traverse(scene, target, program, 10., -10.);
+                    // The first cluster spans x in [-0.1, 0.1] in NDC, the second x in [0.3, 0.5].
+                    CHECK(target.depth[50 + 35 * 100] != ImageBuffer<>::depth_format::gCleared);
+                    CHECK(target.depth[70 + 35 * 100] != ImageBuffer<>::depth_format::gCleared);
+                }
+            }
+        }
+    }
+}
+
+
+SCENARIO("Depth buffer formats")
+{
+    GIVEN("The normalized depth formats")
+    {
+        const DepthRange range{10., -10.};
+
+        THEN("The near plane is the greatest value, and the far plane is the cleared value.")
+        {
+            CHECK(DepthFloat32Reversed::encode(10., range) == 1.f);
+            CHECK(DepthFloat32Reversed::encode(-10., range) == DepthFloat32Reversed::gCleared);
+            CHECK(DepthUnorm16::encode(10., range) == 0xFFFF);
+            CHECK(DepthUnorm16::encode(-10., range) == DepthUnorm16::gCleared);
+            CHECK(DepthUnorm24::encode(10., range) == 0xFFFFFF);
+            CHECK(DepthUnorm24::encode(-10., range) == DepthUnorm24::gCleared);
+            // Clamped
+            CHECK(DepthUnorm16::encode(100., range) == 0xFFFF);
+            CHECK(DepthUnorm16::encode(-100., range) == 0);
+        }
+
+        THEN("Encoding preserves the depth ordering.")
+        {
+            CHECK(DepthFloat32Reversed::encode(0.5, range) > DepthFloat32Reversed::encode(-0.5, range));
+            CHECK(DepthUnorm16::encode(0.5, range) > DepthUnorm16::encode(-0.5, range));
+            CHECK(DepthUnorm24::encode(0.001, range) > DepthUnorm24::encode(0., range));
+        }
+    }
+
+    GIVEN("A red triangle in front of a green triangle, drawn first")
+    {
+        Scene<Vertex> scene;
+        scene.triangles.push_back(makeCoveringTriangle( 0.5, math::hdr::Rgb_d{1., 0., 0.}));
+        scene.triangles.push_back(makeCoveringTriangle(-0.5, math::hdr::Rgb_d{0., 1., 0.}));
+
+        auto checkRedInFront = [](int aInvocations, const auto & aTarget)
+        {
+            CHECK(countCoveredPixels(aTarget) == aTarget.getResolution().area());
+            CHECK(aInvocations == aTarget.getResolution().area());
+            CHECK(aTarget.color.at(50, 35) == math::sdr::Rgb{255, 0, 0});
+        };
+
+        WHEN("It is rendered to targets with compact depth formats.")
+        {
+            THEN("Only the red triangle is shaded, as with the default format.")
+            {
+                renderWithThreads<ImageBuffer<math::sdr::Rgb, DepthFloat32Reversed>, PassThrough>(scene, checkRedInFront);
+                renderWithThreads<ImageBuffer<math::sdr::Rgb, DepthUnorm24>, PassThrough>(scene, checkRedInFront);
+                renderWithThreads<ImageBuffer<math::sdr::Rgb, DepthUnorm16>, PassThrough>(scene, checkRedInFront);
+            }
+        }
+
+        WHEN("It is rendered to a depth-only target.")
+        {
+            THEN("Depth is written without shading fragments.")
+            {
+                renderWithThreads<DepthBuffer<DepthFloat32Reversed>, PassThrough>(
+                    scene,
+                    [](int aInvocations, const DepthBuffer<DepthFloat32Reversed> & aTarget)
+                    {
+                        CHECK(aInvocations == 0);
+                        REQUIRE(countCoveredPixels(aTarget) == aTarget.getResolution().area());
+                        // The red triangle, at NDC depth 0.5, is at window depth 5.
+                        CHECK(aTarget.depth[0] == DepthFloat32Reversed::encode(5., DepthRange{10., -10.}));
+                    });
+            }
+
+            THEN("Programs writing depth are still shaded.")
+            {
+                renderWithThreads<DepthBuffer<DepthUnorm24>, PushRedBack>(
+                    scene,
+                    [](int aInvocations, const DepthBuffer<DepthUnorm24> & aTarget)
+                    {
+                        CHECK(aInvocations == 2 * aTarget.getResolution().area());
+                        CHECK(countCoveredPixels(aTarget) == aTarget.getResolution().area());
+                    });
+            }
+        }
+    }
+}
+
+
+SCENARIO("Clearing a target is deferred per tile")
+{
+    GIVEN("A target spanning several tiles, entirely drawn to, then cleared")
+    {
+        Scene<Vertex> covering;
+        covering.triangles.push_back(makeCoveringTriangle(0.5, math::hdr::Rgb_d{1., 0., 0.}));
+
+        // Only covers pixels of the first tile.
+        Scene<Vertex> small;
+        small.triangles.push_back(Triangle<Vertex>{
+            makeVertex(-1.,  -1.,  0., math::hdr::Rgb_d{0., 1., 0.}),
+            makeVertex(-0.8, -1.,  0., math::hdr::Rgb_d{0., 1., 0.}),
+            makeVertex(-1.,  -0.8, 0., math::hdr::Rgb_d{0., 1., 0.}),
+        });
+
+        const math::sdr::Rgb clearColor{0, 0, 255};
+
+        WHEN("A triangle is drawn in a single tile, then the clears are resolved.")
+        {
+            THEN("Only this tile is materialized by the draw, and the other tiles are cleared by the resolve.")
+            {
+                for (unsigned int threadCount : {1u, 2u})
+                {
+                    GraphicsPipeline pipeline;
+                    pipeline.threadCount = threadCount;
+                    std::atomic<int> invocations{0};
+
+                    ImageBuffer<> target{{200, 150}, clearColor};
+                    pipeline.traverse(covering, target, PassThrough{&invocations}, 10., -10.);
+                    target.clear();
+                    // Clearing does not write the pixels.
+                    CHECK(target.color.at(150, 100) == math::sdr::Rgb{255, 0, 0});
+
+                    pipeline.traverse(small, target, PassThrough{&invocations}, 10., -10.);
+                    CHECK_FALSE(target.clearedTiles.isCleared(0, 0));
+                    CHECK(target.clearedTiles.isCleared(150, 100));
+                    CHECK(target.color.at(2, 2) == math::sdr::Rgb{0, 255, 0});
+                    // Materialized with the tile of the fragments.
+                    CHECK(target.color.at(40, 40) == clearColor);
+
+                    target.resolveClears();
+                    CHECK_FALSE(target.clearedTiles.isCleared(150, 100));
+                    CHECK(target.color.at(150, 100) == clearColor);
+                    CHECK(target.depth[150 + 100 * 200] == DepthDouble::gCleared);
+                    CHECK(countCoveredPixels(target) > 0);
+                    CHECK(countCoveredPixels(target) < 40 * 40);
+                }
+            }
+        }
+    }
+}
+
+
+SCENARIO("Multisample anti-aliasing evaluates coverage and depth per sample, shading once per pixel")
+{
+    const math::sdr::Rgb red{255, 0, 0};
+    const math::sdr::Rgb blue{0, 0, 255};
+
+    // Resolves a copy, so the checks can be made on the target and on its resolved image.
+    auto resolve = [](auto aTarget)
+    {
+        arte::Image<math::sdr::Rgb> image{aTarget.getResolution(), math::sdr::gBlack};
+        aTarget.resolve(image);
+        return image;
+    };
+
+    GIVEN("A red triangle covering the lower left half of the viewport, on a blue background")
+    {
+        Scene<Vertex> scene;
+        scene.triangles.push_back(Triangle<Vertex>{
+            makeVertex(-1., -1., 0., math::hdr::Rgb_d{1., 0., 0.}),
+            makeVertex( 1., -1., 0., math::hdr::Rgb_d{1., 0., 0.}),
+            makeVertex(-1.,  1., 0., math::hdr::Rgb_d{1., 0., 0.}),
+        });
+
+        WHEN("It is rendered to a 4x multisample target.")
+        {
+            THEN("Each pixel with a covered sample is shaded once, and edge pixels resolve to blends.")
+            {
+                std::optional<arte::Image<math::sdr::Rgb>> serialImage;
+                for (unsigned int threadCount : {1u, 2u})
+                {
+                    GraphicsPipeline pipeline;
+                    pipeline.threadCount = threadCount;
+                    MultisampleBuffer<4> target{{100, 70}, blue};
+                    target.clear();
+                    std::atomic<int> invocations{0};
+                    pipeline.traverse(scene, target, PassThrough{&invocations}, 10., -10.);
+                    target.resolveClears();
+
+                    int coveredPixels = 0;
+                    int blendedPixels = 0;
+                    for (int y = 0; y != 70; ++y)
+                    {
+                        for (int x = 0; x != 100; ++x)
+                        {
+                            int coveredSamples = 0;
+                            for (int sample = 0; sample != 4; ++sample)
+                            {
+                                coveredSamples += (target.depthAt(math::Position<2, int>{x, y}, sample)
+                                                   != DepthDouble::gCleared);
+                            }
+                            coveredPixels += (coveredSamples != 0);
+                            blendedPixels += (coveredSamples != 0 && coveredSamples != 4);
+                            // Only partially covered pixels store distinct sample colors.
+                            CHECK(target.compressed[x + y * 100] == (coveredSamples == 0 || coveredSamples == 4));
+                        }
+                    }
+                    CHECK(invocations == coveredPixels);
+                    CHECK(blendedPixels > 70);
+
+                    arte::Image<math::sdr::Rgb> image = resolve(target);
+                    CHECK(image.at(5, 5) == red);
+                    CHECK(image.at(95, 65) == blue);
+                    // On the diagonal, from (99.5, -0.5) to (-0.5, 69.5)
+                    const math::sdr::Rgb edge = image.at(50, 34);
+                    CHECK((edge.r() > 0 && edge.r() < 255 && edge.b() > 0));
+
+                    if (serialImage)
+                    {
+                        CHECK(image.at(50, 34) == serialImage->at(50, 34));
+                        CHECK(image.at(20, 55) == serialImage->at(20, 55));
+                    }
+                    serialImage = image;
+                }
+            }
+        }
+    }
+
+    GIVEN("Two triangles of distinct colors, sharing a diagonal, covering the viewport")
+    {
+        Scene<Vertex> scene;
+        scene.triangles.push_back(Triangle<Vertex>{
+            makeVertex(-1., -1., 0., math::hdr::Rgb_d{1., 0., 0.}),
+            makeVertex( 1., -1., 0., math::hdr::Rgb_d{1., 0., 0.}),
+            makeVertex( 1.,  1., 0., math::hdr::Rgb_d{1., 0., 0.}),
+        });
+        scene.triangles.push_back(Triangle<Vertex>{
+            makeVertex(-1., -1., 0., math::hdr::Rgb_d{0., 1., 0.}),
+            makeVertex( 1.,  1., 0., math::hdr::Rgb_d{0., 1., 0.}),
+            makeVertex(-1.,  1., 0., math::hdr::Rgb_d{0., 1., 0.}),
+        });
+
+        auto checkWatertight = [&](int aInvocations, auto & aTarget)
+        {
+            constexpr int sampleCount = std::remove_reference_t<decltype(aTarget)>::gSampleCount;
+            const int area = aTarget.getResolution().area();
+
+            // Each sample is covered, pixels on the diagonal being shaded by both triangles.
+            CHECK(countCoveredPixels(aTarget) == area * sampleCount);
+            CHECK(aInvocations > area);
+            CHECK(aInvocations < 2 * area);
+
+            // No sample keeps the (black) clear color.
+            arte::Image<math::sdr::Rgb> image = resolve(aTarget);
+            for (int y = 0; y != 70; ++y)
+            {
+                for (int x = 0; x != 100; ++x)
+                {
+                    CHECK(image.at(x, y).r() + image.at(x, y).g() >= 254);
+                }
+            }
+        };
+
+        WHEN("It is rendered with 2, 4 and 8 samples per pixel.")
+        {
+            THEN("Each sample is covered, there is no seam along the shared edge.")
+            {
+                renderWithThreads<MultisampleBuffer<2>, PassThrough>(scene, checkWatertight);
+                renderWithThreads<MultisampleBuffer<4>, PassThrough>(scene, checkWatertight);
+                renderWithThreads<MultisampleBuffer<8>, PassThrough>(scene, checkWatertight);
+            }
+        }
+    }
+
+    GIVEN("A red square whose depth increases along x, intersecting a green square drawn first")
+    {
+        Scene<Vertex> scene;
+        const math::hdr::Rgb_d green{0., 1., 0.};
+        const math::hdr::Rgb_d redColor{1., 0., 0.};
+        auto pushSquare = [&scene](double aZLeft, double aZRight, math::hdr::Rgb_d aColor)
+        {
+            scene.triangles.push_back(Triangle<Vertex>{
+                makeVertex(-1., -1., aZLeft, aColor),
+                makeVertex( 1., -1., aZRight, aColor),
+                makeVertex( 1.,  1., aZRight, aColor),
+            });
+            scene.triangles.push_back(Triangle<Vertex>{
+                makeVertex(-1., -1., aZLeft, aColor),
+                makeVertex( 1.,  1., aZRight, aColor),
+                makeVertex(-1.,  1., aZLeft, aColor),
+            });
+        };
+        pushSquare(0., 0., green);
+        // Depth is 0.5 * x - 0.005, intersecting the green square at x = 0.01 (on the centers of column 50).
+        pushSquare(-0.505, 0.495, redColor);
+
+        WHEN("It is rendered to a 8x multisample target.")
+        {
+            THEN("Pixels crossed by the intersection resolve to blends, the others to a single color.")
+            {
+                renderWithThreads<MultisampleBuffer<8>, PassThrough>(
+                    scene,
+                    [&](int, MultisampleBuffer<8> & aTarget)
+                    {
+                        arte::Image<math::sdr::Rgb> image = resolve(aTarget);
+                        const math::sdr::Rgb left = image.at(10, 35);
+                        const math::sdr::Rgb right = image.at(90, 35);
+                        CHECK(left != right);
+                        CHECK((left == red || left == math::sdr::Rgb{0, 255, 0}));
+                        CHECK((right == red || right == math::sdr::Rgb{0, 255, 0}));
+
+                        int blended = 0;
+                        for (int y = 0; y != 70; ++y)
+                        {
+                            const math::sdr::Rgb pixel = image.at(50, y);
+                            blended += (pixel != left && pixel != right);
+                        }
+                        CHECK(blended > 0);
+                    });
+            }
+        }
+    }
+}
@@ -0,0 +1,730 @@
+#include "../02-graphics_pipeline/FixedPointRasterization.h"
+#include "../02-graphics_pipeline/HalfSpaceRasterization.h"
+#include "../02-graphics_pipeline/MicroTriangleRasterization.h"
+#include "../02-graphics_pipeline/MultisampleRasterization.h"
+#include "../02-graphics_pipeline/Rasterization.h"
+#include "../02-graphics_pipeline/ScanlineRasterization.h"
+
+#include <catch2/catch_approx.hpp>
+#include <catch2/catch_test_macros.hpp>
+
+#include <array>
+#include <map>
+#include <numbers>
+#include <random>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include <cmath>
+#include <cstdint>
+
+
+using namespace ad;
+using namespace ad::focg;
+
+using Catch::Approx;
+
+
+namespace {
+
+
+    struct Fragment
+    {
+        double z;
+        double depthInverse;
+        math::hdr::Rgb_d color;
+    };
+
+
+    // Fragments by pixel position, the raster itself is not used.
+    struct FragmentRecorder
+    {
+        std::map<std::pair<int, int>, Fragment> fragments;
+        int emitted{0};
+    };
+
+
+    struct ColorVaryings
+    {
+        math::hdr::Rgb_d color;
+
+        static constexpr auto gAttributes = std::tuple{&ColorVaryings::color};
+    };
+
+
+    struct PackedVaryings
+    {
+        PackedNormal normal;
+        math::sdr::Rgb color;
+
+        static constexpr auto gAttributes = std::tuple{&PackedVaryings::normal, &PackedVaryings::color};
+    };
+
+
+    // Window space vertex, as output by the pipeline after the viewport transform.
+    using WindowVertex = ShadedVertex<ColorVaryings>;
+
+
+    auto gRecord = [](FragmentRecorder & aRecorder,
+                      math::Position<2, int> aPosition,
+                      double aZ,
+                      double aDepthInverse,
+                      const DeferredVaryings<WindowVertex> & aVaryings)
+    {
+        aRecorder.fragments[{aPosition.x(), aPosition.y()}] = Fragment{aZ, aDepthInverse, aVaryings.interpolate().color};
+        ++aRecorder.emitted;
+    };
+
+
+    WindowVertex makeVertex(double aX, double aY, double aZ, double aW, math::hdr::Rgb_d aColor)
+    {
+        return WindowVertex{
+            .pos = HPos{aX, aY, aZ, 1.},
+            .varyings = {.color = aColor},
+            .depthInverse = 1. / aW,
+        };
+    }
+
+
+    /// \brief The two triangles of the square [aMin, aMax]^2, split along its y = x diagonal,
+    /// which goes through the offscreen point (-1, -1).
+    std::array<Triangle<WindowVertex>, 2> makeDiagonalQuad(double aMin, double aMax)
+    {
+        WindowVertex v0 = makeVertex(aMin, aMin, -0.5, 1., math::hdr::Rgb_d{1., 0., 0.});
+        WindowVertex v1 = makeVertex(aMax, aMin, -0.5, 1., math::hdr::Rgb_d{1., 0., 0.});
+        WindowVertex v2 = makeVertex(aMax, aMax, -0.5, 1., math::hdr::Rgb_d{1., 0., 0.});
+        WindowVertex v3 = makeVertex(aMin, aMax, -0.5, 1., math::hdr::Rgb_d{1., 0., 0.});
+        return {
+            Triangle<WindowVertex>{v0, v1, v2},
+            Triangle<WindowVertex>{v0, v2, v3},
+        };
+    }
+
+
+    /// \brief Rasterize with aRasterize the two triangles of makeDiagonalQuad().
+    template <class F_rasterize>
+    FragmentRecorder rasterizeDiagonalQuad(double aMin, double aMax, F_rasterize && aRasterize)
+    {
+        FragmentRecorder recorder;
+        for (const Triangle<WindowVertex> & triangle : makeDiagonalQuad(aMin, aMax))
+        {
+            aRasterize(triangle, recorder);
+        }
+        return recorder;
+    }
+
+
+    /// \brief Check that each pixel center strictly inside the quad and inside aScissor was covered exactly once,
+    /// including the centers on the diagonal.
+    void checkDiagonalCoverage(const FragmentRecorder & aRecorder, double aMin, double aMax,
+                               const Scissor & aScissor = {})
+    {
+        CHECK(aRecorder.emitted == (int)aRecorder.fragments.size());
+        for (int y = (int)std::floor(aMin) + 1; y < aMax; ++y)
+        {
+            for (int x = (int)std::floor(aMin) + 1; x < aMax; ++x)
+            {
+                if (x >= aScissor.xMin && x <= aScissor.xMax && y >= aScissor.yMin && y <= aScissor.yMax)
+                {
+                    CHECK(aRecorder.fragments.count({x, y}) == 1);
+                }
+            }
+        }
+    }
+
+
+    // Squares whose diagonal goes through (-1, -1): pixel aligned,
+    // as mapped by the pipeline viewport transform for a full screen quad, and on pixel boundaries.
+    constexpr std::array<std::array<double, 2>, 3> gDiagonalQuads{{
+        {0., 16.},
+        {-0.4, 15.4},
+        {-0.5, 15.5},
+    }};
+
+
+    using RasterizeFunction = void(*)(const Triangle<WindowVertex> &, FragmentRecorder &, const Scissor &);
+
+    // The rasterizers that must agree on the ownership of shared edges.
+    // (The micro triangle path is bit-identical to the fixed-point rasterization, see its own scenario.)
+    const std::array<std::pair<const char *, RasterizeFunction>, 3> gRasterizers{{
+        {
+            "half-space",
+            [](const Triangle<WindowVertex> & aTriangle, FragmentRecorder & aRecorder, const Scissor & aScissor)
+            { rasterizeHalfSpace(aTriangle, aRecorder, gRecord, aScissor); }
+        },
+        {
+            "fixed-point",
+            [](const Triangle<WindowVertex> & aTriangle, FragmentRecorder & aRecorder, const Scissor & aScissor)
+            { rasterizeFixedPoint(aTriangle, aRecorder, gRecord, aScissor); }
+        },
+        {
+            "scanline",
+            [](const Triangle<WindowVertex> & aTriangle, FragmentRecorder & aRecorder, const Scissor & aScissor)
+            { rasterizeScanline(aTriangle, aRecorder, gRecord, aScissor); }
+        },
+    }};
+
+
+} // anonymous namespace
+
+
+SCENARIO("Half-space rasterization matches the incremental reference")
+{
+    GIVEN("Random triangles with non-integer vertex coordinates")
+    {
+        std::mt19937 engine{20240611};
+        std::uniform_real_distribution<double> coordinate{-8., 40.};
+        std::uniform_real_distribution<double> unit{0.1, 1.};
+
+        WHEN("They are rasterized by blocks, with and without a scissor.")
+        {
+            const Scissor scissor{3, 5, 17, 20};
+
+            THEN("The same pixels are covered once, with the same interpolated values.")
+            {
+                for (int triangleId = 0; triangleId != 200; ++triangleId)
+                {
+                    Triangle<WindowVertex> triangle{
+                        makeVertex(coordinate(engine), coordinate(engine), -unit(engine), 1. + unit(engine), math::hdr::Rgb_d{1., 0., 0.}),
+                        makeVertex(coordinate(engine), coordinate(engine), -unit(engine), 1. + unit(engine), math::hdr::Rgb_d{0., 1., 0.}),
+                        makeVertex(coordinate(engine), coordinate(engine), -unit(engine), 1. + unit(engine), math::hdr::Rgb_d{0., 0., 1.}),
+                    };
+
+                    FragmentRecorder reference;
+                    rasterizeIncremental(triangle, reference, gRecord);
+                    FragmentRecorder halfSpace;
+                    rasterizeHalfSpace(triangle, halfSpace, gRecord);
+                    FragmentRecorder scissored;
+                    rasterizeHalfSpace(triangle, scissored, gRecord, scissor);
+
+                    CHECK(halfSpace.emitted == (int)halfSpace.fragments.size());
+                    REQUIRE(halfSpace.fragments.size() == reference.fragments.size());
+                    for (const auto & [position, expected] : reference.fragments)
+                    {
+                        REQUIRE(halfSpace.fragments.count(position) == 1);
+                        const Fragment & fragment = halfSpace.fragments.at(position);
+                        CHECK(fragment.z == Approx(expected.z));
+                        CHECK(fragment.depthInverse == Approx(expected.depthInverse));
+                        CHECK(fragment.color.r() == Approx(expected.color.r()).margin(1e-9));
+                        CHECK(fragment.color.g() == Approx(expected.color.g()).margin(1e-9));
+                        CHECK(fragment.color.b() == Approx(expected.color.b()).margin(1e-9));
+                    }
+
+                    for (const auto & [position, fragment] : scissored.fragments)
+                    {
+                        CHECK(position.first >= scissor.xMin);
+                        CHECK(position.first <= scissor.xMax);
+                        CHECK(position.second >= scissor.yMin);
+                        CHECK(position.second <= scissor.yMax);
+                        // Exact same values whatever the scissor.
+                        CHECK(fragment.z == halfSpace.fragments.at(position).z);
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+SCENARIO("Hierarchical traversal of large triangles matches the incremental reference")
+{
+    GIVEN("Large triangles, covering many complete blocks")
+    {
+        std::mt19937 engine{20240612};
+        std::uniform_real_distribution<double> coordinate{-100., 300.};
+
+        WHEN("They are rasterized hierarchically, with a scissor that is not aligned on blocks.")
+        {
+            const Scissor scissor{-13, 7, 211, 190};
+
+            THEN("They cover the pixels of the reference that are inside the scissor.")
+            {
+                for (int triangleId = 0; triangleId != 10; ++triangleId)
+                {
+                    Triangle<WindowVertex> triangle{
+                        makeVertex(coordinate(engine), coordinate(engine), -0.2, 1., math::hdr::Rgb_d{1., 0., 0.}),
+                        makeVertex(coordinate(engine), coordinate(engine), -0.4, 2., math::hdr::Rgb_d{0., 1., 0.}),
+                        makeVertex(coordinate(engine), coordinate(engine), -0.6, 3., math::hdr::Rgb_d{0., 0., 1.}),
+                    };
+
+                    FragmentRecorder reference;
+                    rasterizeIncremental(triangle, reference, gRecord);
+                    FragmentRecorder halfSpace;
+                    rasterizeHalfSpace(triangle, halfSpace, gRecord, scissor);
+
+                    CHECK(halfSpace.emitted == (int)halfSpace.fragments.size());
+                    std::size_t expectedCount = 0;
+                    for (const auto & [position, expected] : reference.fragments)
+                    {
+                        if (position.first >= scissor.xMin && position.first <= scissor.xMax
+                            && position.second >= scissor.yMin && position.second <= scissor.yMax)
+                        {
+                            ++expectedCount;
+                            REQUIRE(halfSpace.fragments.count(position) == 1);
+                            CHECK(halfSpace.fragments.at(position).z == Approx(expected.z));
+                        }
+                    }
+                    CHECK(halfSpace.fragments.size() == expectedCount);
+                }
+            }
+        }
+    }
+}
+
+
+SCENARIO("Half-space rasterization covers shared edges exactly once")
+{
+    GIVEN("A quad split along its diagonal, with pixel centers exactly on all edges")
+    {
+        // The diagonal goes through pixel centers (2i, i), the outer edges of the quad are not tested.
+        WindowVertex v0 = makeVertex(0., 0., -0.5, 1., math::hdr::Rgb_d{1., 0., 0.});
+        WindowVertex v1 = makeVertex(16., 0., -0.5, 1., math::hdr::Rgb_d{1., 0., 0.});
+        WindowVertex v2 = makeVertex(16., 8., -0.5, 1., math::hdr::Rgb_d{1., 0., 0.});
+        WindowVertex v3 = makeVertex(0., 8., -0.5, 1., math::hdr::Rgb_d{1., 0., 0.});
+
+        Triangle<WindowVertex> lower{v0, v1, v2};
+        Triangle<WindowVertex> upper{v0, v2, v3};
+
+        WHEN("Both triangles are rasterized.")
+        {
+            FragmentRecorder recorder;
+            rasterizeHalfSpace(lower, recorder, gRecord);
+            rasterizeHalfSpace(upper, recorder, gRecord);
+
+            THEN("Each pixel of the diagonal is covered by a single triangle.")
+            {
+                CHECK(recorder.emitted == (int)recorder.fragments.size());
+                for (int i = 1; i != 8; ++i)
+                {
+                    CHECK(recorder.fragments.count({2 * i, i}) == 1);
+                }
+            }
+        }
+    }
+}
+
+
+SCENARIO("Fixed-point rasterization matches the half-space rasterization on the subpixel grid")
+{
+    GIVEN("Random triangles with vertices on the subpixel grid")
+    {
+        std::mt19937 engine{20240613};
+        std::uniform_int_distribution<int> subpixel{-8 * gSubpixelScale, 200 * gSubpixelScale};
+        auto coordinate = [&]()
+        {
+            return static_cast<double>(subpixel(engine)) / gSubpixelScale;
+        };
+
+        WHEN("They are rasterized with fixed-point and floating point edge functions.")
+        {
+            const Scissor scissor{3, 5, 170, 150};
+
+            THEN("The same pixels are covered, with the same interpolated values.")
+            {
+                for (int triangleId = 0; triangleId != 200; ++triangleId)
+                {
+                    Triangle<WindowVertex> triangle{
+                        makeVertex(coordinate(), coordinate(), -0.2, 1., math::hdr::Rgb_d{1., 0., 0.}),
+                        makeVertex(coordinate(), coordinate(), -0.4, 2., math::hdr::Rgb_d{0., 1., 0.}),
+                        makeVertex(coordinate(), coordinate(), -0.6, 3., math::hdr::Rgb_d{0., 0., 1.}),
+                    };
+
+                    FragmentRecorder halfSpace;
+                    rasterizeHalfSpace(triangle, halfSpace, gRecord, scissor);
+                    FragmentRecorder fixedPoint;
+                    rasterizeFixedPoint(triangle, fixedPoint, gRecord, scissor);
+
+                    CHECK(fixedPoint.emitted == (int)fixedPoint.fragments.size());
+                    REQUIRE(fixedPoint.fragments.size() == halfSpace.fragments.size());
+                    for (const auto & [position, expected] : halfSpace.fragments)
+                    {
+                        REQUIRE(fixedPoint.fragments.count(position) == 1);
+                        const Fragment & fragment = fixedPoint.fragments.at(position);
+                        CHECK(fragment.z == Approx(expected.z));
+                        CHECK(fragment.color.r() == Approx(expected.color.r()).margin(1e-9));
+                        CHECK(fragment.color.g() == Approx(expected.color.g()).margin(1e-9));
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+SCENARIO("Fixed-point rasterization is watertight")
+{
+    GIVEN("A fan of thin triangles around a center, with vertices off the subpixel grid")
+    {
+        constexpr int gSliceCount = 97;
+        const double radius = 60.3;
+        const WindowVertex center = makeVertex(64.1234567, 63.7654321, -0.5, 1., math::hdr::Rgb_d{1., 0., 0.});
+        auto rim = [&](int aSlice)
+        {
+            const double angle = 2 * std::numbers::pi * (aSlice % gSliceCount) / gSliceCount;
+            return makeVertex(center.pos.x() + radius * std::cos(angle),
+                              center.pos.y() + radius * std::sin(angle),
+                              -0.5, 1., math::hdr::Rgb_d{1., 0., 0.});
+        };
+
+        WHEN("All the triangles of the fan are rasterized.")
+        {
+            FragmentRecorder recorder;
+            for (int slice = 0; slice != gSliceCount; ++slice)
+            {
+                rasterizeFixedPoint(Triangle<WindowVertex>{center, rim(slice), rim(slice + 1)}, recorder, gRecord);
+            }
+
+            THEN("No pixel is covered twice, and there is no hole inside the fan.")
+            {
+                CHECK(recorder.emitted == (int)recorder.fragments.size());
+                // The disc of radius 59 is entirely inside the polygon.
+                for (int y = 0; y != 128; ++y)
+                {
+                    for (int x = 0; x != 128; ++x)
+                    {
+                        if (std::hypot(x - center.pos.x(), y - center.pos.y()) < 59.)
+                        {
+                            CHECK(recorder.fragments.count({x, y}) == 1);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+SCENARIO("Scanline rasterization matches the fixed-point rasterization")
+{
+    GIVEN("Random slivers, and random triangles with axis aligned edges")
+    {
+        std::mt19937 engine{20240725};
+        std::uniform_real_distribution<double> coordinate{-8., 120.};
+        std::uniform_real_distribution<double> thickness{-1.5, 1.5};
+        std::uniform_real_distribution<double> unit{0.1, 1.};
+
+        auto makeSliver = [&]()
+        {
+            const double ax = coordinate(engine), ay = coordinate(engine);
+            const double bx = coordinate(engine), by = coordinate(engine);
+            const double t = unit(engine);
+            return Triangle<WindowVertex>{
+                makeVertex(ax, ay, -unit(engine), 1., math::hdr::Rgb_d{1., 0., 0.}),
+                makeVertex(bx, by, -unit(engine), 2., math::hdr::Rgb_d{0., 1., 0.}),
+                makeVertex(ax + t * (bx - ax) + thickness(engine), ay + t * (by - ay) + thickness(engine),
+                           -unit(engine), 3., math::hdr::Rgb_d{0., 0., 1.}),
+            };
+        };
+
+        auto makeAxisAligned = [&]()
+        {
+            // Integer coordinates put pixel centers exactly on the edges.
+            const double x = std::floor(coordinate(engine)), y = std::floor(coordinate(engine));
+            const double width = std::floor(coordinate(engine) / 4.) - 5.;
+            const double height = std::floor(coordinate(engine) / 4.) - 5.;
+            return Triangle<WindowVertex>{
+                makeVertex(x, y, -unit(engine), 1., math::hdr::Rgb_d{1., 0., 0.}),
+                makeVertex(x + width, y, -unit(engine), 2., math::hdr::Rgb_d{0., 1., 0.}),
+                makeVertex(x, y + height, -unit(engine), 3., math::hdr::Rgb_d{0., 0., 1.}),
+            };
+        };
+
+        WHEN("They are rasterized by spans and by blocks, with and without a scissor.")
+        {
+            const Scissor scissor{3, 5, 70, 90};
+
+            THEN("The same pixels are covered once, with exactly the same interpolated values.")
+            {
+                for (int triangleId = 0; triangleId != 400; ++triangleId)
+                {
+                    const Triangle<WindowVertex> triangle = (triangleId % 2 == 0) ? makeSliver() : makeAxisAligned();
+                    if (triangleId % 2 == 0)
+                    {
+                        CHECK(getFillRatio(triangle) <= 0.5);
+                    }
+
+                    for (const Scissor & bounds : {Scissor{}, scissor})
+                    {
+                        FragmentRecorder blocks;
+                        rasterizeFixedPoint(triangle, blocks, gRecord, bounds);
+                        FragmentRecorder spans;
+                        rasterizeScanline(triangle, spans, gRecord, bounds);
+
+                        CHECK(spans.emitted == (int)spans.fragments.size());
+                        REQUIRE(spans.fragments.size() == blocks.fragments.size());
+                        for (const auto & [position, expected] : blocks.fragments)
+                        {
+                            REQUIRE(spans.fragments.count(position) == 1);
+                            const Fragment & fragment = spans.fragments.at(position);
+                            CHECK(fragment.z == expected.z);
+                            CHECK(fragment.depthInverse == expected.depthInverse);
+                            CHECK(fragment.color == expected.color);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+SCENARIO("Micro triangle rasterization matches the fixed-point rasterization")
+{
+    GIVEN("Random triangles of a few pixels")
+    {
+        std::mt19937 engine{20240801};
+        std::uniform_real_distribution<double> origin{-2., 20.};
+        std::uniform_real_distribution<double> offset{-2.5, 2.5};
+        std::uniform_real_distribution<double> unit{0.1, 1.};
+
+        WHEN("They are rasterized by the micro triangle path, with and without a scissor.")
+        {
+            const Scissor scissor{3, 5, 15, 12};
+
+            THEN("Micro triangles cover the same pixels, with exactly the same interpolated values.")
+            {
+                int microCount = 0;
+                for (int triangleId = 0; triangleId != 2000; ++triangleId)
+                {
+                    const double x = origin(engine);
+                    const double y = origin(engine);
+                    const Triangle<WindowVertex> triangle{
+                        makeVertex(x, y, -unit(engine), 1., math::hdr::Rgb_d{1., 0., 0.}),
+                        makeVertex(x + offset(engine), y + offset(engine), -unit(engine), 2., math::hdr::Rgb_d{0., 1., 0.}),
+                        makeVertex(x + offset(engine), y + offset(engine), -unit(engine), 3., math::hdr::Rgb_d{0., 0., 1.}),
+                    };
+
+                    for (const Scissor & bounds : {Scissor{}, scissor})
+                    {
+                        FragmentRecorder blocks;
+                        rasterizeFixedPoint(triangle, blocks, gRecord, bounds);
+                        FragmentRecorder micro;
+                        if (!rasterizeMicroTriangle(triangle, micro, gRecord, bounds))
+                        {
+                            CHECK(micro.emitted == 0);
+                            continue;
+                        }
+                        ++microCount;
+
+                        CHECK(micro.emitted == (int)micro.fragments.size());
+                        REQUIRE(micro.fragments.size() == blocks.fragments.size());
+                        for (const auto & [position, expected] : blocks.fragments)
+                        {
+                            REQUIRE(micro.fragments.count(position) == 1);
+                            const Fragment & fragment = micro.fragments.at(position);
+                            CHECK(fragment.z == expected.z);
+                            CHECK(fragment.depthInverse == expected.depthInverse);
+                            CHECK(fragment.color == expected.color);
+                        }
+                    }
+                }
+                // Both micro and larger triangles are generated.
+                CHECK(microCount > 1000);
+                CHECK(microCount < 4000);
+            }
+        }
+    }
+
+    GIVEN("A triangle larger than micro")
+    {
+        const Triangle<WindowVertex> triangle{
+            makeVertex(0., 0., -0.5, 1., math::hdr::Rgb_d{1., 0., 0.}),
+            makeVertex(3., 0., -0.5, 1., math::hdr::Rgb_d{0., 1., 0.}),
+            makeVertex(0., 1., -0.5, 1., math::hdr::Rgb_d{0., 0., 1.}),
+        };
+
+        THEN("It is not rasterized by the micro triangle path.")
+        {
+            FragmentRecorder micro;
+            CHECK_FALSE(rasterizeMicroTriangle(triangle, micro, gRecord));
+            CHECK(micro.emitted == 0);
+        }
+    }
+}
+
+
+SCENARIO("Quads split along a diagonal are covered exactly once by each rasterizer")
+{
+    GIVEN("Quads split along a diagonal going through the offscreen point (-1, -1)")
+    {
+        // The large quads (e.g. floors and sky quads) are traversed by complete blocks.
+        std::vector<std::array<double, 2>> quads{gDiagonalQuads.begin(), gDiagonalQuads.end()};
+        quads.push_back({-0.4, 64.});
+        quads.push_back({-0.4, 200.4});
+
+        WHEN("They are rasterized, with and without a scissor that is not aligned on blocks.")
+        {
+            const Scissor scissor{-13, 7, 211, 190};
+
+            THEN("Each pixel inside the quad is covered exactly once, including the diagonal.")
+            {
+                for (const auto & [name, rasterize] : gRasterizers)
+                {
+                    INFO("Rasterizer: " << name);
+                    for (const auto & [min, max] : quads)
+                    {
+                        for (const Scissor & bounds : {Scissor{}, scissor})
+                        {
+                            checkDiagonalCoverage(
+                                rasterizeDiagonalQuad(min, max,
+                                    [&](const auto & aTriangle, FragmentRecorder & aRecorder)
+                                    {
+                                        rasterize(aTriangle, aRecorder, bounds);
+                                    }),
+                                min, max, bounds);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+SCENARIO("Multisample rasterization covers shared edges exactly once per sample")
+{
+    GIVEN("The diagonal quads, with 2 samples of each diagonal pixel exactly on the diagonal")
+    {
+        // With 2 samples, the samples (x + 0.25, y + 0.25) and (x - 0.25, y - 0.25) of the pixels (i, i)
+        // are exactly on the y = x diagonal.
+        constexpr int gSamples = 2;
+        constexpr auto pattern = getSamplePattern<gSamples>();
+
+        // Coverage mask by pixel position.
+        using MaskRecorder = std::map<std::pair<int, int>, std::uint32_t>;
+        auto recordMask = [](MaskRecorder & aRecorder,
+                             math::Position<2, int> aPosition,
+                             const SampleCoverage<gSamples> & aCoverage,
+                             double, double,
+                             const DeferredVaryings<WindowVertex> &)
+        {
+            aRecorder[{aPosition.x(), aPosition.y()}] |= aCoverage.mask;
+        };
+
+        THEN("Each sample inside the quad is covered by exactly one of the triangles.")
+        {
+            for (const auto & [min, max] : gDiagonalQuads)
+            {
+                const auto [lowerTriangle, upperTriangle] = makeDiagonalQuad(min, max);
+                MaskRecorder lower;
+                rasterizeMultisample<gSamples>(lowerTriangle, lower, recordMask);
+                MaskRecorder upper;
+                rasterizeMultisample<gSamples>(upperTriangle, upper, recordMask);
+
+                for (int y = (int)std::floor(min); y <= (int)std::ceil(max); ++y)
+                {
+                    for (int x = (int)std::floor(min); x <= (int)std::ceil(max); ++x)
+                    {
+                        std::uint32_t inside = 0;
+                        for (int sample = 0; sample != gSamples; ++sample)
+                        {
+                            const double sampleX = x + pattern[sample][0] / 16.;
+                            const double sampleY = y + pattern[sample][1] / 16.;
+                            if (sampleX > min && sampleX < max && sampleY > min && sampleY < max)
+                            {
+                                inside |= 1u << sample;
+                            }
+                        }
+                        const std::uint32_t lowerMask = lower.contains({x, y}) ? lower.at({x, y}) : 0;
+                        const std::uint32_t upperMask = upper.contains({x, y}) ? upper.at({x, y}) : 0;
+                        CHECK((lowerMask & upperMask) == 0);
+                        CHECK(((lowerMask | upperMask) & inside) == inside);
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+SCENARIO("Packed attributes are decoded for interpolation")
+{
+    GIVEN("Random unit normals")
+    {
+        std::mt19937 engine{20240704};
+        std::uniform_real_distribution<float> component{-1.f, 1.f};
+
+        THEN("Packing them loses less than the 10 bits quantization step on each component.")
+        {
+            for (int normalId = 0; normalId != 1000; ++normalId)
+            {
+                math::Vec<3, float> normal{component(engine), component(engine), component(engine)};
+                normal = normal / std::sqrt(normal.dot(normal));
+                const math::Vec<3, float> unpacked = PackedNormal{normal}.unpack();
+                for (std::size_t axis = 0; axis != 3; ++axis)
+                {
+                    CHECK(unpacked[axis] == Approx(normal[axis]).margin(0.5 / 511 + 1e-6));
+                }
+            }
+        }
+    }
+
+    GIVEN("Varyings made of a packed normal and an 8 bits color")
+    {
+        const PackedVaryings a{PackedNormal{{1.f, 0.f, 0.f}}, math::sdr::Rgb{0, 0, 255}};
+        const PackedVaryings b{PackedNormal{{0.f, -1.f, 0.f}}, math::sdr::Rgb{255, 0, 0}};
+
+        THEN("They are interpolated as floating point values, then packed back.")
+        {
+            const PackedVaryings middle = interpolateAttributes<PackedVaryings>({{0.5, a}, {0.5, b}});
+            const math::Vec<3, float> normal = middle.normal.unpack();
+            CHECK(normal.x() == Approx(0.5).margin(1. / 511));
+            CHECK(normal.y() == Approx(-0.5).margin(1. / 511));
+            CHECK(normal.z() == 0.f);
+            CHECK(middle.color == math::sdr::Rgb{128, 0, 128});
+
+            CHECK(interpolateAttributes<PackedVaryings>({{1., a}, {0., b}}).normal == a.normal);
+        }
+    }
+}
+
+
+SCENARIO("Triangle setup interpolates varyings as perspective correct barycentric interpolation")
+{
+    GIVEN("Random triangles with varying depths")
+    {
+        std::mt19937 engine{20240718};
+        std::uniform_real_distribution<double> coordinate{-8., 40.};
+        std::uniform_real_distribution<double> unit{0.1, 1.};
+
+        THEN("The attribute planes give the values of the barycentric reference at each pixel center.")
+        {
+            for (int triangleId = 0; triangleId != 100; ++triangleId)
+            {
+                const Triangle<WindowVertex> triangle{
+                    makeVertex(coordinate(engine), coordinate(engine), -unit(engine), 1. + 4 * unit(engine), math::hdr::Rgb_d{1., 0., 0.}),
+                    makeVertex(coordinate(engine), coordinate(engine), -unit(engine), 1. + 4 * unit(engine), math::hdr::Rgb_d{0., 1., 0.}),
+                    makeVertex(coordinate(engine), coordinate(engine), -unit(engine), 1. + 4 * unit(engine), math::hdr::Rgb_d{0., 0., 1.}),
+                };
+                const InterpolationSetup<WindowVertex> setup{triangle};
+
+                auto check = [&](FragmentRecorder &,
+                                 math::Position<2, int> aPosition,
+                                 double /*aZ*/,
+                                 double aDepthInverse,
+                                 const DeferredVaryings<WindowVertex> & aVaryings)
+                {
+                    const HPos center{(double)aPosition.x(), (double)aPosition.y(), 0., 1.};
+                    const double alpha = triangle.getFa()(center) / triangle.getFa()(triangle.a);
+                    const double beta  = triangle.getFb()(center) / triangle.getFb()(triangle.b);
+                    const double gamma = triangle.getFc()(center) / triangle.getFc()(triangle.c);
+                    const ColorVaryings expected = interpolateAttributes<ColorVaryings>({
+                        {alpha * triangle.a.depthInverse / aDepthInverse, triangle.a.varyings},
+                        {beta  * triangle.b.depthInverse / aDepthInverse, triangle.b.varyings},
+                        {gamma * triangle.c.depthInverse / aDepthInverse, triangle.c.varyings},
+                    });
+
+                    const ColorVaryings interpolated = aVaryings.interpolate();
+                    CHECK(interpolated.color.r() == Approx(expected.color.r()).margin(1e-9));
+                    CHECK(interpolated.color.g() == Approx(expected.color.g()).margin(1e-9));
+                    CHECK(interpolated.color.b() == Approx(expected.color.b()).margin(1e-9));
+                    CHECK(setup.interpolate(aPosition, aDepthInverse).color == interpolated.color);
+                };
+
+                FragmentRecorder unused;
+                rasterizeIncremental(triangle, unused, check);
+            }
+        }
+    }
+}
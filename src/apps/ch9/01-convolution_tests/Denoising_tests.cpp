@@ -0,0 +1,129 @@
+#include "Convolution.h"
+
+#include <focg-common/Denoising.h>
+
+#include <catch2/catch_approx.hpp>
+#include <catch2/catch_test_macros.hpp>
+
+#include <cmath>
+
+
+using namespace ad;
+
+using Catch::Approx;
+
+
+namespace {
+
+
+    focg::GuideBuffers makeUniformGuides(math::Size<2, int> aResolution)
+    {
+        focg::GuideBuffers guides{aResolution};
+        std::fill(guides.normals.begin(), guides.normals.end(), math::Vec<3, float>{0.f, 0.f, 1.f});
+        std::fill(guides.depths.begin(), guides.depths.end(), 10.f);
+        // White albedo, so demodulation leaves the color unchanged.
+        std::fill(guides.albedos.begin(), guides.albedos.end(), math::hdr::Rgb_f{1.f, 1.f, 1.f});
+        return guides;
+    }
+
+
+    // Deterministic noise in [-0.5, 0.5]
+    float noise(int aX, int aY)
+    {
+        return static_cast<float>(std::sin(aX * 12.9898 + aY * 78.233) * 43758.5453
+                                  - std::floor(std::sin(aX * 12.9898 + aY * 78.233) * 43758.5453)) - 0.5f;
+    }
+
+
+} // anonymous namespace
+
+
+SCENARIO("À-trous denoising without edge-stopping")
+{
+    GIVEN("A noisy image and uniform guides")
+    {
+        math::Size<2, int> resolution{12, 10};
+        auto image = arte::Image<math::hdr::Rgb_f>::makeUninitialized(resolution);
+        for (int y = 0; y != resolution.height(); ++y)
+        {
+            for (int x = 0; x != resolution.width(); ++x)
+            {
+                float value = 0.5f + noise(x, y);
+                image.at(x, y) = math::hdr::Rgb_f{value, 1.f - value, 0.25f * value};
+            }
+        }
+        focg::GuideBuffers guides = makeUniformGuides(resolution);
+
+        WHEN("A single iteration is applied, with all edge-stopping functions disabled.")
+        {
+            focg::DenoiserParameters parameters{
+                .iterations = 1,
+                .sigmaColor = focg::DenoiserParameters::gDisabled,
+                .sigmaNormal = focg::DenoiserParameters::gDisabled,
+                .sigmaDepth = focg::DenoiserParameters::gDisabled,
+                .sigmaAlbedo = focg::DenoiserParameters::gDisabled,
+                .tileSize = 4,
+            };
+            arte::Image<math::hdr::Rgb_f> denoised = focg::denoiseAtrous(image, guides, parameters);
+
+            THEN("It is the separable filtering by the scaling function.")
+            {
+                arte::Image<math::hdr::Rgb_f> filtered = focg::filterSeparable2D(focg::gB3Spline, image);
+                // Border behaviour is not the same between the two.
+                const int r = static_cast<int>(focg::gB3Spline.size() / 2);
+                for (int y = r; y != resolution.height() - r; ++y)
+                {
+                    for (int x = r; x != resolution.width() - r; ++x)
+                    {
+                        CHECK(denoised.at(x, y).r() == Approx(filtered.at(x, y).r()).epsilon(1e-5));
+                        CHECK(denoised.at(x, y).g() == Approx(filtered.at(x, y).g()).epsilon(1e-5));
+                        CHECK(denoised.at(x, y).b() == Approx(filtered.at(x, y).b()).epsilon(1e-5));
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+SCENARIO("À-trous denoising preserves geometric edges")
+{
+    GIVEN("A noisy image of two surfaces with different normals")
+    {
+        math::Size<2, int> resolution{64, 64};
+        const int edge = resolution.width() / 2;
+        const float amplitude = 0.1f;
+
+        auto image = arte::Image<math::hdr::Rgb_f>::makeUninitialized(resolution);
+        focg::GuideBuffers guides = makeUniformGuides(resolution);
+        for (int y = 0; y != resolution.height(); ++y)
+        {
+            for (int x = 0; x != resolution.width(); ++x)
+            {
+                float value = (x < edge ? 0.2f : 0.8f) + amplitude * noise(x, y);
+                image.at(x, y) = math::hdr::Rgb_f{value, value, value};
+                if (x >= edge)
+                {
+                    guides.normals[guides.index(x, y)] = math::Vec<3, float>{1.f, 0.f, 0.f};
+                }
+            }
+        }
+
+        WHEN("It is denoised.")
+        {
+            arte::Image<math::hdr::Rgb_f> denoised = focg::denoiseAtrous(image, guides);
+
+            THEN("The noise is reduced, and each side keeps its value up to the edge.")
+            {
+                for (int y = 0; y != resolution.height(); ++y)
+                {
+                    for (int x = 0; x != resolution.width(); ++x)
+                    {
+                        float expected = x < edge ? 0.2f : 0.8f;
+                        CHECK(std::abs(denoised.at(x, y).r() - expected) < amplitude / 4);
+                    }
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,89 @@
+#include <focg-common/Tonemapping.h>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+
+using namespace ad;
+
+
+SCENARIO("Tonemapping by bands")
+{
+    GIVEN("A smooth gradient of radiance values")
+    {
+        math::Size<2, int> resolution{13, 11};
+        auto image = arte::Image<math::hdr::Rgb_f>::makeUninitialized(resolution);
+        for (int y = 0; y != resolution.height(); ++y)
+        {
+            for (int x = 0; x != resolution.width(); ++x)
+            {
+                const float value = 0.013f * x + 0.11f * y;
+                image.at(x, y) = math::hdr::Rgb_f{value, 1.f - 0.5f * value, 0.3f * value};
+            }
+        }
+
+        WHEN("It is tonemapped by bands of 3 rows (not a multiple of the dithering period), with dithering.")
+        {
+            const focg::Tonemapping parameters{0.5, focg::ToneOperator::Reinhard, true};
+            const arte::Image<math::sdr::Rgb> expected = focg::tonemap(image, parameters);
+
+            THEN("Each band has the pixels of the complete image.")
+            {
+                for (int firstRow = 0; firstRow < resolution.height(); firstRow += 3)
+                {
+                    const int rowCount = std::min(3, resolution.height() - firstRow);
+                    std::vector<math::hdr::Rgb_d> band;
+                    for (int y = firstRow; y != firstRow + rowCount; ++y)
+                    {
+                        for (int x = 0; x != resolution.width(); ++x)
+                        {
+                            const math::hdr::Rgb_f & pixel = image.at(x, y);
+                            band.push_back(math::hdr::Rgb_d{pixel.r(), pixel.g(), pixel.b()});
+                        }
+                    }
+
+                    const arte::Image<math::sdr::Rgb> quantized =
+                        focg::tonemapBand(band, resolution.width(), firstRow, parameters);
+                    REQUIRE(quantized.height() == rowCount);
+                    for (int y = 0; y != rowCount; ++y)
+                    {
+                        for (int x = 0; x != resolution.width(); ++x)
+                        {
+                            CHECK(quantized.at(x, y) == expected.at(x, firstRow + y));
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+SCENARIO("Tonemapping invalid radiance sums")
+{
+    GIVEN("A framebuffer with a NaN sample in a channel of a pixel")
+    {
+        focg::HdrFramebuffer framebuffer{{4, 2}};
+        framebuffer.accumulate(1, 0, math::hdr::Rgb_d{std::numeric_limits<double>::quiet_NaN(), 0.5, 1.});
+        framebuffer.accumulate(2, 1, math::hdr::Rgb_d{0.5, 0.5, 0.5});
+
+        THEN("The NaN channel is quantized to 0, whatever the operator, and the other pixels are unaffected.")
+        {
+            for (focg::ToneOperator toneOperator : {focg::ToneOperator::Clamp, focg::ToneOperator::Reinhard})
+            {
+                for (bool dithering : {false, true})
+                {
+                    const arte::Image<math::sdr::Rgb> image =
+                        focg::tonemap(framebuffer, {0., toneOperator, dithering});
+                    CHECK(image.at(1, 0).r() == 0);
+                    CHECK(image.at(1, 0).b() > 0);
+                    CHECK(image.at(2, 1).r() > 0);
+                    CHECK(image.at(0, 0) == math::sdr::Rgb{0, 0, 0});
+                }
+            }
+        }
+    }
+}
@@ -2,6 +2,8 @@
 #include "../01-convolution_tests/Filters.h"
 #include "../01-convolution_tests/Reconstruction.h"
 
+#include <focg-common/Tonemapping.h>
+
 #include <arte/Image.h>
 
 #include <cstdlib>
@@ -25,7 +27,7 @@ void filter(std::filesystem::path aImagePath)
         auto filtered = focg::filterSeparable2D(impulse, image);
 
         // Save in working dir
-        tonemap(filtered).saveFile((stem.string() + "_identity.ppm"));
+        focg::tonemap(filtered).saveFile((stem.string() + "_identity.ppm"));
     }
 
     {
@@ -34,7 +36,7 @@ void filter(std::filesystem::path aImagePath)
         auto unscaledGaussian = focg::discreteGaussian<gScale * 3>(1.0 * gScale);
         auto filtered = focg::filterSeparable2D(unscaledGaussian, image);
 
-        tonemap(filtered).saveFile((stem.string() + "_gaussian_unscaled.ppm"));
+        focg::tonemap(filtered).saveFile((stem.string() + "_gaussian_unscaled.ppm"));
 
         // trimmed Gaussian, scaled by s
         // Note: radius of support is s*r because:
@@ -42,7 +44,7 @@ void filter(std::filesystem::path aImagePath)
         auto scaledGaussian = focg::discreteGaussian<gScale * 3>(1.0, (double)gScale);
         filtered = focg::filterSeparable2D(scaledGaussian, image);
 
-        tonemap(filtered).saveFile((stem.string() + "_gaussian_scaled.ppm"));
+        focg::tonemap(filtered).saveFile((stem.string() + "_gaussian_scaled.ppm"));
     }
 
     {
@@ -50,7 +52,7 @@ void filter(std::filesystem::path aImagePath)
         auto sharpen = focg::discreteSharpen<3>(alpha);
         auto filtered = focg::filterSeparable2D(sharpen, image);
 
-        tonemap(filtered).saveFile((stem.string() + "_sharpen.ppm"));
+        focg::tonemap(filtered).saveFile((stem.string() + "_sharpen.ppm"));
     }
 
     {
@@ -63,12 +65,12 @@ void filter(std::filesystem::path aImagePath)
 
             focg::resampleSeparable2D(image, resampled, filter);
 
-            tonemap(resampled).saveFile((stem.string() + "_downscale_filter.ppm"));
+            focg::tonemap(resampled).saveFile((stem.string() + "_downscale_filter.ppm"));
         }
 
         {
             focg::pointResample2D(image, resampled);
-            tonemap(resampled).saveFile((stem.string() + "_downscale_closest.ppm"));
+            focg::tonemap(resampled).saveFile((stem.string() + "_downscale_closest.ppm"));
         }
     }
 
@@ -85,7 +87,7 @@ void filter(std::filesystem::path aImagePath)
 
             focg::resampleSeparable2D(image, resampled, filter);
 
-            tonemap(resampled).saveFile((stem.string() + "_upscale_filter_ripples.ppm"));
+            focg::tonemap(resampled).saveFile((stem.string() + "_upscale_filter_ripples.ppm"));
         }
 
         {
@@ -97,12 +99,12 @@ void filter(std::filesystem::path aImagePath)
 
             focg::resampleSeparable2D(image, resampled, filter);
 
-            tonemap(resampled).saveFile((stem.string() + "_upscale_filter_catmullrom.ppm"));
+            focg::tonemap(resampled).saveFile((stem.string() + "_upscale_filter_catmullrom.ppm"));
         }
 
         {
             focg::pointResample2D(image, resampled);
-            tonemap(resampled).saveFile((stem.string() + "_upscale_closest.ppm"));
+            focg::tonemap(resampled).saveFile((stem.string() + "_upscale_closest.ppm"));
         }
     }
 }
@@ -133,12 +135,12 @@ void debuggrid()
                 1.,
             };
             focg::resampleSeparable2D(image, resampled, filter);
-            tonemap(resampled).saveFile(("dbg_upscale_filter_gaussian.ppm"));
+            focg::tonemap(resampled).saveFile(("dbg_upscale_filter_gaussian.ppm"));
         }
 
         {
             focg::pointResample2D(image, resampled);
-            tonemap(resampled).saveFile(("dbg_upscale_closest.ppm"));
+            focg::tonemap(resampled).saveFile(("dbg_upscale_closest.ppm"));
         }
     }
 }
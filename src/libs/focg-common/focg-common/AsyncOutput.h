@@ -0,0 +1,218 @@
+#pragma once
+
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <cassert>
+#include <cstddef>
+
+
+namespace ad {
+namespace focg {
+
+
+// Notes:
+// Encoding and writing a frame (e.g. a PPM file) does not have to stall the rendering of the next frames.
+// AsyncFrameOutput owns a fixed set of frames, used in turn as render targets:
+// once rendered, a frame is queued and written by a background thread, then becomes available again.
+// The number of frames bounds the frames in flight: with 2 frames (double buffering), frame N+1
+// is rendered while frame N is written; with 3 (triple buffering), a frame can also wait in the queue.
+// When all frames are in flight, the back-pressure policy decides between waiting or dropping a frame.
+
+
+enum class Backpressure
+{
+    Block,      // acquire() waits until a queued frame is written, no frame is ever lost.
+    DropOldest, // acquire() reuses the oldest queued frame, which is then never written (e.g. live output).
+};
+
+
+/// \brief Writes frames on a background thread, while the next frames are rendered.
+template <class T_frame>
+class AsyncFrameOutput
+{
+public:
+    using Writer = std::function<void(T_frame &)>;
+
+    /// \param aFrames The frames to render into, in turn. There must be at least 2.
+    explicit AsyncFrameOutput(std::vector<T_frame> aFrames, Backpressure aBackpressure = Backpressure::Block);
+
+    /// \brief Writes all queued frames before returning.
+    ~AsyncFrameOutput();
+
+    AsyncFrameOutput(const AsyncFrameOutput &) = delete;
+    AsyncFrameOutput & operator=(const AsyncFrameOutput &) = delete;
+
+    /// \brief Return a frame that is neither queued nor being written, to be rendered into.
+    /// \note Rethrows the first exception thrown by a writer.
+    T_frame & acquire();
+
+    /// \brief Queue aFrame, which must have been acquired, to be written by aWriter on the background thread.
+    void submit(T_frame & aFrame, Writer aWriter);
+
+    /// \brief Wait until all submitted frames are written.
+    /// \note Rethrows the first exception thrown by a writer.
+    void finish();
+
+    std::size_t getDroppedCount() const;
+
+private:
+    void run();
+
+    // Must be called with mMutex locked.
+    void rethrowIfFailed();
+
+    std::vector<T_frame> mFrames;
+    Backpressure mBackpressure;
+    // Indices of the frames available to acquire().
+    std::vector<std::size_t> mAvailable;
+    std::deque<std::pair<std::size_t, Writer>> mQueue;
+    bool mWriting{false};
+    bool mStopping{false};
+    std::size_t mDroppedCount{0};
+    std::exception_ptr mException;
+    mutable std::mutex mMutex;
+    std::condition_variable mChanged;
+    // Started last, once all other members are initialized.
+    std::thread mWriterThread;
+};
+
+
+//
+// Implementations
+//
+template <class T_frame>
+AsyncFrameOutput<T_frame>::AsyncFrameOutput(std::vector<T_frame> aFrames, Backpressure aBackpressure) :
+    mFrames{std::move(aFrames)},
+    mBackpressure{aBackpressure},
+    mWriterThread{[this](){ run(); }}
+{
+    assert(mFrames.size() >= 2);
+    std::scoped_lock lock{mMutex};
+    for (std::size_t frame = mFrames.size(); frame != 0; --frame)
+    {
+        mAvailable.push_back(frame - 1);
+    }
+}
+
+
+template <class T_frame>
+AsyncFrameOutput<T_frame>::~AsyncFrameOutput()
+{
+    {
+        std::scoped_lock lock{mMutex};
+        mStopping = true;
+    }
+    mChanged.notify_all();
+    mWriterThread.join();
+}
+
+
+template <class T_frame>
+T_frame & AsyncFrameOutput<T_frame>::acquire()
+{
+    std::unique_lock lock{mMutex};
+    rethrowIfFailed();
+    if (mBackpressure == Backpressure::DropOldest && mAvailable.empty() && !mQueue.empty())
+    {
+        mAvailable.push_back(mQueue.front().first);
+        mQueue.pop_front();
+        ++mDroppedCount;
+    }
+    mChanged.wait(lock, [this](){ return !mAvailable.empty() || mException; });
+    rethrowIfFailed();
+
+    const std::size_t frame = mAvailable.back();
+    mAvailable.pop_back();
+    return mFrames[frame];
+}
+
+
+template <class T_frame>
+void AsyncFrameOutput<T_frame>::submit(T_frame & aFrame, Writer aWriter)
+{
+    assert(&aFrame >= mFrames.data() && &aFrame < mFrames.data() + mFrames.size());
+    {
+        std::scoped_lock lock{mMutex};
+        mQueue.emplace_back(static_cast<std::size_t>(&aFrame - mFrames.data()), std::move(aWriter));
+    }
+    mChanged.notify_all();
+}
+
+
+template <class T_frame>
+void AsyncFrameOutput<T_frame>::finish()
+{
+    std::unique_lock lock{mMutex};
+    mChanged.wait(lock, [this](){ return mQueue.empty() && !mWriting; });
+    rethrowIfFailed();
+}
+
+
+template <class T_frame>
+std::size_t AsyncFrameOutput<T_frame>::getDroppedCount() const
+{
+    std::scoped_lock lock{mMutex};
+    return mDroppedCount;
+}
+
+
+template <class T_frame>
+void AsyncFrameOutput<T_frame>::run()
+{
+    std::unique_lock lock{mMutex};
+    for (;;)
+    {
+        mChanged.wait(lock, [this](){ return !mQueue.empty() || mStopping; });
+        if (mQueue.empty())
+        {
+            return;
+        }
+
+        auto [frame, writer] = std::move(mQueue.front());
+        mQueue.pop_front();
+        mWriting = true;
+
+        // After a failure, the remaining frames are discarded.
+        if (!mException)
+        {
+            std::exception_ptr exception;
+            lock.unlock();
+            try
+            {
+                writer(mFrames[frame]);
+            }
+            catch (...)
+            {
+                exception = std::current_exception();
+            }
+            lock.lock();
+            mException = exception;
+        }
+
+        mWriting = false;
+        mAvailable.push_back(frame);
+        mChanged.notify_all();
+    }
+}
+
+
+template <class T_frame>
+void AsyncFrameOutput<T_frame>::rethrowIfFailed()
+{
+    if (mException)
+    {
+        std::rethrow_exception(mException);
+    }
+}
+
+
+} // namespace focg
+} // namespace ad
@@ -0,0 +1,239 @@
+#pragma once
+
+
+#include "Parallel.h"
+
+#include <arte/Image.h>
+
+#include <math/Color.h>
+#include <math/Vector.h>
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <vector>
+
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+
+
+namespace ad {
+namespace focg {
+
+
+// Notes:
+// Edge-avoiding à-trous wavelet filter.
+// see: https://jo.dreggn.org/home/2010_atrous.pdf (Edge-Avoiding À-Trous Wavelet Transform for fast
+//      Global Illumination Filtering, Dammertz et al.)
+//
+// Each iteration convolves with the same small filter, whose taps are spread 2^iteration pixels apart,
+// so the footprint grows exponentially at a constant cost per pixel.
+// The filter weights are modulated by the similarity of the guide buffers (normal, depth, albedo)
+// and of the color itself, which prevents blurring across geometric and texture edges.
+//
+// Noise (e.g. from stochastic soft shadows) is mostly in the illumination, not in the texture:
+// color is divided by albedo before filtering, then modulated back.
+
+
+/// \brief Per-pixel features of the primary hit, guiding the denoiser.
+struct GuideBuffers
+{
+    explicit GuideBuffers(math::Size<2, int> aResolution) :
+        resolution{aResolution},
+        normals((std::size_t)aResolution.area(), math::Vec<3, float>{0.f, 0.f, 0.f}),
+        depths((std::size_t)aResolution.area(), gBackgroundDepth),
+        albedos((std::size_t)aResolution.area(), math::hdr::Rgb_f{0.f, 0.f, 0.f})
+    {}
+
+    std::size_t index(int aX, int aY) const
+    { return aX + (std::size_t)aY * resolution.width(); }
+
+    math::Size<2, int> resolution;
+    std::vector<math::Vec<3, float>> normals;
+    std::vector<float> depths;
+    std::vector<math::hdr::Rgb_f> albedos;
+
+    // Finite, so depth differences never produce a NaN.
+    static constexpr float gBackgroundDepth = std::numeric_limits<float>::max();
+};
+
+
+struct DenoiserParameters
+{
+    static constexpr double gDisabled = std::numeric_limits<double>::infinity();
+
+    int iterations{5};
+    // Standard deviations of the edge-stopping functions, gDisabled ignores the corresponding feature.
+    double sigmaColor{0.5};  // halved at each iteration, as the color gets smoother.
+    double sigmaNormal{0.3};
+    double sigmaDepth{1.};   // per pixel of tap spacing.
+    double sigmaAlbedo{0.1};
+    int tileSize{32};
+};
+
+
+/// \brief B3-spline, the à-trous scaling function from Dammertz et al.
+constexpr std::array<double, 5> gB3Spline{1./16, 1./4, 3./8, 1./4, 1./16};
+
+
+/// \brief Denoise aColor, guided by aGuides.
+///
+/// \param aFilter1D The separable filter whose outer product gives the 2D taps.
+/// Its size must be odd.
+///
+/// Each iteration is processed in parallel by tiles.
+template <class T_filter1D = std::array<double, 5>>
+arte::Image<math::hdr::Rgb_f> denoiseAtrous(const arte::Image<math::hdr::Rgb_f> & aColor,
+                                            const GuideBuffers & aGuides,
+                                            const DenoiserParameters & aParameters = {},
+                                            const T_filter1D & aFilter1D = gB3Spline);
+
+
+//
+// Implementations
+//
+namespace detail {
+
+
+    inline float squaredDistance(const math::hdr::Rgb_f & a, const math::hdr::Rgb_f & b)
+    {
+        float r = a.r() - b.r();
+        float g = a.g() - b.g();
+        float bl = a.b() - b.b();
+        return r*r + g*g + bl*bl;
+    }
+
+
+    /// \brief Inverse of twice the variance, so a disabled (infinite) sigma gives a null factor.
+    inline float inverseTwoVariance(double aSigma)
+    {
+        return static_cast<float>(1. / (2. * aSigma * aSigma));
+    }
+
+
+    template <class T_filter1D>
+    void atrousIteration(const arte::Image<math::hdr::Rgb_f> & aInput,
+                         arte::Image<math::hdr::Rgb_f> & aOutput,
+                         const GuideBuffers & aGuides,
+                         const DenoiserParameters & aParameters,
+                         const T_filter1D & aFilter1D,
+                         int aIteration)
+    {
+        const int step = 1 << aIteration;
+        const int r = static_cast<int>(std::size(aFilter1D) / 2);
+        const int width = aInput.width();
+        const int height = aInput.height();
+
+        const float colorFactor  = inverseTwoVariance(aParameters.sigmaColor / step);
+        const float normalFactor = inverseTwoVariance(aParameters.sigmaNormal);
+        const float albedoFactor = inverseTwoVariance(aParameters.sigmaAlbedo);
+        const float depthFactor  = static_cast<float>(1. / (aParameters.sigmaDepth * step));
+
+        const int tilesX = (width + aParameters.tileSize - 1) / aParameters.tileSize;
+        const int tilesY = (height + aParameters.tileSize - 1) / aParameters.tileSize;
+
+        // Each tile only writes its own pixels in aOutput, and only reads from aInput.
+        parallelFor((std::size_t)(tilesX * tilesY), [&](std::size_t aTile)
+        {
+            const int xBegin = static_cast<int>(aTile % tilesX) * aParameters.tileSize;
+            const int yBegin = static_cast<int>(aTile / tilesX) * aParameters.tileSize;
+
+            for (int y = yBegin; y != std::min(yBegin + aParameters.tileSize, height); ++y)
+            {
+                for (int x = xBegin; x != std::min(xBegin + aParameters.tileSize, width); ++x)
+                {
+                    const std::size_t p = aGuides.index(x, y);
+                    const math::hdr::Rgb_f & colorP = aInput.at(x, y);
+
+                    math::hdr::Rgb_f accumulated{0.f, 0.f, 0.f};
+                    float weightSum = 0.f;
+                    for (int j = -r; j <= r; ++j)
+                    {
+                        // Implement "border" sampling for edges (clamping the tap to the image).
+                        const int qy = std::clamp(y + j * step, 0, height - 1);
+                        for (int i = -r; i <= r; ++i)
+                        {
+                            const int qx = std::clamp(x + i * step, 0, width - 1);
+                            const std::size_t q = aGuides.index(qx, qy);
+                            const math::hdr::Rgb_f & colorQ = aInput.at(qx, qy);
+
+                            math::Vec<3, float> normalDelta = aGuides.normals[p] - aGuides.normals[q];
+                            float depthDelta = std::abs(aGuides.depths[p] - aGuides.depths[q]);
+
+                            float weight =
+                                static_cast<float>(aFilter1D[i + r] * aFilter1D[j + r])
+                                * std::exp(- squaredDistance(colorP, colorQ) * colorFactor
+                                           - normalDelta.dot(normalDelta) * normalFactor
+                                           - squaredDistance(aGuides.albedos[p], aGuides.albedos[q]) * albedoFactor
+                                           - (depthDelta == 0.f ? 0.f : depthDelta * depthFactor));
+
+                            accumulated += colorQ * weight;
+                            weightSum += weight;
+                        }
+                    }
+                    // The center tap always has a weight of filter(r)^2 (all features are equal).
+                    aOutput.at(x, y) = accumulated / weightSum;
+                }
+            }
+        });
+    }
+
+
+} // namespace detail
+
+
+template <class T_filter1D>
+arte::Image<math::hdr::Rgb_f> denoiseAtrous(const arte::Image<math::hdr::Rgb_f> & aColor,
+                                            const GuideBuffers & aGuides,
+                                            const DenoiserParameters & aParameters,
+                                            const T_filter1D & aFilter1D)
+{
+    // we require that the filter has a middle element
+    assert(std::size(aFilter1D) % 2 == 1);
+    assert(aColor.dimensions() == aGuides.resolution);
+
+    // Avoid dividing by a null albedo (the illumination is lost there anyway).
+    constexpr float gMinAlbedo = 1.f / 255;
+    auto safeAlbedo = [&](int x, int y)
+    {
+        const math::hdr::Rgb_f & albedo = aGuides.albedos[aGuides.index(x, y)];
+        return math::hdr::Rgb_f{std::max(albedo.r(), gMinAlbedo),
+                                std::max(albedo.g(), gMinAlbedo),
+                                std::max(albedo.b(), gMinAlbedo)};
+    };
+
+    // Demodulate albedo
+    arte::Image<math::hdr::Rgb_f> input{aColor};
+    for (int y = 0; y != input.height(); ++y)
+    {
+        for (int x = 0; x != input.width(); ++x)
+        {
+            math::hdr::Rgb_f albedo = safeAlbedo(x, y);
+            math::hdr::Rgb_f & color = input.at(x, y);
+            color = math::hdr::Rgb_f{color.r() / albedo.r(), color.g() / albedo.g(), color.b() / albedo.b()};
+        }
+    }
+
+    // Ping-pong between the two images
+    arte::Image<math::hdr::Rgb_f> output{input};
+    for (int iteration = 0; iteration != aParameters.iterations; ++iteration)
+    {
+        detail::atrousIteration(input, output, aGuides, aParameters, aFilter1D, iteration);
+        std::swap(input, output);
+    }
+
+    // Modulate albedo back
+    for (int y = 0; y != input.height(); ++y)
+    {
+        for (int x = 0; x != input.width(); ++x)
+        {
+            input.at(x, y) = input.at(x, y).cwMul(safeAlbedo(x, y));
+        }
+    }
+    return input;
+}
+
+
+} // namespace focg
+} // namespace ad
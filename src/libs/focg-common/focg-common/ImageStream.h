@@ -0,0 +1,331 @@
+#pragma once
+
+
+#include "Tonemapping.h"
+
+#include <arte/Image.h>
+
+#include <math/Color.h>
+
+#include <fstream>
+#include <mutex>
+#include <numeric>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+
+namespace ad {
+namespace focg {
+
+
+/// \brief Write aImage as a binary PPM (P6) to aOut.
+///
+/// Contrary to arte::Image::saveFile(), the destination is any stream (e.g. a pipe).
+inline void writePpm(std::ostream & aOut, const arte::Image<math::sdr::Rgb> & aImage, bool aInvertVerticalAxis = false)
+{
+    aOut << "P6\n" << aImage.width() << " " << aImage.height() << "\n255\n";
+
+    std::vector<char> row((std::size_t)aImage.width() * 3);
+    for (int j = 0; j != aImage.height(); ++j)
+    {
+        int y = aInvertVerticalAxis ? aImage.height() - 1 - j : j;
+        for (int i = 0; i != aImage.width(); ++i)
+        {
+            const math::sdr::Rgb & pixel = aImage.at(i, y);
+            row[3 * i + 0] = static_cast<char>(pixel.r());
+            row[3 * i + 1] = static_cast<char>(pixel.g());
+            row[3 * i + 2] = static_cast<char>(pixel.b());
+        }
+        aOut.write(row.data(), row.size());
+    }
+}
+
+
+inline void writePpm(std::ostream & aOut,
+                     const arte::Image<math::sdr::Rgb> & aImage,
+                     arte::ImageOrientation aOrientation)
+{
+    writePpm(aOut, aImage, aOrientation == arte::ImageOrientation::InvertVerticalAxis);
+}
+
+
+enum class VideoFormat
+{
+    // YUV4MPEG2, 4:4:4 chroma with BT.601 limited range: `ffmpeg -i - out.mp4`
+    Y4m,
+    // Packed 8 bits RGB frames, without any header: `ffmpeg -f rawvideo -pix_fmt rgb24 -s WxH -r FPS -i - out.mp4`
+    RawRgb,
+};
+
+
+/// \brief Convert aCount RGB pixels to the Y, U and V planes (BT.601, limited range).
+///
+/// The fixed-point conversion is a branchless loop over the pixels, which the compiler vectorizes
+/// (on x86, deinterleaving the RGB bytes requires at least SSSE3, e.g. `-march=native`).
+inline void convertRgbToYuv(const math::sdr::Rgb * aPixels, std::size_t aCount,
+                            std::uint8_t * aY, std::uint8_t * aU, std::uint8_t * aV)
+{
+    for (std::size_t i = 0; i != aCount; ++i)
+    {
+        const int r = aPixels[i].r();
+        const int g = aPixels[i].g();
+        const int b = aPixels[i].b();
+        // The results are always in [16, 240], there is no need to clamp.
+        aY[i] = static_cast<std::uint8_t>((( 66 * r + 129 * g +  25 * b + 128) >> 8) +  16);
+        aU[i] = static_cast<std::uint8_t>(((-38 * r -  74 * g + 112 * b + 128) >> 8) + 128);
+        aV[i] = static_cast<std::uint8_t>(((112 * r -  94 * g -  18 * b + 128) >> 8) + 128);
+    }
+}
+
+
+/// \brief Write successive frames as a single video stream (e.g. to stdout, piped to an encoder).
+///
+/// Contrary to a file per frame, there is a single destination, opened once.
+class VideoStreamWriter
+{
+public:
+    /// \note For Y4M, the stream header is written on construction.
+    VideoStreamWriter(std::ostream & aOut,
+                      math::Size<2, int> aResolution,
+                      double aFramesPerSecond,
+                      VideoFormat aFormat);
+
+    /// \param aImage Must have the resolution of the stream.
+    void writeFrame(const arte::Image<math::sdr::Rgb> & aImage, bool aInvertVerticalAxis = false);
+
+    void writeFrame(const arte::Image<math::sdr::Rgb> & aImage, arte::ImageOrientation aOrientation)
+    { writeFrame(aImage, aOrientation == arte::ImageOrientation::InvertVerticalAxis); }
+
+private:
+    std::ostream & mOut;
+    math::Size<2, int> mResolution;
+    VideoFormat mFormat;
+    // Reused for each frame: the three planes for Y4M, the packed pixels for raw RGB.
+    std::vector<std::uint8_t> mBuffer;
+};
+
+
+inline VideoStreamWriter::VideoStreamWriter(std::ostream & aOut,
+                                            math::Size<2, int> aResolution,
+                                            double aFramesPerSecond,
+                                            VideoFormat aFormat) :
+    mOut{aOut},
+    mResolution{aResolution},
+    mFormat{aFormat},
+    mBuffer((std::size_t)aResolution.area() * 3)
+{
+    if (mFormat == VideoFormat::Y4m)
+    {
+        // The frame rate is a ratio of integers, with a millisecond precision.
+        long long numerator = std::llround(aFramesPerSecond * 1000);
+        long long denominator = 1000;
+        const long long divisor = std::gcd(numerator, denominator);
+        mOut << "YUV4MPEG2 W" << mResolution.width() << " H" << mResolution.height()
+             << " F" << numerator / divisor << ":" << denominator / divisor
+             << " Ip A1:1 C444\n";
+    }
+}
+
+
+inline void VideoStreamWriter::writeFrame(const arte::Image<math::sdr::Rgb> & aImage, bool aInvertVerticalAxis)
+{
+    if (aImage.dimensions() != mResolution)
+    {
+        throw std::invalid_argument{"Frame resolution does not match the video stream resolution."};
+    }
+
+    const std::size_t width = mResolution.width();
+    const std::size_t planeSize = (std::size_t)mResolution.area();
+    for (int j = 0; j != mResolution.height(); ++j)
+    {
+        const int y = aInvertVerticalAxis ? mResolution.height() - 1 - j : j;
+        const math::sdr::Rgb * row = &aImage.at(0, y);
+        if (mFormat == VideoFormat::Y4m)
+        {
+            convertRgbToYuv(row, width,
+                            mBuffer.data() + j * width,
+                            mBuffer.data() + planeSize + j * width,
+                            mBuffer.data() + 2 * planeSize + j * width);
+        }
+        else
+        {
+            for (std::size_t i = 0; i != width; ++i)
+            {
+                mBuffer[3 * (j * width + i) + 0] = row[i].r();
+                mBuffer[3 * (j * width + i) + 1] = row[i].g();
+                mBuffer[3 * (j * width + i) + 2] = row[i].b();
+            }
+        }
+    }
+
+    if (mFormat == VideoFormat::Y4m)
+    {
+        mOut << "FRAME\n";
+    }
+    mOut.write(reinterpret_cast<const char *>(mBuffer.data()), mBuffer.size());
+    if (!mOut)
+    {
+        throw std::runtime_error{"Error while writing video frame."};
+    }
+}
+
+
+enum class StreamingFormat
+{
+    Ppm, // 8 bits per channel, quantized by tonemapBand().
+    Pfm, // 32 bits float per channel, preserving the high dynamic range.
+};
+
+
+/// \brief Image file that is written band by band, so the whole image never has to reside in memory.
+///
+/// The header is written on construction, then each call to writeBand() writes complete rows
+/// at their final place in the file. Bands can be written from several threads, and in any order.
+///
+/// \note Both formats have fixed-size pixels, which is what allows to seek to any row directly.
+class StreamingImageFile
+{
+public:
+    /// \param aTonemapping Only used by the Ppm format, which then has the pixels of tonemap() on the complete image.
+    StreamingImageFile(const filesystem::path & aPath,
+                       math::Size<2, int> aResolution,
+                       StreamingFormat aFormat,
+                       const Tonemapping & aTonemapping = {});
+
+    /// \param aFirstRow Index of the first row of the band, with the image origin at the top-left.
+    /// \param aBand Pixels of complete rows, stored row after row.
+    void writeBand(int aFirstRow, const std::vector<math::hdr::Rgb_d> & aBand);
+
+    math::Size<2, int> getResolution() const
+    { return mResolution; }
+
+    static StreamingFormat DeduceFormat(const filesystem::path & aPath);
+
+private:
+    std::size_t getPixelSize() const
+    { return mFormat == StreamingFormat::Ppm ? 3 * sizeof(std::uint8_t) : 3 * sizeof(float); }
+
+    math::Size<2, int> mResolution;
+    StreamingFormat mFormat;
+    Tonemapping mTonemapping;
+    std::ofstream mFile;
+    std::streamoff mDataOffset;
+    std::mutex mFileMutex;
+};
+
+
+inline StreamingImageFile::StreamingImageFile(const filesystem::path & aPath,
+                                              math::Size<2, int> aResolution,
+                                              StreamingFormat aFormat,
+                                              const Tonemapping & aTonemapping) :
+    mResolution{aResolution},
+    mFormat{aFormat},
+    mTonemapping{aTonemapping},
+    mFile{aPath, std::ios::binary}
+{
+    if (!mFile)
+    {
+        throw std::runtime_error{"Cannot open '" + aPath.string() + "' for writing."};
+    }
+
+    // For PFM, a negative scale denotes little-endian data (i.e. the layout of all supported platforms).
+    mFile << (mFormat == StreamingFormat::Ppm ? "P6" : "PF") << "\n"
+          << mResolution.width() << " " << mResolution.height() << "\n"
+          << (mFormat == StreamingFormat::Ppm ? "255" : "-1.0") << "\n";
+    mDataOffset = mFile.tellp();
+}
+
+
+inline void StreamingImageFile::writeBand(int aFirstRow, const std::vector<math::hdr::Rgb_d> & aBand)
+{
+    const std::size_t width = mResolution.width();
+    assert(aBand.size() % width == 0);
+    const int rowCount = static_cast<int>(aBand.size() / width);
+    assert(aFirstRow >= 0 && aFirstRow + rowCount <= mResolution.height());
+
+    // Encode outside of the lock, only the file access is serialized.
+    std::vector<char> encoded(aBand.size() * getPixelSize());
+    std::streamoff fileRow;
+    if (mFormat == StreamingFormat::Ppm)
+    {
+        const arte::Image<math::sdr::Rgb> quantized =
+            tonemapBand(aBand, mResolution.width(), aFirstRow, mTonemapping);
+        for (int row = 0; row != rowCount; ++row)
+        {
+            for (std::size_t i = 0; i != width; ++i)
+            {
+                const math::sdr::Rgb & pixel = quantized.at((int)i, row);
+                const std::size_t pixelId = row * width + i;
+                encoded[3 * pixelId + 0] = static_cast<char>(pixel.r());
+                encoded[3 * pixelId + 1] = static_cast<char>(pixel.g());
+                encoded[3 * pixelId + 2] = static_cast<char>(pixel.b());
+            }
+        }
+        fileRow = aFirstRow;
+    }
+    else
+    {
+        // PFM stores rows from bottom to top: the band is still contiguous, but its rows are reversed.
+        for (int row = 0; row != rowCount; ++row)
+        {
+            char * destination = encoded.data() + (rowCount - 1 - row) * width * getPixelSize();
+            for (std::size_t i = 0; i != width; ++i)
+            {
+                const math::hdr::Rgb_d & source = aBand[row * width + i];
+                float channels[3]{(float)source.r(), (float)source.g(), (float)source.b()};
+                std::memcpy(destination + i * sizeof(channels), channels, sizeof(channels));
+            }
+        }
+        fileRow = mResolution.height() - (aFirstRow + rowCount);
+    }
+
+    std::scoped_lock lock{mFileMutex};
+    mFile.seekp(mDataOffset + fileRow * (std::streamoff)(width * getPixelSize()));
+    mFile.write(encoded.data(), encoded.size());
+    if (!mFile)
+    {
+        throw std::runtime_error{"Error while writing image band."};
+    }
+}
+
+
+inline StreamingFormat StreamingImageFile::DeduceFormat(const filesystem::path & aPath)
+{
+    if (aPath.extension() == ".ppm")
+    {
+        return StreamingFormat::Ppm;
+    }
+    else if (aPath.extension() == ".pfm")
+    {
+        return StreamingFormat::Pfm;
+    }
+    throw std::invalid_argument{"Unsupported streaming image extension: '" + aPath.extension().string() + "'."};
+}
+
+
+/// \brief Standard streams are opened in text mode on Windows, which would corrupt binary images.
+inline void setBinaryMode(std::FILE * aFile)
+{
+#ifdef _WIN32
+    _setmode(_fileno(aFile), _O_BINARY);
+#else
+    (void)aFile;
+#endif
+}
+
+
+} // namespace focg
+} // namespace ad
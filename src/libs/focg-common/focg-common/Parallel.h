@@ -0,0 +1,214 @@
+#pragma once
+
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <cstddef>
+
+
+namespace ad {
+namespace focg {
+
+
+inline unsigned int getDefaultThreadCount()
+{
+    // hardware_concurrency() is allowed to return 0 when it cannot be determined.
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+
+/// \brief Persistent worker threads, executing the jobs submitted to them in order.
+///
+/// Creating threads costs tens of microseconds, which adds up when parallelFor() is invoked
+/// several times per draw, for each mesh of each frame: its helpers run on a shared pool instead.
+/// The pool grows on demand up to the largest number of workers ever requested, and its threads live
+/// until the end of the program.
+class WorkerPool
+{
+public:
+    WorkerPool() = default;
+    WorkerPool(const WorkerPool &) = delete;
+    WorkerPool & operator=(const WorkerPool &) = delete;
+
+    ~WorkerPool();
+
+    /// \brief The pool shared by all parallelFor() invocations.
+    static WorkerPool & getShared()
+    {
+        static WorkerPool pool;
+        return pool;
+    }
+
+    /// \brief Queue aJob, after making sure at least aWorkerCount threads are available.
+    void submit(std::function<void()> aJob, std::size_t aWorkerCount);
+
+private:
+    void work();
+
+    std::mutex mMutex;
+    std::condition_variable mJobAvailable;
+    std::deque<std::function<void()>> mJobs;
+    std::vector<std::thread> mWorkers;
+    bool mStopping{false};
+};
+
+
+/// \brief Invoke aTask(i) for each i in [0, aCount), distributing the indices over aThreadCount threads.
+///
+/// The calling thread is one of them, the others are helpers of the shared WorkerPool.
+/// Indices are handed out dynamically (in increasing order) so that uneven tasks balance out,
+/// yet tasks complete in any order. Returns once all tasks completed.
+/// \note If any task throws, the remaining indices are not started and the first exception is rethrown.
+/// \note Invocations can be nested (a task can itself invoke parallelFor()): the caller never waits for a helper
+/// that did not start, it processes the indices itself.
+template <class F_task>
+void parallelFor(std::size_t aCount, F_task && aTask, unsigned int aThreadCount = getDefaultThreadCount());
+
+
+//
+// Implementations
+//
+inline WorkerPool::~WorkerPool()
+{
+    {
+        std::scoped_lock lock{mMutex};
+        mStopping = true;
+    }
+    mJobAvailable.notify_all();
+    for (std::thread & worker : mWorkers)
+    {
+        worker.join();
+    }
+}
+
+
+inline void WorkerPool::submit(std::function<void()> aJob, std::size_t aWorkerCount)
+{
+    {
+        std::scoped_lock lock{mMutex};
+        while (mWorkers.size() < aWorkerCount)
+        {
+            mWorkers.emplace_back(&WorkerPool::work, this);
+        }
+        mJobs.push_back(std::move(aJob));
+    }
+    mJobAvailable.notify_one();
+}
+
+
+inline void WorkerPool::work()
+{
+    for (;;)
+    {
+        std::function<void()> job;
+        {
+            std::unique_lock lock{mMutex};
+            mJobAvailable.wait(lock, [this]{ return mStopping || !mJobs.empty(); });
+            if (mJobs.empty())
+            {
+                return; // Stopping, once all queued jobs are done.
+            }
+            job = std::move(mJobs.front());
+            mJobs.pop_front();
+        }
+        job();
+    }
+}
+
+
+namespace detail {
+
+
+    /// \brief Synchronization of the caller of parallelFor() with its helpers.
+    ///
+    /// Shared with the helpers, since a helper can start after the caller returned
+    /// (it then does nothing, all the indices being processed).
+    struct ParallelForState
+    {
+        std::atomic<std::size_t> next{0};
+        std::mutex mutex;
+        std::condition_variable helpersDone;
+        unsigned int runningHelpers{0};
+        bool finished{false}; // Set by the caller once it processed all the indices it could.
+        std::exception_ptr exception;
+    };
+
+
+} // namespace detail
+
+
+template <class F_task>
+void parallelFor(std::size_t aCount, F_task && aTask, unsigned int aThreadCount)
+{
+    auto state = std::make_shared<detail::ParallelForState>();
+
+    auto worker = [&task = aTask, aCount](detail::ParallelForState & aState)
+    {
+        for (std::size_t index = aState.next++; index < aCount; index = aState.next++)
+        {
+            try
+            {
+                task(index);
+            }
+            catch (...)
+            {
+                std::scoped_lock lock{aState.mutex};
+                if (!aState.exception)
+                {
+                    aState.exception = std::current_exception();
+                }
+                aState.next = aCount; // Prevent starting any further task.
+            }
+        }
+    };
+
+    const unsigned int threadCount =
+        static_cast<unsigned int>(std::min<std::size_t>(std::max(1u, aThreadCount), aCount));
+
+    // The calling thread is also a worker.
+    for (unsigned int helper = 1; helper < threadCount; ++helper)
+    {
+        WorkerPool::getShared().submit(
+            [state, worker]()
+            {
+                {
+                    std::scoped_lock lock{state->mutex};
+                    if (state->finished)
+                    {
+                        return; // The caller might be gone, worker must not be invoked.
+                    }
+                    ++state->runningHelpers;
+                }
+                worker(*state);
+                {
+                    std::scoped_lock lock{state->mutex};
+                    --state->runningHelpers;
+                }
+                state->helpersDone.notify_one();
+            },
+            threadCount - 1);
+    }
+    worker(*state);
+
+    std::unique_lock lock{state->mutex};
+    state->finished = true;
+    state->helpersDone.wait(lock, [&state]{ return state->runningHelpers == 0; });
+
+    if (state->exception)
+    {
+        std::rethrow_exception(state->exception);
+    }
+}
+
+
+} // namespace focg
+} // namespace ad
@@ -0,0 +1,172 @@
+#pragma once
+
+
+#include "ImageStream.h"
+
+#include <math/Vector.h>
+
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+namespace ad {
+namespace focg {
+
+
+// Notes:
+// The render service is a long-running process reading requests on its input stream,
+// one request per line, and streaming back one answer per request on its output stream.
+// This allows to load assets and build the scene once, then render many variations of it
+// (e.g. different camera or lights) at the sole cost of rendering.
+//
+// A request is a command followed by `key=value` tokens, values being comma separated numbers:
+//   render eye=0,600,1000 target=0,0,-100 resolution=400,400 light0=-3000,2000,800
+//   quit
+//
+// A `render` request is answered with a binary PPM (P6) image,
+// any failure is answered by a single line starting with `error `.
+// Keys that are not understood by the renderer are ignored.
+
+
+struct RenderRequest
+{
+    bool has(const std::string & aKey) const
+    {
+        return parameters.find(aKey) != parameters.end();
+    }
+
+    double get(const std::string & aKey, double aDefault) const
+    {
+        if (auto found = parameters.find(aKey); found != parameters.end())
+        {
+            expectCount(*found, 1);
+            return found->second.front();
+        }
+        return aDefault;
+    }
+
+    /// \brief Read the N components of the value at aKey (e.g. a Position, Vec or Size).
+    template <template <int, class> class TT_vector, int N, class T_value>
+    TT_vector<N, T_value> get(const std::string & aKey, TT_vector<N, T_value> aDefault) const
+    {
+        if (auto found = parameters.find(aKey); found != parameters.end())
+        {
+            expectCount(*found, N);
+            for (std::size_t i = 0; i != N; ++i)
+            {
+                aDefault[i] = static_cast<T_value>(found->second[i]);
+            }
+        }
+        return aDefault;
+    }
+
+    std::string command;
+    std::map<std::string, std::vector<double>> parameters;
+
+private:
+    template <class T_entry>
+    static void expectCount(const T_entry & aEntry, std::size_t aCount)
+    {
+        if (aEntry.second.size() != aCount)
+        {
+            throw std::invalid_argument{"Parameter '" + aEntry.first + "' expects "
+                                        + std::to_string(aCount) + " value(s), got "
+                                        + std::to_string(aEntry.second.size()) + "."};
+        }
+    }
+};
+
+
+inline RenderRequest parseRequest(const std::string & aLine)
+{
+    RenderRequest request;
+    std::istringstream input{aLine};
+    input >> request.command;
+
+    for (std::string token; input >> token;)
+    {
+        std::size_t equal = token.find('=');
+        if (equal == std::string::npos || equal == 0)
+        {
+            throw std::invalid_argument{"Invalid parameter '" + token + "', expected key=value."};
+        }
+
+        std::vector<double> values;
+        std::istringstream valueStream{token.substr(equal + 1)};
+        for (std::string value; std::getline(valueStream, value, ',');)
+        {
+            std::size_t consumed = 0;
+            try
+            {
+                values.push_back(std::stod(value, &consumed));
+            }
+            catch (std::logic_error &)
+            {
+                consumed = 0;
+            }
+            if (consumed == 0 || consumed != value.size())
+            {
+                throw std::invalid_argument{"Invalid number '" + value + "' in parameter '" + token + "'."};
+            }
+        }
+        request.parameters[token.substr(0, equal)] = std::move(values);
+    }
+
+    return request;
+}
+
+
+/// \brief Serve render requests from aIn until `quit` or end of input.
+///
+/// \param aRender Callable taking a `const RenderRequest &` and returning an `arte::Image<math::sdr::Rgb>`.
+/// It is expected to reuse the resident scene, and may throw to report a failure to the client.
+/// \param aInvertVerticalAxis Forwarded to writePpm(), for renderers with a bottom-left image origin.
+template <class F_render>
+void serve(std::istream & aIn, std::ostream & aOut, F_render && aRender, bool aInvertVerticalAxis = false)
+{
+    for (std::string line; std::getline(aIn, line);)
+    {
+        try
+        {
+            RenderRequest request = parseRequest(line);
+
+            if (request.command.empty())
+            {
+                continue;
+            }
+            else if (request.command == "quit")
+            {
+                return;
+            }
+            else if (request.command == "render")
+            {
+                auto start = std::chrono::steady_clock::now();
+                writePpm(aOut, aRender(request), aInvertVerticalAxis);
+                aOut.flush();
+
+                std::clog << "Rendered request in "
+                          << std::chrono::duration_cast<std::chrono::milliseconds>(
+                                std::chrono::steady_clock::now() - start).count()
+                          << " ms.\n";
+            }
+            else
+            {
+                throw std::invalid_argument{"Unknown command '" + request.command + "'."};
+            }
+        }
+        catch (std::exception & e)
+        {
+            aOut << "error " << e.what() << '\n';
+            aOut.flush();
+        }
+    }
+}
+
+
+} // namespace focg
+} // namespace ad
@@ -0,0 +1,336 @@
+#pragma once
+
+
+#include <arte/Image.h>
+
+#include <math/Color.h>
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <vector>
+
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+
+
+namespace ad {
+namespace focg {
+
+
+enum class ToneOperator
+{
+    Clamp,    // Saturates values above 1.
+    Reinhard, // x / (1 + x), compresses the whole range.
+};
+
+
+struct Tonemapping
+{
+    double exposure{0.}; // In stops, i.e. radiance is scaled by 2^exposure before the tone operator.
+    ToneOperator toneOperator{ToneOperator::Clamp};
+    bool dithering{false}; // Ordered dithering (4x4 Bayer matrix), hiding banding in smooth gradients.
+};
+
+
+/// \brief High dynamic range framebuffer, accumulating weighted radiance samples for each pixel.
+///
+/// Quantization is deferred to tonemap(), so a render can be refined by accumulating more samples,
+/// or re-exposed, without being traced again.
+///
+/// \note Storage is planar (one contiguous array per channel), so the tonemapping pass processes
+/// contiguous floats that the compiler can vectorize.
+class HdrFramebuffer
+{
+public:
+    explicit HdrFramebuffer(math::Size<2, int> aResolution);
+
+    void accumulate(int aX, int aY, const math::hdr::Rgb_d & aSample, float aWeight = 1.f)
+    {
+        std::size_t index = getIndex(aX, aY);
+        mRed[index]    += static_cast<float>(aSample.r()) * aWeight;
+        mGreen[index]  += static_cast<float>(aSample.g()) * aWeight;
+        mBlue[index]   += static_cast<float>(aSample.b()) * aWeight;
+        mWeights[index] += aWeight;
+    }
+
+    /// \brief The weighted average of the samples accumulated at (aX, aY).
+    math::hdr::Rgb_f resolve(int aX, int aY) const;
+
+    /// \brief The weighted average of all pixels, e.g. to post-process radiance before tonemapping.
+    arte::Image<math::hdr::Rgb_f> resolve() const;
+
+    void clear();
+
+    math::Size<2, int> getResolution() const
+    { return mResolution; }
+
+    const float * redRow(int aY) const
+    { return mRed.data() + getIndex(0, aY); }
+
+    const float * greenRow(int aY) const
+    { return mGreen.data() + getIndex(0, aY); }
+
+    const float * blueRow(int aY) const
+    { return mBlue.data() + getIndex(0, aY); }
+
+    const float * weightRow(int aY) const
+    { return mWeights.data() + getIndex(0, aY); }
+
+private:
+    std::size_t getIndex(int aX, int aY) const
+    {
+        assert(aX >= 0 && aX < mResolution.width() && aY >= 0 && aY < mResolution.height());
+        return aX + (std::size_t)aY * mResolution.width();
+    }
+
+    math::Size<2, int> mResolution;
+    std::vector<float> mRed;
+    std::vector<float> mGreen;
+    std::vector<float> mBlue;
+    std::vector<float> mWeights;
+};
+
+
+/// \brief Tonemap and quantize the weighted average of each pixel of aFramebuffer.
+arte::Image<math::sdr::Rgb> tonemap(const HdrFramebuffer & aFramebuffer, const Tonemapping & aParameters = {});
+
+/// \brief Tonemap and quantize an image of (already resolved) radiance values.
+arte::Image<math::sdr::Rgb> tonemap(const arte::Image<math::hdr::Rgb_f> & aImage, const Tonemapping & aParameters = {});
+
+/// \brief Tonemap and quantize a band of complete rows of radiance values (stored row after row),
+/// whose first row is the row aFirstRow of the image.
+///
+/// The pixels are the same as tonemap() would give for these rows of the complete image
+/// (the dithering pattern is anchored on the image rows), so images produced band by band can be quantized.
+arte::Image<math::sdr::Rgb> tonemapBand(const std::vector<math::hdr::Rgb_d> & aBand,
+                                        int aWidth,
+                                        int aFirstRow,
+                                        const Tonemapping & aParameters = {});
+
+
+//
+// Implementations
+//
+inline HdrFramebuffer::HdrFramebuffer(math::Size<2, int> aResolution) :
+    mResolution{aResolution},
+    mRed((std::size_t)aResolution.area(), 0.f),
+    mGreen((std::size_t)aResolution.area(), 0.f),
+    mBlue((std::size_t)aResolution.area(), 0.f),
+    mWeights((std::size_t)aResolution.area(), 0.f)
+{}
+
+
+inline math::hdr::Rgb_f HdrFramebuffer::resolve(int aX, int aY) const
+{
+    std::size_t index = getIndex(aX, aY);
+    float weight = mWeights[index];
+    if (weight <= 0.f)
+    {
+        return math::hdr::Rgb_f{0.f, 0.f, 0.f};
+    }
+    return math::hdr::Rgb_f{mRed[index] / weight, mGreen[index] / weight, mBlue[index] / weight};
+}
+
+
+inline arte::Image<math::hdr::Rgb_f> HdrFramebuffer::resolve() const
+{
+    auto result = arte::Image<math::hdr::Rgb_f>::makeUninitialized(mResolution);
+    for (int y = 0; y != mResolution.height(); ++y)
+    {
+        for (int x = 0; x != mResolution.width(); ++x)
+        {
+            result.at(x, y) = resolve(x, y);
+        }
+    }
+    return result;
+}
+
+
+inline void HdrFramebuffer::clear()
+{
+    std::fill(mRed.begin(), mRed.end(), 0.f);
+    std::fill(mGreen.begin(), mGreen.end(), 0.f);
+    std::fill(mBlue.begin(), mBlue.end(), 0.f);
+    std::fill(mWeights.begin(), mWeights.end(), 0.f);
+}
+
+
+namespace detail {
+
+
+    // 4x4 Bayer index matrix.
+    constexpr std::array<int, 16> gBayer4x4{
+         0,  8,  2, 10,
+        12,  4, 14,  6,
+         3, 11,  1,  9,
+        15,  7, 13,  5,
+    };
+
+
+    /// \brief Per-pixel offset (in quantization steps) for row aY, centered on zero.
+    inline void fillDitherRow(std::vector<float> & aOffsets, int aY, bool aDithering)
+    {
+        for (std::size_t x = 0; x != aOffsets.size(); ++x)
+        {
+            aOffsets[x] = aDithering ? (gBayer4x4[(aY % 4) * 4 + (x % 4)] + 0.5f) / 16.f - 0.5f : 0.f;
+        }
+    }
+
+
+    /// \brief Tonemap and quantize aCount values of a single channel.
+    ///
+    /// Written as a branchless loop over contiguous floats, without aliasing,
+    /// so it compiles to SIMD instructions (this is the hot loop of the pass).
+    template <ToneOperator N_operator>
+    void tonemapChannel(const float * __restrict aSums,
+                        const float * __restrict aWeights,
+                        const float * __restrict aDitherOffsets,
+                        std::uint8_t * __restrict aOut,
+                        std::size_t aCount,
+                        float aScale)
+    {
+        for (std::size_t i = 0; i != aCount; ++i)
+        {
+            // A pixel without samples has a null sum, the max() only guards the division.
+            float value = aSums[i] * aScale / std::max(aWeights[i], std::numeric_limits<float>::min());
+            if constexpr (N_operator == ToneOperator::Reinhard)
+            {
+                value = value / (1.f + value);
+            }
+            // Round to nearest, after offsetting by the dither threshold.
+            const float rounded = value * 255.f + aDitherOffsets[i] + 0.5f;
+            // Comparisons with NaN (e.g. from a 0 * inf sample) are false, so it is quantized to 0:
+            // casting it to an integer would be undefined behaviour.
+            const float quantized = rounded >= 0.f ? std::min(rounded, 255.f) : 0.f;
+            aOut[i] = static_cast<std::uint8_t>(quantized);
+        }
+    }
+
+
+    inline void tonemapChannel(const float * aSums,
+                               const float * aWeights,
+                               const float * aDitherOffsets,
+                               std::uint8_t * aOut,
+                               std::size_t aCount,
+                               float aScale,
+                               ToneOperator aOperator)
+    {
+        switch (aOperator)
+        {
+        case ToneOperator::Clamp:
+            return tonemapChannel<ToneOperator::Clamp>(aSums, aWeights, aDitherOffsets, aOut, aCount, aScale);
+        case ToneOperator::Reinhard:
+            return tonemapChannel<ToneOperator::Reinhard>(aSums, aWeights, aDitherOffsets, aOut, aCount, aScale);
+        }
+    }
+
+
+    /// \param aFirstRow Image row of the first of the aResolution.height() rows, anchoring the dithering pattern.
+    template <class F_rowProvider>
+    arte::Image<math::sdr::Rgb> tonemapRows(math::Size<2, int> aResolution,
+                                            const Tonemapping & aParameters,
+                                            F_rowProvider && aGetRow,
+                                            int aFirstRow = 0)
+    {
+        const std::size_t width = aResolution.width();
+        const float scale = static_cast<float>(std::exp2(aParameters.exposure));
+
+        auto result = arte::Image<math::sdr::Rgb>::makeUninitialized(aResolution);
+        std::vector<float> ditherOffsets(width);
+        std::array<std::vector<std::uint8_t>, 3> quantized;
+        quantized.fill(std::vector<std::uint8_t>(width));
+
+        for (int y = 0; y != aResolution.height(); ++y)
+        {
+            fillDitherRow(ditherOffsets, aFirstRow + y, aParameters.dithering);
+
+            // Channel sums, then weights.
+            std::array<const float *, 4> row = aGetRow(y);
+            for (std::size_t channel = 0; channel != 3; ++channel)
+            {
+                tonemapChannel(row[channel], row[3], ditherOffsets.data(), quantized[channel].data(),
+                               width, scale, aParameters.toneOperator);
+            }
+
+            for (std::size_t x = 0; x != width; ++x)
+            {
+                result.at((int)x, y) = math::sdr::Rgb{quantized[0][x], quantized[1][x], quantized[2][x]};
+            }
+        }
+
+        return result;
+    }
+
+
+} // namespace detail
+
+
+inline arte::Image<math::sdr::Rgb> tonemap(const HdrFramebuffer & aFramebuffer, const Tonemapping & aParameters)
+{
+    return detail::tonemapRows(aFramebuffer.getResolution(), aParameters,
+        [&aFramebuffer](int aY) -> std::array<const float *, 4>
+        {
+            return {
+                aFramebuffer.redRow(aY),
+                aFramebuffer.greenRow(aY),
+                aFramebuffer.blueRow(aY),
+                aFramebuffer.weightRow(aY),
+            };
+        });
+}
+
+
+inline arte::Image<math::sdr::Rgb> tonemap(const arte::Image<math::hdr::Rgb_f> & aImage, const Tonemapping & aParameters)
+{
+    const std::size_t width = aImage.width();
+    // The image is interleaved, each row is first deinterleaved to planar storage.
+    std::array<std::vector<float>, 3> planar;
+    planar.fill(std::vector<float>(width));
+    const std::vector<float> weights(width, 1.f);
+
+    return detail::tonemapRows(aImage.dimensions(), aParameters,
+        [&](int aY) -> std::array<const float *, 4>
+        {
+            for (std::size_t x = 0; x != width; ++x)
+            {
+                const math::hdr::Rgb_f & pixel = aImage.at((int)x, aY);
+                planar[0][x] = pixel.r();
+                planar[1][x] = pixel.g();
+                planar[2][x] = pixel.b();
+            }
+            return {planar[0].data(), planar[1].data(), planar[2].data(), weights.data()};
+        });
+}
+
+
+inline arte::Image<math::sdr::Rgb> tonemapBand(const std::vector<math::hdr::Rgb_d> & aBand,
+                                               int aWidth,
+                                               int aFirstRow,
+                                               const Tonemapping & aParameters)
+{
+    const std::size_t width = aWidth;
+    assert(aBand.size() % width == 0);
+    std::array<std::vector<float>, 3> planar;
+    planar.fill(std::vector<float>(width));
+    const std::vector<float> weights(width, 1.f);
+
+    return detail::tonemapRows({aWidth, static_cast<int>(aBand.size() / width)}, aParameters,
+        [&](int aY) -> std::array<const float *, 4>
+        {
+            for (std::size_t x = 0; x != width; ++x)
+            {
+                const math::hdr::Rgb_d & pixel = aBand[aY * width + x];
+                planar[0][x] = static_cast<float>(pixel.r());
+                planar[1][x] = static_cast<float>(pixel.g());
+                planar[2][x] = static_cast<float>(pixel.b());
+            }
+            return {planar[0].data(), planar[1].data(), planar[2].data(), weights.data()};
+        },
+        aFirstRow);
+}
+
+
+} // namespace focg
+} // namespace ad